@@ -0,0 +1,123 @@
+#ifndef bpred_h_
+#define bpred_h_
+
+// branch prediction: direction predictors, a branch target buffer and a return address stack, fed the retired
+// control instructions. Works with the functional emulator alone, and tells the timing models which ones missed.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "retire.h"
+
+enum PredictorKind : std::uint8_t {
+    PRED_STATIC = 0,  // backward taken, forward not taken
+    PRED_BIMODAL,     // 2-bit counters by PC
+    PRED_GSHARE,      // 2-bit counters by PC xor global history
+    PRED_TAGE,        // bimodal base plus four tagged tables over geometric history lengths
+    PRED_COUNT
+};
+
+constexpr uint32_t BTB_ENTRIES = 512;  // direct mapped
+constexpr uint32_t RAS_ENTRIES = 16;   // wraps around, overwriting the oldest return
+
+// conditional branch direction, one instance per predictor in the run
+class DirectionPredictor {
+   public:
+    virtual ~DirectionPredictor() = default;
+    virtual bool predict(uint32_t pc, uint32_t target) = 0;
+    // called with the outcome right after `predict()` for the same branch
+    virtual void update(uint32_t pc, bool taken) = 0;
+};
+
+/**
+ * @return a new direction predictor of `kind`, at its default size
+ */
+std::unique_ptr<DirectionPredictor> make_predictor(PredictorKind kind);
+
+struct BranchStats {
+    uint64_t branches = 0;           // conditional
+    uint64_t directionMisses = 0;
+    uint64_t jumps = 0;              // JMP JMR CALL RET
+    uint64_t targetMisses = 0;       // taken control transfers the BTB or return stack had the wrong target for
+    uint64_t mispredicts() const { return directionMisses + targetMisses; }
+};
+
+/**
+ * @brief One front end: a direction predictor with its own BTB and return address stack.
+ * @details A prediction is right when the direction is and, if taken, the BTB (JMP, CALL, conditional
+ * branches, JMR) or the return stack (RET, and JMR when the BTB has nothing) had the target. CALL pushes its
+ * return address; a JMR that lands on the top of the stack is treated as a return and pops it.
+ */
+class BranchUnit {
+   public:
+    PredictorKind kind;
+    BranchStats stats;
+
+    explicit BranchUnit(PredictorKind kind);
+
+    /**
+     * @brief Predicts and trains on one control instruction.
+     * @return TRUE if it was mispredicted
+     */
+    bool retire(const RetiredInstr& r);
+
+   private:
+    struct BtbEntry {
+        bool valid = false;
+        uint32_t pc = 0;
+        uint32_t target = 0;
+    };
+
+    std::unique_ptr<DirectionPredictor> direction;
+    std::vector<BtbEntry> btb;
+    uint32_t ras[RAS_ENTRIES] = {};
+    uint32_t rasTop = 0;    // next free slot
+    uint32_t rasDepth = 0;  // valid entries, at most RAS_ENTRIES
+
+    BtbEntry& btbEntry(uint32_t pc) { return btb[(pc >> 3) & (BTB_ENTRIES - 1)]; }
+    bool btbHas(uint32_t pc, uint32_t target);
+};
+
+// executions and mispredictions of one branch, for the per-PC report
+struct BranchSite {
+    uint8_t op = 0;
+    uint64_t executed = 0;
+    uint64_t taken = 0;
+    std::vector<uint64_t> misses;  // per unit, in `bpred_units` order
+};
+
+extern bool bpred_enabled;
+extern std::vector<BranchUnit> bpred_units;  // the first one decides what the timing models see as mispredicted
+extern uint64_t bpred_instructions;          // retired while predicting, for MPKI
+
+/**
+ * @brief Parses a comma separated list of predictor names: static, bimodal, gshare, tage.
+ * @return FALSE on an unknown name or an empty list
+ */
+bool parsePredictorList(const std::string& spec, std::vector<PredictorKind>& kinds);
+
+/**
+ * @return the name `parsePredictorList()` takes for `kind`
+ */
+const char* predictor_name(PredictorKind kind);
+
+/**
+ * @brief Starts predicting every retired control instruction with one unit per kind.
+ * @param perSite also count executions and mispredictions per branch PC
+ */
+void bpred_start(const std::vector<PredictorKind>& kinds, bool perSite);
+
+/**
+ * @brief Counts one retired instruction and, for control instructions, runs every unit over it. Marks `r` as
+ * predicted, and as mispredicted when the first unit missed it.
+ */
+void bpred_retire(RetiredInstr& r);
+
+/**
+ * @brief Writes `pc,op,executed,taken` and a mispredictions column per unit as CSV, one row per branch PC.
+ * @return FALSE if the file can't be written or per-PC counts weren't collected
+ */
+bool write_bpred_report(const char* filename);
+
+#endif
@@ -0,0 +1,488 @@
+#ifndef cache_h_
+#define cache_h_
+
+// the cache timing model. The emulator drives one instance (`cache_model`) whose lines also carry data, trace
+// replay drives as many data-less instances as it has worker threads.
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "dram.h"
+#include "emu4380.h"
+#include "heatmap.h"
+#include "regions.h"
+#include "spsc.h"
+
+// who an access belongs to, for way partitioning
+enum CachePartition : std::uint8_t { PART_CODE = 0, PART_STATIC, PART_HEAP, PART_STACK, PART_COUNT };
+
+enum PartitionMode : std::uint8_t {
+    PARTITION_NONE,
+    PARTITION_FIXED,    // `CacheConfig::quotas`
+    PARTITION_UTILITY,  // resized every `CacheConfig::repartition` accesses from what extra ways would have hit
+};
+
+/**
+ * @brief Partition of a `cls` access at `addr`: instruction fetches are code, data goes by `regionOf()`, with the
+ * free gap between heap and stack given to the stack, which grows down into it.
+ */
+inline CachePartition partitionOf(uint32_t addr, AccessClass cls) {
+    if (cls == CLASS_IFETCH) return PART_CODE;
+    switch (regionOf(addr)) {
+        case REGION_CODE:
+            return PART_STATIC;
+        case REGION_HEAP:
+            return PART_HEAP;
+        default:
+            return PART_STACK;
+    }
+}
+
+/**
+ * @brief A cache geometry, as picked by `-c`, `--cache` or a sweep grid point
+ * @details `ways == 0` stands for fully associative (`ways == lines`).
+ */
+struct CacheConfig {
+    uint32_t blockSize = BLOCK_SIZE;
+    uint32_t lines = NUM_CACHE_LINES;
+    uint32_t ways = 1;
+    ReplacementPolicy policy = POLICY_LRU;
+    uint32_t victims = 0;        // victim cache entries, 0 for none
+    uint32_t victimLatency = 2;  // cycles charged for an access served by the victim cache
+    bool classify = false;       // split misses into compulsory, capacity and conflict
+    uint32_t mshrs = 0;          // miss status holding registers, 0 for a blocking cache
+    uint32_t sectorSize = 0;     // bytes per sector, 0 for lines that are filled and written back whole
+    uint32_t sectorFill = 1;     // sectors fetched per miss: the aligned group holding the requested one
+    PartitionMode partition = PARTITION_NONE;
+    uint32_t quotas[PART_COUNT] = {};  // ways each partition fills with PARTITION_FIXED, all 0 for an even split
+    uint32_t repartition = 4096;       // accesses between PARTITION_UTILITY resizes
+};
+
+constexpr uint32_t MAX_VICTIMS = 16;
+constexpr uint32_t MAX_MSHRS = 64;
+
+// hit/miss counters, kept for the whole cache and for every set
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;  // every access the cache itself missed, including the ones the victim cache served
+    uint64_t writebacks = 0;
+    uint64_t victimHits = 0;
+    uint64_t evictions = 0;  // valid lines replaced by a fill
+
+    // the three C's, only counted when the cache classifies its misses; with `sectorMisses` they add up to `misses`
+    uint64_t compulsory = 0;
+    uint64_t capacity = 0;
+    uint64_t conflict = 0;
+
+    uint64_t splits = 0;        // word accesses that ran into another block or page frame, two lookups each
+    uint64_t batchedFills = 0;  // of those, both halves filled from memory in one request
+
+    // only counted with sectored lines
+    uint64_t sectorMisses = 0;    // the block was resident but a sector the access needed wasn't (also in `misses`)
+    uint64_t sectorFills = 0;     // sectors transferred in
+    uint64_t evictedSectors = 0;  // sectors of the lines evicted
+    uint64_t evictedValid = 0;    // of those, filled
+    uint64_t evictedUsed = 0;     // of those, accessed at least once
+
+    // per `CachePartition`, whether or not the ways are partitioned
+    uint64_t partHits[PART_COUNT] = {};
+    uint64_t partMisses[PART_COUNT] = {};
+    uint64_t repartitions = 0;
+
+    // only counted with MSHRs
+    uint64_t secondaryMisses = 0;  // accesses merged into a fill already in flight
+    uint64_t mshrStallCycles = 0;  // waiting for a free MSHR
+    uint64_t missCycles = 0;       // summed over every fill and write-back, from issue to completion
+    uint64_t missBusyCycles = 0;   // cycles with at least one of them outstanding
+    uint64_t cycles = 0;           // charged for every access
+    uint64_t blockingCycles = 0;   // what a blocking cache would have charged for the same accesses
+
+    // memory-level parallelism: fills and write-backs outstanding together, on average, while any was
+    double mlp() const { return missBusyCycles ? static_cast<double>(missCycles) / missBusyCycles : 0.0; }
+
+    // fraction of an evicted line's sectors that were used before it left
+    double sectorUtilization() const { return evictedSectors ? static_cast<double>(evictedUsed) / evictedSectors : 0.0; }
+
+    void add(const CacheStats& other) {
+        hits += other.hits;
+        misses += other.misses;
+        writebacks += other.writebacks;
+        victimHits += other.victimHits;
+        evictions += other.evictions;
+        compulsory += other.compulsory;
+        capacity += other.capacity;
+        conflict += other.conflict;
+        splits += other.splits;
+        batchedFills += other.batchedFills;
+        sectorMisses += other.sectorMisses;
+        sectorFills += other.sectorFills;
+        evictedSectors += other.evictedSectors;
+        evictedValid += other.evictedValid;
+        evictedUsed += other.evictedUsed;
+        for (uint32_t p = 0; p < PART_COUNT; p++) {
+            partHits[p] += other.partHits[p];
+            partMisses[p] += other.partMisses[p];
+        }
+        repartitions += other.repartitions;
+        secondaryMisses += other.secondaryMisses;
+        mshrStallCycles += other.mshrStallCycles;
+        missCycles += other.missCycles;
+        missBusyCycles += other.missBusyCycles;
+        cycles += other.cycles;
+        blockingCycles += other.blockingCycles;
+    }
+};
+
+enum MissClass { MISS_NONE, MISS_COMPULSORY, MISS_CAPACITY, MISS_CONFLICT };
+
+/**
+ * @brief Sorts misses into the three C's.
+ * @details A miss on a block never touched before is compulsory. Otherwise a shadow fully associative LRU cache
+ * with as many lines as the real one decides: if the shadow missed too the miss is a capacity miss, if it hit the
+ * real cache only missed because of where the block maps, a conflict miss. One hash lookup per access, the
+ * shadow's LRU order is a linked list spliced in O(1).
+ */
+struct MissClassifier {
+    explicit MissClassifier(size_t lines) : capacity(lines) {}
+
+    /**
+     * @brief Feeds one access, hit or miss, and classifies it.
+     * @return MISS_NONE when `miss` is FALSE
+     */
+    MissClass access(uint32_t block, bool miss);
+
+   private:
+    size_t capacity;
+    std::list<uint32_t> lru;  // shadow cache contents, most recently used first
+    // every block ever touched, with its place in `lru`, or `lru.end()` once the shadow evicted it
+    std::unordered_map<uint32_t, std::list<uint32_t>::iterator> blocks;
+};
+
+/**
+ * @brief Utility monitors for utility-based way partitioning.
+ * @details Every partition gets a shadow LRU tag directory with all the ways, kept for one set in 32 (every set in
+ * smaller caches). A shadow hit at LRU position `p` is a hit the partition only gets with more than `p` ways, so
+ * `hits[part][p]` is the utility of its `p + 1`th way.
+ */
+struct UtilityMonitor {
+    UtilityMonitor(uint32_t ways, uint32_t sets);
+
+    void access(uint8_t part, uint32_t setidx, uint32_t block);
+
+    /**
+     * @brief Splits `ways` ways, at least one per partition, by greedily taking the most hits per extra way
+     * (looking ahead over several ways, so a partition that needs a few at once still gets them), then halves the
+     * counters so older behaviour fades out.
+     */
+    void allocate(uint32_t ways, uint32_t quotas[PART_COUNT]);
+
+   private:
+    uint32_t ways;
+    uint32_t sampleMask;  // sets whose index has none of these bits are monitored
+    std::vector<uint32_t> tags;  // per partition, per monitored set, `ways` blocks most recent first
+    std::vector<uint64_t> hits;  // per partition, per LRU position
+};
+
+// a fill or write-back in flight, see `CacheModel::mshrs`
+struct Mshr {
+    uint32_t block;
+    uint64_t ready;  // cycle, on the cache's clock, the transfer completes
+    bool fill;       // FALSE for a write-back, which nothing waits on
+};
+
+// outcome of a single `CacheModel::checkCache()` call
+struct CacheResult {
+    Line* line = nullptr;  // line holding the requested block after the access
+    uint32_t cycles = 0;   // memory cycles charged for the access
+    bool hit = false;
+};
+
+struct CacheModel {
+    uint32_t blockSize = BLOCK_SIZE;
+    uint32_t numLines = NUM_CACHE_LINES;
+    uint32_t ways = 1;
+    uint32_t numSets = NUM_CACHE_LINES;
+    uint32_t offsetBits = 4;
+    uint32_t setBits = 6;
+    uint32_t offsetMask = BLOCK_SIZE - 1;
+    uint32_t setMask = NUM_CACHE_LINES - 1;
+    ReplacementPolicy policy = POLICY_LRU;
+    uint32_t rng = 0x2545F491;  // xorshift state for POLICY_RANDOM
+
+    // sectored lines: each sector is filled, marked dirty and written back on its own
+    uint32_t sectorSize = BLOCK_SIZE;
+    uint32_t sectorBits = 4;
+    uint32_t sectorsPerLine = 1;
+    uint32_t sectorFill = 1;
+    uint32_t fillGroup = 1;  // mask of the first `sectorFill` sectors
+
+    // way partitioning: partition p fills ways [firstWay[p], firstWay[p] + quota[p]) of every set and hits in any
+    PartitionMode partition = PARTITION_NONE;
+    uint32_t quota[PART_COUNT] = {};
+    uint32_t firstWay[PART_COUNT] = {};
+    std::unique_ptr<UtilityMonitor> utility;
+    uint32_t repartition = 4096;
+    uint32_t untilRepartition = 4096;
+
+    Line** sets = nullptr;
+    std::vector<Line> victims;  // fully associative, LRU. `tag` holds the whole block number.
+    uint32_t victimLatency = 2;
+    CacheStats stats;
+    std::vector<CacheStats> setStats;  // per set, indexed by set index
+    std::unique_ptr<MissClassifier> classifier;
+    RegionStats* regionStats = nullptr;  // when set, hits, misses and cycles are also charged per region
+    HeatMap* heat = nullptr;             // when set, misses are also counted per heat map block
+    DramModel* memory = nullptr;         // when set, fills and write-backs are timed by it, not the cost model
+
+    // when set, lines carry data: fills copy from it and write-backs copy into it. Replay leaves it null.
+    unsigned char* backing = nullptr;
+
+    /**
+     * Non-blocking misses, when `mshrCount` isn't 0. Every fill and write-back holds an MSHR until its transfer
+     * completes, and waits for the earliest one to free up when they are all busy. Reads wait for their fill;
+     * writes and write-backs are posted and only cost the access the wait for an MSHR. An access to a block whose
+     * fill is still in flight merges into it and, if it reads, waits out the rest. Time is the cache's own clock,
+     * the sum of the cycles it has charged, so the overlap is with later memory accesses only. Lines still hold
+     * their data from the moment they miss: MSHRs change timing, never contents.
+     */
+    uint32_t mshrCount = 0;
+    std::vector<Mshr> mshrs;
+    uint64_t clock = 0;
+    uint64_t busyUntil = 0;  // end of the last interval with a transfer outstanding
+
+    bool filled = false;  // the last `checkCache()` filled its block from memory
+
+    CacheModel() = default;
+    CacheModel(const CacheModel&) = delete;
+    CacheModel& operator=(const CacheModel&) = delete;
+    ~CacheModel() { release(); }
+
+    /**
+     * @brief Allocates an empty cache with the given geometry.
+     * @return FALSE if the geometry is invalid, see `configure_cache()`.
+     */
+    bool configure(const CacheConfig& cfg);
+
+    /**
+     * @brief Frees the lines, the model is unusable until configured again.
+     */
+    void release();
+
+    /**
+     * @brief Writes dirty lines back into `backing` and empties the cache, victim cache included.
+     * @details Nothing is charged or counted: this is for switching to functional execution, which reads and writes
+     * memory directly and would otherwise leave stale lines behind.
+     */
+    void flush();
+
+    /**
+     * @brief Set index of `addr`, the only thing that decides which lines an access can touch.
+     */
+    uint32_t setIndex(uint32_t addr) const { return (addr >> offsetBits) & setMask; }
+
+    /**
+     * @brief Looks `addr` up, filling the block on a miss, and charges the access.
+     * @param stamp strictly increasing per access, used for LRU/FIFO ordering. Any increasing sequence gives the
+     * same replacement decisions, which is what lets set-partitioned replay match a sequential run exactly.
+     */
+    CacheResult checkCache(uint32_t addr,
+                           AccessType accessType,
+                           uint64_t stamp,
+                           uint8_t region = REGION_CODE,
+                           uint8_t part = PART_STATIC);
+
+    /**
+     * @brief Mask of the sectors of its block an `accessType` access at `addr` touches. A straddling word only
+     * touches the sectors up to the end of the block.
+     */
+    uint32_t sectorsOf(uint32_t addr, AccessType accessType) const {
+        uint32_t first = addr & offsetMask;
+        uint32_t last = accessType == READWORD || accessType == WRITEWORD ? first + 3 : first;
+        if (last >= blockSize) last = blockSize - 1;
+        return ((2u << (last >> sectorBits)) - 1) & ~((1u << (first >> sectorBits)) - 1);
+    }
+
+    /**
+     * @brief Whether an `accessType` access at `addr` runs past the end of its block.
+     */
+    bool straddles(uint32_t addr, AccessType accessType) const {
+        return (accessType == READWORD || accessType == WRITEWORD) && (addr & offsetMask) > blockSize - 4;
+    }
+
+    /**
+     * @brief Second half of a word access that ran past the block `checkCache()` just looked up. `addr` is the
+     * first byte of the next block, or, with `continues` FALSE, wherever the rest of a word split across two page
+     * frames lives.
+     * @details When both halves fill from memory the second fill continues the first request and costs only its
+     * words, `fillNextWord` each. With a DRAM model the second fill is its own access, which the open row makes
+     * cheap anyway. The second frame of a split word is never the next block, so its fill is a request of its own.
+     */
+    CacheResult checkSecondHalf(uint32_t addr,
+                                AccessType accessType,
+                                uint64_t stamp,
+                                uint8_t region = REGION_CODE,
+                                uint8_t part = PART_STATIC,
+                                bool continues = true);
+
+    /**
+     * @brief Times an access whose data lives elsewhere (the cache thread, replay): both halves of a straddling
+     * word, the second with `stamp + 1`. Returns the cycles charged.
+     */
+    uint32_t timeAccess(uint32_t addr,
+                        AccessType accessType,
+                        uint64_t stamp,
+                        uint8_t region = REGION_CODE,
+                        uint8_t part = PART_STATIC);
+
+    /**
+     * @brief Bookkeeping for an access to the `sectors` of `line`, all of them valid. Returns the cycles charged.
+     */
+    uint32_t handleCacheHit(Line& line, AccessType accessType, uint64_t stamp, uint32_t sectors);
+
+    /**
+     * @brief Refills `line` with the block holding `address`, from the victim cache when it has the block and from
+     * memory otherwise. The block `line` held moves to the victim cache, or is written back if dirty when there is
+     * none. Only the sector group the access needs is fetched. Returns the cycles charged.
+     */
+    uint32_t handleCacheMiss(uint32_t address, uint32_t setidx, Line& line, AccessType accessType, uint64_t stamp);
+
+    /**
+     * @brief Fetches the sectors of `line` an access at `address` needs, `sectors`, when the block is resident but
+     * they aren't. Counted as a miss. Returns the cycles charged.
+     */
+    uint32_t handleSectorMiss(uint32_t address,
+                              uint32_t setidx,
+                              Line& line,
+                              AccessType accessType,
+                              uint64_t stamp,
+                              uint32_t sectors);
+
+   private:
+    bool burst = false;  // the fill in progress continues the previous one
+
+    CacheResult lookup(uint32_t addr, AccessType accessType, uint64_t stamp, uint8_t part);
+    void setQuotas(const uint32_t quotas[PART_COUNT]);
+    uint32_t transfer(uint32_t address, uint32_t words, bool write);
+    uint32_t fillSectors(Line& line, uint32_t base, uint32_t sectors);
+    void copyBack(const Line& line, uint32_t base);
+    void noteEviction(const Line& line, uint32_t setidx);
+    void retireMshrs(uint64_t now);
+    Mshr* pendingFill(uint32_t block);
+    uint32_t allocateMshr(uint32_t block, uint32_t cycles, bool fill, uint64_t now);
+    uint32_t nonBlockingMiss(uint32_t block, uint32_t writeBackCycles, uint32_t fillCycles, AccessType accessType);
+    uint32_t writeBack(const Line& line, uint32_t base);
+    uint32_t retireToVictims(const Line& line, uint32_t setidx, uint64_t stamp);
+};
+
+extern CacheModel cache_model;
+
+const char* partition_name(CachePartition part);
+
+/**
+ * @brief `configure_cache()` taking a whole `CacheConfig`, victim cache included.
+ */
+bool configure_cache(const CacheConfig& cfg);
+
+/**
+ * @brief Writes a readable cache report: totals, the three C's when they were counted (sector misses are the
+ * fourth class), and one row per accessed set (accesses, misses, evictions), the sets with the most misses first.
+ * @return FALSE if the file can't be written
+ */
+bool write_cache_report(const char* filename,
+                        const CacheConfig& cfg,
+                        const CacheStats& stats,
+                        const std::vector<CacheStats>& setStats);
+
+// which half of a straddling word an access is, when replay sends the halves to different workers, or of a word
+// split across two page frames, whose halves the live pipeline queues back to back
+enum SplitHalf : uint8_t { HALF_NONE, HALF_FIRST, HALF_SECOND, HALF_FRAME_FIRST, HALF_FRAME_SECOND };
+
+// one access handed to a cache running on another thread
+struct CacheAccess {
+    uint64_t stamp;
+    uint32_t addr;
+    uint8_t type;    // AccessType
+    uint8_t region;  // MemRegion
+    uint8_t half;    // SplitHalf
+    uint8_t part;    // CachePartition
+};
+
+/**
+ * @brief Runs a cache model on its own thread, fed through a lock-free queue.
+ * @details Only the worker thread touches `model` while accesses it hasn't consumed are queued. Once `consumed`
+ * catches up with everything pushed, the worker sits idle on the empty queue and the model is safe to read.
+ */
+struct CacheWorker {
+    CacheModel* model;
+    SpscRing<CacheAccess> queue;
+    std::atomic<uint64_t> cycles{0};    // charged since the worker was started
+    std::atomic<uint64_t> consumed{0};  // queue entries fully modelled, published after each batch
+    // the model's totals after the latest batch, for readers that mustn't wait; `version` is odd while they change
+    std::atomic<uint64_t> version{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> writebacks{0};
+    // stamps of the HALF_FIRST and HALF_SECOND accesses that filled from memory, for replay to pair up
+    std::vector<uint64_t> filledHalves[2];
+
+    explicit CacheWorker(CacheModel* m, size_t capacity = 1u << 14) : model(m), queue(capacity) {}
+
+    /**
+     * @brief Thread body, returns once the queue is closed and drained.
+     */
+    void run();
+};
+
+extern bool cache_pipelined;
+
+/**
+ * @brief Moves `cache_model` onto a worker thread.
+ * @details From here on memory accesses are served straight from `prog_mem`, which always holds the current
+ * values, and only their address and type go to the worker, which keeps running until
+ * `stop_cache_pipeline()`. Its cycles reach `mem_cycle_cntr` at every `sync_cache_pipeline()`. The lines hold no data while pipelined, so the cache has to be configured again before
+ * it is used synchronously.
+ * @return FALSE if no cache is configured
+ */
+bool start_cache_pipeline();
+
+/**
+ * @brief Queues one access for the pipelined cache. A word split across two page frames passes `head`, the bytes
+ * at `address`, and `next`, where the rest continue; it is queued as two halves.
+ */
+void pipeline_access(uint32_t address,
+                     AccessType accessType,
+                     uint8_t region,
+                     uint8_t part,
+                     uint32_t head = 0,
+                     uint32_t next = 0);
+
+/**
+ * @brief Waits for the worker to catch up, then adds its cycles to `mem_cycle_cntr`. Stats and cycles match a
+ * synchronous run exactly afterwards. The worker isn't stopped, only left idle until the next access.
+ */
+void sync_cache_pipeline();
+
+// the pipelined cache's counters as of the last batch the worker finished
+struct PipelineCounters {
+    uint64_t accesses = 0;   // queue entries they cover, of those `pipeline_access()` has queued
+    uint64_t memCycles = 0;  // `mem_cycle_cntr` with the worker's cycles so far added in
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t writebacks = 0;
+};
+
+/**
+ * @brief Queues any partial batch, then reads the worker's published counters without waiting for it to catch up,
+ * so they lag execution by whatever it hasn't modelled yet.
+ */
+PipelineCounters cache_pipeline_counters();
+
+/**
+ * @brief Syncs and stops the worker thread, joining it.
+ */
+void stop_cache_pipeline();
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef costs_h_
+#define costs_h_
+
+// cycle costs charged to `mem_cycle_cntr`, read once from a cost model file so the emulator can match a board
+// without a rebuild. The defaults are the course's memory timings and charge nothing for execution.
+
+#include <string>
+
+#include "emu4380.h"
+
+constexpr uint32_t COST_OPCODES = 64;  // every opcode fits in 6 bits
+
+struct CostModel {
+    uint32_t uncachedByte = 8;        // readByte and writeByte without a cache
+    uint32_t uncachedWord = 8;        // readWord and writeWord without a cache
+    uint32_t uncachedFetchWord = 2;   // second word of an uncached instruction fetch, the immediate
+    uint32_t hit = 1;                 // cache hit
+    uint32_t fillFirstWord = 8;       // first word of a line fill or write-back
+    uint32_t fillNextWord = 2;        // each further word of it
+    uint32_t trapIo = 0;              // each TRP #1 to #6, on top of its memory accesses
+    uint32_t execute[COST_OPCODES] = {};  // per opcode, charged as the instruction executes
+    bool executeCosts = false;        // any `execute` entry is non-zero
+
+    // line fill or write-back of `words` words
+    uint32_t transfer(uint32_t words) const { return fillFirstWord + fillNextWord * (words - 1); }
+};
+
+extern CostModel cost_model;
+
+/**
+ * @brief Reads a cost model file over the defaults.
+ * @details One `key = value` per line, `#` starts a comment. Keys: uncached_byte, uncached_word,
+ * uncached_fetch_word, hit, fill_first_word, fill_next_word, trap_io, and execute.<MNEMONIC> (e.g. execute.DIV)
+ * or execute.* for every opcode; later lines win.
+ * @param error set to "line N: ..." when the file is rejected
+ * @return FALSE if the file can't be read or has an unknown key or a value that isn't a number
+ */
+bool load_cost_model(const char* filename, CostModel& model, std::string& error);
+
+#endif
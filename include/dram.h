@@ -0,0 +1,79 @@
+#ifndef dram_h_
+#define dram_h_
+
+// DRAM timing behind the cache: banks with one open row each, so what a fill or write-back costs depends on which
+// row the bank last opened
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+enum PagePolicy { PAGE_OPEN, PAGE_CLOSED };
+
+struct DramConfig {
+    uint32_t banks = 8;        // power of two
+    uint32_t rowSize = 1024;   // bytes per row, a power of two no smaller than the largest cache block
+    uint32_t tRCD = 4;         // activate: row to column delay
+    uint32_t tCAS = 4;         // column access, paid by every access
+    uint32_t tRP = 4;          // precharge, closing the open row
+    uint32_t burst = 2;        // cycles per word after the first
+    PagePolicy policy = PAGE_OPEN;
+};
+
+struct DramStats {
+    uint64_t reads = 0;         // line fills and uncached reads
+    uint64_t writes = 0;        // write-backs and uncached writes
+    uint64_t rowHits = 0;       // the row was already open
+    uint64_t rowMisses = 0;     // the bank had no open row
+    uint64_t rowConflicts = 0;  // another row was open and had to be closed first
+    uint64_t cycles = 0;
+};
+
+/**
+ * @brief Banks and row buffers of a single DRAM channel.
+ * @details Addresses interleave across banks a row at a time: bank = (address / rowSize) % banks, row = address /
+ * (rowSize * banks). A row hit costs tCAS, a miss tRCD + tCAS and a conflict tRP + tRCD + tCAS, plus `burst` for
+ * every word after the first. The open-page policy leaves the row open after an access; closed-page precharges
+ * off the critical path, so every access is a miss.
+ */
+class DramModel {
+   public:
+    DramStats stats;
+
+    void reset(const DramConfig& cfg);
+    const DramConfig& configuration() const { return config; }
+
+    /**
+     * @brief Moves `words` consecutive words starting at `address`, all in one row.
+     * @return the cycles charged
+     */
+    uint32_t access(uint32_t address, uint32_t words, bool write);
+
+   private:
+    static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+    DramConfig config;
+    uint32_t rowBits = 10;
+    uint32_t bankMask = 7;
+    std::vector<uint32_t> openRow = std::vector<uint32_t>(8, NO_ROW);  // per bank
+};
+
+extern DramModel dram;
+extern bool dram_enabled;
+
+/**
+ * @brief Parses a `--dram` spec: "default" or comma separated overrides of
+ * `banks=8,row=1024,trcd=4,tcas=4,trp=4,burst=2,page=open`, `page` being `open` or `closed`.
+ * @return FALSE on an unknown key, a bad value or a bank count or row size that isn't a power of two
+ */
+bool parseDramSpec(const std::string& spec, DramConfig& cfg);
+
+/**
+ * @brief Resets `dram` to `cfg` and routes every cache fill, write-back and uncached access through it.
+ */
+void dram_start(const DramConfig& cfg);
+
+const char* page_policy_name(PagePolicy policy);
+
+#endif
@@ -22,31 +22,39 @@ extern unsigned char* prog_mem;  // default size is 131,072 elements/bytes
 extern uint32_t cntrl_regs[5];  // stores instruction operation, register operands, and immediate value
 extern uint32_t data_regs[2];   // stores register operand values retrieved from register file
 extern uint32_t mem_size;
-extern uint32_t mem_cycle_cntr;
+extern uint64_t mem_cycle_cntr;
 
 extern bool runBool;  // boolean for executing fetch, decode, execute
 extern bool cacheUsed;
 
+// default geometry used by the `-c` presets, `configure_cache()` can pick any other one at runtime
 constexpr uint32_t BLOCK_SIZE = 16;
 constexpr uint32_t NUM_CACHE_LINES = 64;
+constexpr uint32_t MAX_BLOCK_SIZE = 128;
 
 extern size_t associativity;
 extern size_t num_sets;
+extern uint32_t block_size;
+extern uint32_t num_cache_lines;
 extern uint32_t SET_BITS;
 extern uint32_t TAG_BITS;
-
-const uint32_t OFFSET_BITS = log2(BLOCK_SIZE);
+extern uint32_t OFFSET_BITS;
 
 struct Line {
     uint32_t tag = 0;
     bool valid = false;
     bool dirty = false;
-    uint8_t data[BLOCK_SIZE]{};
+    // one bit per sector, the first sector in bit 0. A line without sectors is a single one.
+    uint32_t validSectors = 0;
+    uint32_t dirtySectors = 0;
+    uint32_t usedSectors = 0;  // accessed since the block was filled
+    uint8_t data[MAX_BLOCK_SIZE]{};  // only the first `block_size` bytes are used
     size_t lastused = 0;
 
     void badline() noexcept {
         valid = false;
         dirty = false;
+        validSectors = dirtySectors = usedSectors = 0;
         tag = 0;
     }
 };
@@ -147,11 +155,21 @@ enum CacheType : std::uint32_t {
     NO_CACHE = 0,
     DIRECT_MAPPED = 1,
     FULLY_ASSOCIATIVE = 2,
-    TWO_WAY_SET_ASSOCIATIVE = 3
+    TWO_WAY_SET_ASSOCIATIVE = 3,
+    SET_ASSOCIATIVE = 4  // any other associativity picked through `configure_cache()`
 };
 
 extern CacheType current_cache_type;
 
+// which line `checkCache()` evicts from a full set
+enum ReplacementPolicy : std::uint32_t {
+    POLICY_LRU = 0,     // least recently used
+    POLICY_FIFO = 1,    // oldest fill
+    POLICY_RANDOM = 2   // pseudo-random, deterministic from run to run
+};
+
+extern ReplacementPolicy replacement_policy;
+
 // used in cache functions `readWord()`, `readByte()`. `writeWord()`, and `writeByte()`.
 enum AccessType {
     READBYTE,
@@ -161,26 +179,89 @@ enum AccessType {
 
 };
 
+// used by the access observers (stack distance analysis, etc.) to split instruction fetches from data accesses.
+enum AccessClass : std::uint8_t {
+    CLASS_IFETCH = 0,
+    CLASS_DATA = 1
+};
+
+extern bool access_hooks;  // true when any observer wants to see the memory access stream
+extern bool functional_mode;  // true while memory is read and written directly, with no cache and no cycles
+
+extern uint64_t instructions_retired;
+extern uint64_t next_event;  // value of `instructions_retired` at which the run loop checks its periodic work
+
+// why the run loop stopped the guest before it reached TRP #0
+enum StopReason : std::uint8_t {
+    STOP_NONE = 0,
+    STOP_INSTRUCTIONS,  // --max-instructions
+    STOP_CYCLES,        // --max-cycles
+    STOP_OUTPUT,        // --max-output-bytes
+    STOP_WATCHDOG       // --timeout
+};
+
+// batch limits, 0 means unlimited
+struct RunLimits {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint64_t outputBytes = 0;
+    double seconds = 0;  // host wall clock
+};
+
+constexpr uint64_t LIMIT_POLL = 4096;  // instructions between cycle and wall clock checks
+
+extern StopReason stop_reason;
+
+// why fetch, decode or execute refused an instruction. The run loop stops on any of these and leaves the rest
+// (report, exit, carry on) to whoever called it.
+enum TrapCode : std::uint8_t {
+    TRAP_NONE = 0,
+    TRAP_BAD_OPCODE,       // unknown opcode
+    TRAP_BAD_REGISTER,     // operand names a register the instruction can't use
+    TRAP_OUT_OF_BOUNDS,    // address outside guest memory
+    TRAP_STACK_OVERFLOW,   // SP would drop below SL
+    TRAP_STACK_UNDERFLOW,  // SP would rise above SB
+    TRAP_HEAP_EXHAUSTED,   // allocation would run HP into the stack
+    TRAP_DIVIDE_BY_ZERO,
+    TRAP_BAD_TRAP,         // unknown TRP immediate, or TRP #5 on a malformed string
+    TRAP_INPUT,            // TRP read with no input left
+    TRAP_PAGE_FAULT,       // unmapped page, or a write to a read-only one, under `--mmu`
+    TRAP_COUNT
+};
+
+extern TrapCode trap_code;  // set by the failing stage, cleared by `init_mem()`, `load_binary()` and `runLoop()`
+
+// records `code` and returns FALSE, so failing paths can `return raiseTrap(...)`
+inline bool raiseTrap(TrapCode code) noexcept {
+    trap_code = code;
+    return false;
+}
+
+/**
+ * @return a short name for `code`, e.g. "stack_overflow"
+ */
+const char* trap_name(TrapCode code);
+
 // function prototypes
 /**
  * @brief Retrieves the bytes for the next instruction, and places them in the appropriate cntrl_regs
  * @details Also increments the PC so it points at the next instruction.
- * @return FALSE if invalid fetch location (OOB) is encountered, otherwise TRUE
+ * @return FALSE, with `trap_code` set, if invalid fetch location (OOB) is encountered, otherwise TRUE
  */
-bool fetch();
+bool fetch() noexcept;
 
 /**
  * @brief Verifies that the specified operation (or TRP) and operands specified in cntrl_regs are valid. Also retrieves register values from register file and places these in appropriate data_regs as indicated by operands present in cntrl_regs
  * @details A MOV instruction operates on state registers, and there are a limited number of these; a MOV with an RD value of 55 would be a malformed instruction.
- * @return FALSE if invalid instruction is encountered, otherwise TRUE
+ * @return FALSE, with `trap_code` set, if invalid instruction is encountered, otherwise TRUE
  */
-bool decode();
+bool decode() noexcept;
 
 /**
  * @brief Executes the effects of decoded and validated instruction or TRP on the state members (regs, memory, etc.) as indicated by cntrl_regs and data_regs, and in accordance with instruction or TRP's specification
- * @return FALSE if illegal operation is encountered (does not execute instruction), otherwise TRUE
+ * @return FALSE, with `trap_code` set, if illegal operation is encountered (does not execute instruction), otherwise TRUE
  */
-bool execute();
+bool execute() noexcept;
 
 /**
  * @brief Helper that loads a binary file into program memory
@@ -200,10 +281,49 @@ bool init_mem(unsigned int size);
  */
 void init_cache(uint32_t cacheType);
 
+/**
+ * @brief Initializes the emulator's cache with an arbitrary geometry
+ * @details `blockSize` must be a power of two between 4 and `MAX_BLOCK_SIZE`, `lines` a power of two, and `ways` a
+ * power of two no larger than `lines`. Replaces any cache that was already configured and resets `cache_model.stats`.
+ * @return FALSE if the geometry is invalid, otherwise TRUE
+ */
+bool configure_cache(uint32_t blockSize, uint32_t lines, uint32_t ways, ReplacementPolicy policy = POLICY_LRU);
+
 /**
  * @brief frees the cache from memory
  */
 void free_cache();
+
+/**
+ * @brief Arms `limits` for the next `runLoop()`, counting from now.
+ * @details The instruction limit is exact. Cycles and the wall clock are looked at every `LIMIT_POLL`
+ * instructions, so a run may overshoot them by that much. Output is counted per TRP and the write that would
+ * cross the limit is not made.
+ */
+void set_run_limits(const RunLimits& limits);
+
+/**
+ * @brief Switches between functional execution and the normal timed one.
+ * @details Functional accesses skip the cache, the cycle counter and the access hooks. Going functional flushes
+ * the cache so memory is current, going back leaves it cold.
+ */
+void set_functional_mode(bool on);
+
+/**
+ * @return the process exit code for a run stopped for `reason`: 0 for STOP_NONE, otherwise 3 and up
+ */
+int stop_exit_code(StopReason reason);
+
+/**
+ * @return a short name for `reason`, e.g. "instruction_limit"
+ */
+const char* stop_reason_name(StopReason reason);
+
+/**
+ * @brief Runs the fetch, decode, execute loop until the program executes the stop routine
+ * @return FALSE if an instruction trapped, see `trap_code`, otherwise TRUE
+ */
+bool runLoop();
 /**
  * @brief First call to start the emulator, used heavily in testing
  * @return ints that you would expect from a main.
@@ -217,32 +337,32 @@ int runEmulator(int argc, char** argv);
 /**
  * @brief Jump to address
  */
-bool JMP();
+bool JMP() noexcept;
 
 /**
  * @brief Update PC to value in RS
  */
-bool JMR();
+bool JMR() noexcept;
 
 /**
  * @brief Update PC to Address if RS != 0
  */
-bool BNZ();
+bool BNZ() noexcept;
 
 /**
  * @brief Update PC to Address if RS > 0
  */
-bool BGT();
+bool BGT() noexcept;
 
 /**
  * @brief Update PC to Address if RS < 0
  */
-bool BLT();
+bool BLT() noexcept;
 
 /**
  * @brief Update PC to Address if RS = 0
  */
-bool BRZ();
+bool BRZ() noexcept;
 
 // -----------------move functions-----------------
 
@@ -251,213 +371,215 @@ bool BRZ();
  * @details
  * @return
  */
-bool MOV();
+bool MOV() noexcept;
 
 /**
  * @brief Move IMM value into RD
  * @details
  * @return
  */
-bool MOVI();
+bool MOVI() noexcept;
 
 /**
  * @brief Load address into RD
  * @details
  * @return
  */
-bool LDA();
+bool LDA() noexcept;
 
 /**
  * @brief Store integer in RS at address
  * @details
  * @return
  */
-bool STR();
+bool STR() noexcept;
 
 /**
  * @brief Load integer at Address to RD
  * @details
  * @return
  */
-bool LDR();
+bool LDR() noexcept;
 
 /**
  * @brief Store least significant byte in RS at address
  * @details
  * @return
  */
-bool STB();
+bool STB() noexcept;
 
 /**
  * @brief Load byte at Address to RD
  * @details
  * @return
  */
-bool LDB();
+bool LDB() noexcept;
 
 /**
  * @brief Store integer in RS at address in RG
  * @details
  * @return
  */
-bool ISTR();
+bool ISTR() noexcept;
 
 /**
  * @brief Load integer at address in RG into RD
  * @details
  * @return
  */
-bool ILDR();
+bool ILDR() noexcept;
 
 /**
  * @brief Store byte in RS at address in RG
  * @details
  * @return
  */
-bool ISTB();
+bool ISTB() noexcept;
 
 /**
  * @brief Load byte at address in RG into RD
  * @details
  * @return
  */
-bool ILDB();
+bool ILDB() noexcept;
 
 // -----------------arithmetic functions-----------------
 /**
  * @brief Add RS1 to RS2, store result in RD
  * @details
  */
-bool ADD();
+bool ADD() noexcept;
 
 /**
  * @brief Add Imm to RS1, store result in RD
  * @details
  */
-bool ADDI();
+bool ADDI() noexcept;
 
 /**
  * @brief Subtract RS2 from RS1, store result in RD
  * @details
  */
-bool SUB();
+bool SUB() noexcept;
 
 /**
  * @brief Subtract Imm from RS1, store result in RD
  * @details
  */
-bool SUBI();
+bool SUBI() noexcept;
 
 /**
  * @brief Multiply RS1 by RS2, store result in RD
  * @details
  */
-bool MUL();
+bool MUL() noexcept;
 
 /**
  * @brief Multiply RS1 by IMM, store the result in RD
  * @details
  */
-bool MULI();
+bool MULI() noexcept;
 
 /**
  * @brief Perform unsigned integer division RS1 / RS2. Store quotient in RD
  * @details Division by zero shall result in an emulator error
  */
-bool DIV();
+bool DIV() noexcept;
 
 /**
  * @brief Store result of signed division RS1 / RS2 in RD.
  * @detailsDivision by zero shall result in an emulator error
  */
-bool SDIV();
+bool SDIV() noexcept;
 
 /**
  * @brief Divide RS1 by IMM (signed), store the result in RD.
  * @details Division by zero shall result in an emulator error
  */
-bool DIVI();
+bool DIVI() noexcept;
 
 /**
  * @brief Performs a LOGICAL AND (&&) between RS1 and RS2, stores the result in RD.
  * @details 1 = True, 0 = False
  */
-bool AND();
+bool AND() noexcept;
 
 /**
  * @brief Performs a LOGICAL OR (||) between RS1 and RS2, stores the result in RD.
  * @details 1 = True, 0 = False
  */
-bool OR();
+bool OR() noexcept;
 
 // -----------------comparison functions-----------------
 /**
  * @brief  Performs a signed comparison between RS1 and RS2, and stores the result in RD
  * @details Set RD = 0 if RS1 == RS2 OR set RD = 1 if RS1 >RS2 OR set RD = -1 if RS1 < RS2
  */
-bool CMP();
+bool CMP() noexcept;
 
 /**
  * @brief  Performs a signed comparison between RS1 and IMM and stores the result in RD
  * @details Set RD = 0 if RS1 == IMM OR set RD = 1 if RS1 >IMM OR set RD = -1 if RS1 < IMM
  */
-bool CMPI();
+bool CMPI() noexcept;
 
 // -----------------trap/interrupt functions-----------------
 /**
  * @brief function for traps
  * @note based on immediate value
  * @details Trp 0 ends program and outputs number of memory cycles. \n TRP 1 Writes an int in r3 to stdout. \n TRP2 Read an integer into r3 from stdout \n TRP3 Write character in R3 to stdout \n TRP4 Read a char into R3 from stdin \n TRP5 Writes the full null-terminated pascal-style string whose starting address is in R3 to stdout \n TRP6 Read a newline terminated string from stdin and stores it in memory as a null-terminated pascal-style string whose starting address is in R3.
+ * @note Guest I/O goes through iostreams with their exceptions left off, and TRP 1 formats on the stack. TRP 6 still
+ * reads the line into a `std::string`: a `std::bad_alloc` escaping there terminates the emulator, per `noexcept`.
  */
-bool TRP();
+bool TRP() noexcept;
 
 /**
  * @brief Allocate imm bytes of space on the heap, and increment HP accordingly.
  * @details The imm value is a 4-byte unsigned integer. Store the initial heap pointer in RD.
  */
-bool ALCI();
+bool ALCI() noexcept;
 
 /**
  * @brief Allocate a number of bytes on the heap according to the value of the 4-byte unsigned integer stored at address
  * @details Also increment HP accordingly. Store the initial heap pointer in RD
  */
-bool ALLC();
+bool ALLC() noexcept;
 
 /**
  * @brief Indirectly allocate a number of bytes on the heap according to the value of the 4-byte uint at memory address stored in RS1.
  * @details Increments HP accordingly. Store the initial heap pointer in RD.
  */
-bool IALLC();
+bool IALLC() noexcept;
 
 /**
  * @brief Set SP = SP - 4, place the word in RS onto the stack
  */
-bool PSHR();
+bool PSHR() noexcept;
 
 /**
  * @brief Set SP = SP - 1, place the least significant byte in RS onto the stack
  */
-bool PSHB();
+bool PSHB() noexcept;
 
 /**
  * @brief place the word on top of the stack into RD, update SP = SP + 4
  */
-bool POPR();
+bool POPR() noexcept;
 
 /**
  * @brief place the byte on top of the stack into RD, update SP = SP + 1
  */
-bool POPB();
+bool POPB() noexcept;
 
 /**
  * @brief Push PC onto stack, update PC to Address
  */
-bool CALL();
+bool CALL() noexcept;
 
 /**
  * @brief pop stack into PC
  */
-bool RET();
+bool RET() noexcept;
 
 /**
  * @brief executes the stop routine
@@ -471,35 +593,44 @@ void STOP();
  */
 
 // -----------------Other helpers-----------------
+ostream& operator<<(ostream& os, Opcode op);
 void dumpRegisterContents();
 void dumpCacheSummary();
 
+/**
+ * @brief Reports the instruction that trapped: register dump and line number.
+ */
 void invalidInstruction();
 
 //-----------------Timing functions-----------------
 /**
  * @brief Returns the unsigned char located at index address in `prog_mem`.
- * @details Also increments the global `mem_cycle_cntr` by 8 when called.
+ * @details Also increments the global `mem_cycle_cntr` by the cost model's uncached byte cost (8) when called, or
+ * what the cache charges. Out of range raises TRAP_OUT_OF_BOUNDS.
  */
-unsigned char readByte(uint32_t address);
+unsigned char readByte(uint32_t address) noexcept;
 
 /**
  * @brief Returns the unsigned int located at index address in `prog_mem`.
- * @details also increments the global `mem_cycle_cntr` by 8 when called.
+ * @details also increments the global `mem_cycle_cntr` by the cost model's uncached word cost (8, or 2 for the
+ * second word of a fetch) when called, or what the cache charges. Out of range raises TRAP_OUT_OF_BOUNDS.
+ * `cls` tells the analyses and the cache partitions whether `fetch()` or the instruction is reading.
  */
-unsigned int readWord(uint32_t address);
+unsigned int readWord(uint32_t address, AccessClass cls = CLASS_DATA) noexcept;
 
 /**
  * @brief Places the value in byte at index address in the `prog_mem` array.
- * @details also increments the global `mem_cycle_counter` by 8 when called
+ * @details also increments the global `mem_cycle_counter` by the cost model's uncached byte cost (8) when called,
+ * or what the cache charges. Out of range raises TRAP_OUT_OF_BOUNDS.
  */
-void writeByte(uint32_t address, unsigned char byte);
+void writeByte(uint32_t address, unsigned char byte) noexcept;
 
 /**
  * @brief Places the value in `word`, beginning at index `address` in `prog_mem` array
- * @details increments the global mem_cycle_cntr by 8 when called
+ * @details increments the global mem_cycle_cntr by the cost model's uncached word cost (8) when called, or what
+ * the cache charges. Out of range raises TRAP_OUT_OF_BOUNDS.
  */
-void writeWord(uint32_t address, unsigned int word);
+void writeWord(uint32_t address, unsigned int word) noexcept;
 
 /**
  * @brief Dumps the contents of the cache to console. Useful in debugging.
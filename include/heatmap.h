@@ -0,0 +1,94 @@
+#ifndef heatmap_h_
+#define heatmap_h_
+
+// memory access heat map: reads, writes and cache misses per fixed-size block of guest memory
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// one block's counters, in memory and in the file
+struct HeatCounts {
+    uint32_t reads = 0;
+    uint32_t writes = 0;
+    uint32_t misses = 0;
+};
+
+/**
+ * @brief Heat map file layout: this header, then `records` of (block index, reads, writes, misses), all uint32
+ * little endian, in address order. Blocks that were never accessed are left out.
+ */
+struct HeatmapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t memSize;
+    uint32_t records;
+};
+
+struct HeatRecord {
+    uint32_t block;  // address / blockSize
+    HeatCounts counts;
+};
+
+constexpr char HEATMAP_MAGIC[8] = {'4', '3', '8', '0', 'H', 'E', 'A', 'T'};
+constexpr uint32_t HEATMAP_VERSION = 1;
+constexpr uint32_t HEATMAP_BLOCK = 64;
+
+/**
+ * @brief Counters for every block of guest memory, indexed by `address >> shift`.
+ * @details The counter array is split into pages that are only allocated the first time one of their blocks is
+ * touched, so a multi-GiB `-m` costs a page table of pointers and the parts of memory the program actually uses.
+ */
+struct HeatMap {
+    static constexpr uint32_t PAGE_SHIFT = 12;  // blocks per page, as a power of two
+    static constexpr uint32_t PAGE_MASK = (1u << PAGE_SHIFT) - 1;
+
+    uint32_t blockSize = HEATMAP_BLOCK;
+    uint32_t shift = 6;
+    uint32_t memSize = 0;
+    uint64_t blocks = 0;
+    std::vector<std::unique_ptr<HeatCounts[]>> pages;
+
+    /**
+     * @brief Clears the map for `memSize` bytes of memory counted in blocks of `blockSize` (a power of two).
+     * @return FALSE if `blockSize` isn't a power of two
+     */
+    bool init(uint32_t blockSize, uint32_t memSize);
+
+    // counters of the block holding `addr`, allocating its page on first use. `nullptr` outside memory.
+    HeatCounts* at(uint32_t addr) {
+        uint64_t b = addr >> shift;
+        if (b >= blocks) return nullptr;
+
+        std::unique_ptr<HeatCounts[]>& page = pages[b >> PAGE_SHIFT];
+        if (!page) page.reset(new HeatCounts[PAGE_MASK + 1]());
+        return &page[b & PAGE_MASK];
+    }
+
+    /**
+     * @brief Counts a miss on a block the access hook already counted, so the page exists and no allocation
+     * happens. That is what lets the `--cache-thread` worker count misses while the emulator counts accesses.
+     */
+    void miss(uint32_t addr) {
+        uint64_t b = addr >> shift;
+        if (b < blocks && pages[b >> PAGE_SHIFT]) pages[b >> PAGE_SHIFT][b & PAGE_MASK].misses++;
+    }
+
+    /**
+     * @brief Writes every touched block to `filename`.
+     * @return FALSE if the file can't be written
+     */
+    bool write(const char* filename) const;
+};
+
+/**
+ * @brief Loads a heat map file written by `HeatMap::write()`.
+ * @return FALSE if the file can't be read or isn't a heat map
+ */
+bool read_heatmap(const char* filename, HeatmapHeader& header, std::vector<HeatRecord>& records);
+
+extern HeatMap heatmap;
+extern bool heatmap_enabled;
+
+#endif
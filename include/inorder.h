@@ -0,0 +1,80 @@
+#ifndef inorder_h_
+#define inorder_h_
+
+// in-order five stage pipeline (IF ID EX MEM WB) timing model, driven by the retired instruction stream
+
+#include "retire.h"
+
+// where the cycles beyond one per instruction went
+enum StallCause : std::uint8_t {
+    STALL_RAW = 0,   // waiting on a register an older ALU instruction writes
+    STALL_LOAD_USE,  // waiting on a register an older load writes
+    STALL_BRANCH,    // fetching down the wrong path, or waiting for a jump target
+    STALL_FETCH,     // instruction fetch beyond a hit
+    STALL_MEMORY,    // loads and stores beyond a hit
+    STALL_EXECUTE,   // EX cycles beyond the first, from the cost model
+    STALL_OTHER,     // bubbles none of the above explain, kept so the stalls always add up
+    STALL_COUNT
+};
+
+struct PipelineConfig {
+    bool forwarding = true;  // EX and MEM results bypass to EX, otherwise operands are read in ID once written back
+    uint32_t hitCycles = 1;  // memory cycles per access a stage absorbs without stalling
+};
+
+struct PipelineStats {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;  // up to the write-back of the last instruction
+    uint64_t stalls[STALL_COUNT] = {};
+    uint64_t branches = 0;  // conditional branches
+    uint64_t taken = 0;     // of those, taken
+};
+
+/**
+ * @brief Classic single issue pipeline. Without `--bpred` not taken is predicted for conditional branches, with
+ * it only mispredictions redirect fetch. Conditional branches resolve in EX; JMP and CALL redirect fetch from ID,
+ * JMR from EX and RET from MEM.
+ * @details Each instruction gets the cycle it enters every stage, from its own operands and memory cycles and from
+ * the stage the instruction ahead still occupies. The bubbles between consecutive write-backs are charged to the
+ * causes that delayed the later instruction, latest stage first, so `cycles` is always `instructions + 4` plus the
+ * sum of `stalls`.
+ */
+class InOrderModel {
+   public:
+    PipelineStats stats;
+
+    void reset(const PipelineConfig& cfg);
+    void retire(const RetiredInstr& r);
+
+   private:
+    PipelineConfig config;
+    // stage entry cycles of the previous instruction
+    uint64_t lastId = 0;
+    uint64_t lastEx = 0;
+    uint64_t lastMem = 0;
+    uint64_t lastWb = 3;      // a virtual one ahead of the first, so it writes back at cycle 4
+    uint64_t fetchReady = 0;  // earliest IF after a redirect
+    uint64_t ready[TIMED_REGS] = {};  // cycle a register's value can enter EX (forwarding) or ID (no forwarding)
+    bool fromLoad[TIMED_REGS] = {};
+};
+
+extern InOrderModel inorder;
+extern bool inorder_enabled;
+
+/**
+ * @brief Resets the model and starts feeding it every timed instruction. Needs the synchronous cache.
+ */
+void inorder_start(const PipelineConfig& cfg);
+
+/**
+ * @brief Charges `bubbles` to the causes with a `delay`, latest stage first, up to each one's delay, and the rest
+ * to STALL_OTHER.
+ */
+void charge_stalls(uint64_t stalls[STALL_COUNT], const uint64_t delay[STALL_COUNT], uint64_t bubbles);
+
+/**
+ * @return a short name for `cause`, e.g. "load_use"
+ */
+const char* stall_cause_name(StallCause cause);
+
+#endif
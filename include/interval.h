@@ -0,0 +1,48 @@
+#ifndef interval_h_
+#define interval_h_
+
+// time-series statistics: a snapshot of the run every N retired instructions, for plotting and phase detection
+
+#include "emu4380.h"
+
+// one snapshot, also the binary file record
+struct IntervalRecord {
+    uint64_t instructions;
+    uint64_t cycles;  // mem_cycle_cntr
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;
+    uint32_t sp;
+    uint32_t hp;
+    uint32_t pc;
+    uint32_t pcBucket;  // pc >> INTERVAL_BUCKET_SHIFT
+};
+
+constexpr uint32_t INTERVAL_BUCKET_SHIFT = 8;  // 256 byte PC buckets, 32 instructions each
+constexpr char INTERVAL_MAGIC[8] = {'4', '3', '8', '0', 'I', 'V', 'A', 'L'};
+constexpr uint32_t INTERVAL_VERSION = 1;
+
+extern bool interval_enabled;
+extern uint64_t interval_next;  // instruction count of the next snapshot
+
+/**
+ * @brief Starts taking a snapshot every `every` retired instructions.
+ * @details Snapshots go into a preallocated ring and a background thread writes them out, so execution only
+ * stalls if the writer falls a whole ring behind. A `filename` ending in `.csv` gets CSV, anything else a binary
+ * file: `INTERVAL_MAGIC`, version, record size and interval as uint32, then `IntervalRecord`s.
+ * @return FALSE if `every` is 0 or the file can't be created
+ */
+bool interval_start(uint64_t every, const char* filename);
+
+/**
+ * @brief Takes the snapshot that is due and schedules the next one. Called from the run loop.
+ */
+void interval_record();
+
+/**
+ * @brief Records the last, partial interval, waits for the writer and closes the file.
+ * @return FALSE if any write failed
+ */
+bool interval_finish();
+
+#endif
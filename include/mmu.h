@@ -0,0 +1,132 @@
+#ifndef mmu_h_
+#define mmu_h_
+
+// paged virtual memory: a TLB in front of a single level page table that lives in guest memory
+
+#include <string>
+#include <vector>
+
+#include "emu4380.h"
+
+constexpr uint32_t TRP_PT_GET = 9;   // R3 = page table base
+constexpr uint32_t TRP_PT_SET = 10;  // page table base = R3, and the TLB is flushed
+
+// page table entry: the physical page address, with these flags in its low bits
+constexpr uint32_t PTE_VALID = 1;
+constexpr uint32_t PTE_WRITABLE = 2;
+
+struct MmuConfig {
+    uint32_t pageSize = 4096;  // power of two, 64 or more, dividing the memory size
+    uint32_t entries = 64;     // TLB entries
+    uint32_t ways = 4;         // 0 for fully associative
+    ReplacementPolicy policy = POLICY_LRU;
+    uint32_t walkCycles = 8;   // one page table entry read, charged on every TLB miss
+};
+
+struct TlbStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;  // page walks
+    uint64_t faults = 0;
+    uint64_t walkCycles = 0;
+    uint64_t flushes = 0;
+};
+
+struct TlbEntry {
+    uint32_t vpn = 0;
+    uint32_t pte = 0;
+    uint64_t lastused = 0;  // access stamp for LRU, fill stamp for FIFO
+    bool valid = false;
+};
+
+/**
+ * @brief Translates guest (virtual) addresses to `prog_mem` (physical) offsets.
+ * @details The virtual address space is the guest's memory size. Virtual page `n` is described by the 4 byte little
+ * endian entry at `tableBase + 4 * n`, read straight from `prog_mem` on a TLB miss. A missing entry, a write to a
+ * page without PTE_WRITABLE or a frame outside memory raises TRAP_PAGE_FAULT. Translation runs in functional mode
+ * too, so remapped pages stay correct while fast-forwarding, but walks are only charged when timing.
+ */
+class Mmu {
+   public:
+    TlbStats stats;
+    uint32_t tableBase = 0;
+    uint32_t faultAddress = 0;  // virtual address of the last page fault
+
+    void reset(const MmuConfig& cfg, uint32_t base);
+    const MmuConfig& configuration() const { return config; }
+
+    // bytes of page table needed to map `memSize` bytes
+    uint32_t tableBytes(uint32_t memSize) const { return (memSize >> pageBits) * 4; }
+
+    // whether an access of `bytes` bytes at `address` runs into the next page
+    bool crossesPage(uint32_t address, uint32_t bytes) const { return (address & pageMask) + bytes > config.pageSize; }
+
+    /**
+     * @brief Replaces `address` by its physical address, for an access that stays in one page.
+     * @return FALSE, with `trap_code` set, on a page fault
+     */
+    bool translate(uint32_t& address, bool write) {
+        const uint32_t vpn = address >> pageBits;
+        TlbEntry* set = &tlb[(vpn & setMask) * ways];
+        for (uint32_t w = 0; w < ways; w++) {
+            TlbEntry& e = set[w];
+            if (e.valid && e.vpn == vpn && (!write || (e.pte & PTE_WRITABLE))) {
+                stats.hits++;
+                if (config.policy == POLICY_LRU) e.lastused = ++stamp;
+                address = (e.pte & ~pageMask) | (address & pageMask);
+                return true;
+            }
+        }
+        return walk(address, write);
+    }
+
+    /**
+     * @brief Translates an access that runs into the next page, one page at a time.
+     * @details `address` becomes the physical address of the first byte. When the next page's frame doesn't follow
+     * the first one, `head` is the number of bytes left in the first page and `next` the physical address the rest
+     * continue at; otherwise `head` is 0 and the access stays in one piece.
+     * @return FALSE, with `trap_code` set, if either page faults
+     */
+    bool translateSplit(uint32_t& address, bool write, uint32_t& next, uint32_t& head);
+
+    /**
+     * @brief Drops every TLB entry, for after the page table changed.
+     */
+    void flush();
+
+   private:
+    MmuConfig config;
+    uint32_t pageBits = 12;
+    uint32_t pageMask = 4095;
+    uint32_t ways = 4;
+    uint32_t setMask = 15;
+    uint64_t stamp = 0;
+    uint32_t rng = 0x2545F491;  // xorshift state for POLICY_RANDOM
+    std::vector<TlbEntry> tlb;  // sets of `ways` entries, one after the other
+
+    bool walk(uint32_t& address, bool write);
+};
+
+extern Mmu mmu;
+extern bool mmu_enabled;
+
+/**
+ * @brief Parses an `--mmu` spec: "default" or comma separated overrides of
+ * `page=4096,tlb=64,assoc=4,policy=lru,walk=8`, `assoc` also taking `full` and `policy` `fifo` or `random`.
+ * @return FALSE on an unknown key or a bad value
+ */
+bool parseMmuSpec(const std::string& spec, MmuConfig& cfg);
+
+/**
+ * @brief Turns translation on over an identity mapped page table, placed in the last pages of guest memory with
+ * the stack moved down below it. Call after the binary is loaded.
+ * @return FALSE if the memory size isn't a multiple of the page size or the table doesn't fit above the program
+ */
+bool mmu_start(const MmuConfig& cfg);
+
+/**
+ * @brief TRP #10: switches to the page table at `base` and flushes the TLB.
+ * @return FALSE, raising TRAP_OUT_OF_BOUNDS, if the table would run past memory or `base` isn't word aligned
+ */
+bool mmu_set_table(uint32_t base);
+
+#endif
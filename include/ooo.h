@@ -0,0 +1,116 @@
+#ifndef ooo_h_
+#define ooo_h_
+
+// out-of-order superscalar timing model, fed the retired instruction stream on a thread of its own
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "retire.h"
+
+struct OooConfig {
+    uint32_t width = 4;  // instructions dispatched, and committed, per cycle
+    uint32_t rob = 64;   // reorder buffer entries, held from dispatch to commit
+    uint32_t rs = 32;    // reservation station entries, held from dispatch to issue
+    uint32_t lsq = 16;   // load/store queue entries, held from dispatch to commit
+    uint32_t alu = 1;    // latencies in cycles
+    uint32_t mul = 3;
+    uint32_t div = 12;   // DIV SDIV DIVI, on a single divider that isn't pipelined
+    uint32_t load = 2;   // load to use on a hit, memory cycles beyond a hit come on top
+    uint32_t hitCycles = 1;
+};
+
+struct OooStats {
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;  // up to the last commit
+    // how many entries were busy as each instruction dispatched, indexed by occupancy
+    std::vector<uint64_t> robOccupancy;
+    std::vector<uint64_t> rsOccupancy;
+    std::vector<uint64_t> lsqOccupancy;
+    uint64_t missCycles = 0;      // summed over every load that missed, from issue to completion
+    uint64_t missBusyCycles = 0;  // cycles with at least one such load outstanding
+
+    double ipc() const { return cycles ? static_cast<double>(instructions) / cycles : 0.0; }
+
+    // memory-level parallelism: loads that missed outstanding together, on average, while any was
+    double mlp() const { return missBusyCycles ? static_cast<double>(missCycles) / missBusyCycles : 0.0; }
+};
+
+/**
+ * @brief Trace driven model of a core that dispatches and commits in order, `width` at a time, and issues out of
+ * order as operands become ready.
+ * @details Dispatch waits for the front end, a free reorder buffer entry, a reservation station entry and, for
+ * loads and stores, a queue entry. Branches follow the in-order model: whatever `redirects()` picks out refetches,
+ * once it completes for branches, JMR and RET, or one cycle after dispatch for JMP and CALL. Instruction fetch cycles beyond
+ * a hit hold up dispatch.
+ */
+class OooModel {
+   public:
+    OooStats stats;
+
+    void reset(const OooConfig& cfg);
+    void retire(const RetiredInstr& r);
+
+    /**
+     * @brief Closes the miss intervals still open. Call once after the last instruction.
+     */
+    void finish();
+
+   private:
+    OooConfig config;
+    uint64_t fetchReady = 0;
+    uint64_t lastDispatch = 0;
+    uint32_t dispatchSlots = 0;  // dispatched in `lastDispatch` so far
+    uint64_t lastCommit = 0;
+    uint32_t commitSlots = 0;
+    uint64_t divFree = 0;
+    uint64_t ready[TIMED_REGS] = {};
+    std::vector<uint64_t> robCommit;  // ring, commit cycle of the instruction `rob` older than the next one
+    std::vector<uint64_t> lsqCommit;
+    uint64_t retired = 0;
+    uint64_t memOps = 0;
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> rsIssue;  // of waiting instructions
+    std::deque<uint64_t> inFlight;  // commit cycles of dispatched instructions, oldest first
+    std::deque<uint64_t> memInFlight;
+    std::map<uint64_t, uint64_t> misses;  // merged [issue, complete) of loads that missed, by issue
+
+    void closeMisses(uint64_t before);
+};
+
+extern OooModel ooo;
+extern bool ooo_enabled;
+
+/**
+ * @brief Parses comma separated `key=value` pairs over the defaults, keys width, rob, rs, lsq, alu, mul, div and
+ * load, e.g. "width=2,rob=32". "default" keeps every default.
+ * @return FALSE on an unknown key or a zero value
+ */
+bool parseOooSpec(const std::string& spec, OooConfig& cfg);
+
+/**
+ * @brief Resets the model and starts the thread it runs on. Needs the synchronous cache.
+ */
+void ooo_start(const OooConfig& cfg);
+
+/**
+ * @brief Queues one retired instruction for the model thread.
+ */
+void ooo_feed(const RetiredInstr& r);
+
+/**
+ * @brief Hands over what is still queued, joins the model thread and finishes the model, after which `ooo.stats`
+ * is safe to read.
+ */
+void ooo_finish();
+
+/**
+ * @brief Writes the occupancy histograms as `structure,entries,dispatches` CSV rows, leaving out zero counts.
+ * @return FALSE if the file can't be written
+ */
+bool write_ooo_report(const char* filename);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef opstats_h_
+#define opstats_h_
+
+// executed instruction mix: opcodes, opcode pairs and triples, TRP immediates and branch outcomes.
+// The run loop only feeds it when built with EMU_OPCODE_STATS (cmake -DEMU_OPCODE_STATS=ON), otherwise it
+// compiles away entirely.
+
+#include <map>
+#include <vector>
+
+#include "emu4380.h"
+
+constexpr uint32_t OPCODE_SLOTS = 64;  // every opcode fits in 6 bits
+
+struct OpcodeStats {
+    uint64_t total = 0;
+    uint64_t mix[OPCODE_SLOTS] = {};
+    std::vector<uint64_t> pairs;    // [first * OPCODE_SLOTS + second]
+    std::vector<uint64_t> triples;  // [(first * OPCODE_SLOTS + second) * OPCODE_SLOTS + third], 2 MiB
+    std::map<uint32_t, uint64_t> traps;  // TRP immediate -> count
+    uint64_t taken[OPCODE_SLOTS] = {};
+    uint64_t notTaken[OPCODE_SLOTS] = {};
+
+    void reset();
+
+    /**
+     * @brief Counts one executed instruction.
+     * @param redirected TRUE if the instruction left PC somewhere other than the next instruction
+     */
+    void retire(uint32_t op, uint32_t imm, bool redirected) {
+        op &= OPCODE_SLOTS - 1;
+        mix[op]++;
+        if (total >= 1) pairs[prev1 * OPCODE_SLOTS + op]++;
+        if (total >= 2) triples[(prev2 * OPCODE_SLOTS + prev1) * OPCODE_SLOTS + op]++;
+        prev2 = prev1;
+        prev1 = op;
+        total++;
+
+        if (op == OP_TRP)
+            traps[imm]++;
+        else if (op >= OP_BNZ && op <= OP_BRZ)
+            (redirected ? taken : notTaken)[op]++;
+    }
+
+    /**
+     * @brief Writes the readable report: opcodes, pairs and triples by count, TRP immediates, branch outcomes.
+     * @param top how many pairs and triples to list
+     */
+    bool writeReport(const char* filename, size_t top = 25) const;
+
+    /**
+     * @brief Writes every non-zero counter as `kind,key,count` CSV rows, `kind` one of op, pair, triple, trp,
+     * taken, not_taken. Opcode sequences are space separated mnemonics.
+     */
+    bool writeCsv(const char* filename) const;
+
+   private:
+    uint32_t prev1 = 0;
+    uint32_t prev2 = 0;
+};
+
+extern OpcodeStats opstats;
+extern bool opstats_enabled;
+
+#endif
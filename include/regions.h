@@ -0,0 +1,45 @@
+#ifndef regions_h_
+#define regions_h_
+
+// per-region memory statistics: every guest access is charged to the part of the memory layout it falls in
+
+#include "emu4380.h"
+
+/**
+ * @brief Parts of the guest memory layout, decided per access from the live `SL`, `HP`, `SP` and `SB` registers.
+ * @details Code and static data sit below `SL`, the heap grows from `SL` up to `HP` and the stack from `SB` down
+ * to `SP`. `REGION_FREE` is the unallocated gap between the heap and the stack.
+ */
+enum MemRegion : std::uint8_t { REGION_CODE = 0, REGION_HEAP, REGION_STACK, REGION_FREE, REGION_COUNT };
+
+struct RegionStats {
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t hits = 0;    // only counted with a cache
+    uint64_t misses = 0;  // only counted with a cache
+    uint64_t cycles = 0;  // charged to `mem_cycle_cntr`
+};
+
+extern RegionStats region_stats[REGION_COUNT];
+extern bool region_stats_enabled;
+extern MemRegion current_region;  // region of the access in flight, set by the access hooks
+
+inline MemRegion regionOf(uint32_t addr) {
+    if (addr < reg_file[SL]) return REGION_CODE;
+    if (addr < reg_file[HP]) return REGION_HEAP;
+    if (addr >= reg_file[SP] && addr < reg_file[SB]) return REGION_STACK;
+    return REGION_FREE;
+}
+
+/**
+ * @brief Zeroes the counters and starts collecting, for the cache too. Needs `access_hooks`.
+ */
+void region_stats_start();
+
+/**
+ * @brief Writes one row per region with its final boundaries and counters.
+ * @return FALSE if the file can't be written
+ */
+bool write_region_report(const char* filename);
+
+#endif
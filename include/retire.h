@@ -0,0 +1,54 @@
+#ifndef retire_h_
+#define retire_h_
+
+// the retired instruction stream: what each executed instruction read, wrote and cost, for the timing models
+
+#include "emu4380.h"
+
+constexpr uint8_t NO_REG = 0xFF;  // unused source or destination slot
+constexpr size_t TIMED_REGS = 22;  // `reg_file` entries the timing models track dependences on
+
+enum RetireFlags : std::uint8_t {
+    RETIRE_LOAD = 1,
+    RETIRE_STORE = 2,
+    RETIRE_BRANCH = 4,    // conditional, BNZ BGT BLT BRZ
+    RETIRE_JUMP = 8,      // unconditional, JMP JMR CALL RET
+    RETIRE_INDIRECT = 16, // target comes from a register or the stack, JMR RET
+    RETIRE_TAKEN = 32,    // PC went somewhere other than the next instruction
+    RETIRE_PREDICTED = 64,     // a branch predictor looked at it, see `bpred_retire()`
+    RETIRE_MISPREDICTED = 128  // and got the direction or the target wrong
+};
+
+struct RetiredInstr {
+    uint32_t pc = 0;
+    uint32_t nextPc = 0;
+    uint32_t target = 0;  // where BNZ BGT BLT BRZ JMP CALL go when taken, from the immediate
+    uint8_t op = 0;
+    uint8_t flags = 0;
+    uint8_t src[3] = {NO_REG, NO_REG, NO_REG};  // registers read, in `reg_file` numbering
+    uint8_t dst[2] = {NO_REG, NO_REG};          // registers written
+    uint32_t fetchCycles = 0;  // memory cycles charged by `fetch()`
+    uint32_t memCycles = 0;    // memory cycles charged by `execute()`
+    uint32_t exCycles = 0;     // the cost model's `execute.<OP>` cycles, charged by `execute()` but not memory
+    uint8_t memAccesses = 0;   // data reads and writes, 0 for TRP #5/#6 whose count depends on the string
+};
+
+// TRUE if the front end went down the wrong path after `r`: mispredicted when a predictor ran, otherwise taken,
+// since without one the timing models fetch sequentially
+inline bool redirects(const RetiredInstr& r) {
+    return (r.flags & RETIRE_PREDICTED) ? (r.flags & RETIRE_MISPREDICTED) != 0 : (r.flags & RETIRE_TAKEN) != 0;
+}
+
+// memory cycles beyond what `accesses` hits would take, the part the timing models stall on
+inline uint64_t beyondHits(uint32_t cycles, uint32_t accesses, uint32_t hitCycles) {
+    uint64_t hits = static_cast<uint64_t>(accesses) * hitCycles;
+    return cycles > hits ? cycles - hits : 0;
+}
+
+/**
+ * @brief Describes the instruction that just executed from `cntrl_regs` and the given counters.
+ * @param fallthrough PC after fetch, i.e. the address of the next sequential instruction
+ */
+RetiredInstr retired_instr(uint32_t fallthrough, uint64_t fetchCycles, uint64_t memCycles);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef roi_h_
+#define roi_h_
+
+// region of interest: TRP #7 and TRP #8 bracket the part of a program whose timing matters
+
+#include "emu4380.h"
+
+constexpr uint32_t TRP_ROI_BEGIN = 7;
+constexpr uint32_t TRP_ROI_END = 8;
+
+// totals over every begin/end pair the program ran
+struct RoiStats {
+    uint32_t regions = 0;
+    uint64_t instructions = 0;  // between the markers, neither marker counted
+    uint64_t cycles = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t writebacks = 0;
+};
+
+extern RoiStats roi_stats;
+extern bool roi_active;  // between a begin and its end
+extern bool roi_only;    // run outside the regions functionally, see `set_functional_mode()`
+
+/**
+ * @brief Starts tracking regions. With `only`, execution is functional until the first TRP #7.
+ */
+void roi_start(bool only);
+
+/**
+ * @brief TRP #7: snapshots the counters, and turns timing on under `roi_only`. Ignored inside a region.
+ */
+void roi_begin();
+
+/**
+ * @brief TRP #8, and TRP #0 inside a region: adds the region's share to `roi_stats`, and turns timing off under
+ * `roi_only`. Ignored outside a region.
+ */
+void roi_end();
+
+#endif
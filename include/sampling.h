@@ -0,0 +1,49 @@
+#ifndef sampling_h_
+#define sampling_h_
+
+// sampled simulation: functional fast-forward between short timed windows, SMARTS style
+
+#include "emu4380.h"
+
+struct SampleConfig {
+    uint64_t fastForward = 0;  // functional instructions before each window
+    uint64_t warmup = 0;       // timed but unmeasured instructions that refill the cache before each window
+    uint64_t detail = 0;       // measured instructions per window
+    uint32_t samples = 0;      // windows to take; the rest of the run is functional
+};
+
+// whole-run numbers extrapolated from the windows
+struct SampleEstimate {
+    uint32_t windows = 0;
+    uint64_t instructions = 0;    // retired over the whole run
+    double cpi = 0;               // mean memory cycles per instruction over the windows
+    double cycles = 0;            // cpi * instructions
+    double cyclesHalfWidth = 0;   // of the 95% confidence interval, 0 with fewer than two windows
+    double missRatio = 0;         // mean over the windows
+};
+
+extern bool sampling_enabled;
+extern uint64_t sampling_next;  // instruction count of the next phase change
+
+/**
+ * @brief Parses "fast_forward,warmup,detail,samples", e.g. "1000000,20000,10000,50".
+ * @return FALSE unless there are four numbers and detail and samples are non-zero
+ */
+bool parseSampleSpec(const string& spec, SampleConfig& cfg);
+
+/**
+ * @brief Starts sampling from the current instruction, beginning with a fast-forward.
+ */
+void sampling_start(const SampleConfig& cfg);
+
+/**
+ * @brief Moves to the next phase. Called from the run loop at `sampling_next`.
+ */
+void sampling_event();
+
+/**
+ * @brief Stops sampling, drops a window the run ended inside, and returns the estimate. Timing is back on after.
+ */
+SampleEstimate sampling_finish();
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef spsc_h_
+#define spsc_h_
+
+// bounded single-producer/single-consumer ring used to hand work between threads without locks
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Lock-free queue between exactly one producer thread and one consumer thread.
+ * @details Capacity is rounded up to a power of two. Each side caches the other side's index and only reloads it
+ * when the ring looks full (producer) or empty (consumer), so in steady state a bulk push or pop costs one release
+ * store. `close()` is how the producer says no more items are coming.
+ */
+template <typename T>
+class SpscRing {
+   public:
+    explicit SpscRing(size_t capacity) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        buffer.resize(cap);
+        mask = cap - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return mask + 1; }
+
+    // producer side. Returns how many of `items` fit, possibly 0.
+    size_t pushBulk(const T* items, size_t count) {
+        size_t head = writeIdx.load(std::memory_order_relaxed);
+        if (capacity() - (head - cachedRead) < count) cachedRead = readIdx.load(std::memory_order_acquire);
+
+        size_t space = capacity() - (head - cachedRead);
+        size_t n = count < space ? count : space;
+        for (size_t i = 0; i < n; i++)
+            buffer[(head + i) & mask] = items[i];
+
+        writeIdx.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    bool push(const T& item) { return pushBulk(&item, 1) == 1; }
+
+    // consumer side. Returns how many items were copied into `out`, possibly 0.
+    size_t popBulk(T* out, size_t max) {
+        size_t tail = readIdx.load(std::memory_order_relaxed);
+        if (cachedWrite == tail) cachedWrite = writeIdx.load(std::memory_order_acquire);
+
+        size_t avail = cachedWrite - tail;
+        size_t n = max < avail ? max : avail;
+        for (size_t i = 0; i < n; i++)
+            out[i] = buffer[(tail + i) & mask];
+
+        readIdx.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    bool pop(T& item) { return popBulk(&item, 1) == 1; }
+
+    void close() { closed.store(true, std::memory_order_release); }
+
+    // empties and reopens the ring. Only safe while neither side is using it.
+    void reset() {
+        writeIdx.store(0, std::memory_order_relaxed);
+        readIdx.store(0, std::memory_order_relaxed);
+        cachedRead = 0;
+        cachedWrite = 0;
+        closed.store(false, std::memory_order_release);
+    }
+
+    // TRUE once the producer has closed the ring and everything pushed before that has been popped
+    bool drained() const {
+        return closed.load(std::memory_order_acquire) &&
+               readIdx.load(std::memory_order_relaxed) == writeIdx.load(std::memory_order_acquire);
+    }
+
+   private:
+    std::vector<T> buffer;
+    size_t mask = 0;
+
+    alignas(64) std::atomic<size_t> writeIdx{0};
+    size_t cachedRead = 0;  // producer's copy of readIdx
+
+    alignas(64) std::atomic<size_t> readIdx{0};
+    size_t cachedWrite = 0;  // consumer's copy of writeIdx
+
+    alignas(64) std::atomic<bool> closed{false};
+};
+
+#endif
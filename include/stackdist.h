@@ -0,0 +1,71 @@
+#ifndef stackdist_h_
+#define stackdist_h_
+
+// single-pass LRU stack distance (reuse distance) analysis, used to build miss-ratio curves for every
+// fully associative cache size at once instead of re-running the emulator per size.
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "emu4380.h"
+
+/**
+ * @brief Computes LRU stack distances over the guest's memory access stream.
+ * @details Mattson's observation is that an access hits in a fully associative LRU cache of C lines exactly
+ * when fewer than C distinct blocks were touched since the previous access to the same block. Following
+ * Bennett & Kruskal, each block's most recent access time is marked in an order-statistics (Fenwick) tree so
+ * that the number of distinct blocks touched since then is a single range count, making every access O(log n).
+ * \n Optionally samples blocks SHARDS-style (a fixed-rate spatial hash filter) so very long runs can be analyzed
+ * with a fraction of the memory and time; distances are rescaled by the sampling rate when the curve is written.
+ */
+struct StackDistance {
+    uint32_t shift = 0;      // log2 of the analysis granularity in bytes
+    double rate = 1.0;       // SHARDS sampling rate, 1.0 means every block is analyzed
+    uint32_t threshold = 0;  // sampled when (hash & SAMPLE_MODULUS - 1) < threshold
+
+    uint32_t now = 0;                                 // logical time of the next sampled access, starts at 1
+    std::vector<uint32_t> tree;                       // fenwick tree over access times, 1-indexed
+    std::unordered_map<uint32_t, uint32_t> lastseen;  // block -> time of its most recent access
+
+    // per access class (instruction fetch, data)
+    std::vector<uint64_t> hist[2];  // hist[c][d] = accesses whose stack distance was d
+    uint64_t cold[2] = {};          // first touch of a block, a miss at every cache size
+    uint64_t refs[2] = {};          // sampled accesses
+
+    /**
+     * @brief Resets the analysis.
+     * @param granularity block size in bytes, must be a power of two.
+     * @param sampleRate fraction of blocks to analyze, in (0, 1].
+     * @return FALSE if either parameter is invalid.
+     */
+    bool init(uint32_t granularity, double sampleRate = 1.0);
+
+    /**
+     * @brief Records one access, computing its stack distance.
+     */
+    void access(uint32_t address, AccessClass cls);
+
+    /**
+     * @brief Fraction of class `cls` accesses (or all of them when cls is out of range) that miss in a fully
+     * associative LRU cache of `lines` blocks.
+     */
+    double missRatio(uint64_t lines, int cls = -1) const;
+
+    /**
+     * @brief Writes the miss-ratio curve as CSV, one row per cache size in blocks.
+     * @return FALSE if the file can't be opened.
+     */
+    bool write(const char* filename) const;
+
+   private:
+    void mark(uint32_t t, int delta);
+    uint32_t prefix(uint32_t t) const;
+    void compact();
+};
+
+extern StackDistance stackdist;
+extern bool stackdist_enabled;
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef summary_h_
+#define summary_h_
+
+// machine readable run summary, written once when the emulator exits
+
+#include "emu4380.h"
+
+extern bool summary_enabled;
+extern uint32_t stack_low;  // lowest `SP` seen, kept by the run loop
+
+/**
+ * @brief Starts the host clock the summary's wall time is measured from and remembers where to write it.
+ */
+void summary_start(const char* filename);
+
+/**
+ * @brief Writes the summary as a JSON object and stops collecting.
+ * @details Fields: `status`, `instructions`, `cycles` (`mem_cycle_cntr`), `cpi` (memory cycles per instruction),
+ * `host_seconds`, `host_ns_per_instruction`, a `cache` object with the hit, miss, write-back, victim hit and
+ * eviction counts, a `roi` object when the program marked regions of interest, a `pipeline` object with the in-order
+ * model's cycles, CPI and stalls when it ran, an `ooo` object with the out-of-order model's cycles,
+ * IPC and memory-level parallelism when it ran, a `branch_predictors` array with each predictor's misses and MPKI, `peak_stack_bytes` (`SB` minus the lowest `SP`) and `final_hp`.
+ * @param status how the run ended, e.g. "completed"
+ * @return FALSE if the file can't be written
+ */
+bool summary_write(const char* status);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef sweep_h_
+#define sweep_h_
+
+// cache configuration sweeps: run one binary against a grid of cache geometries, in parallel, and emit a CSV
+
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "mmu.h"
+
+// one point of a sweep grid
+using SweepPoint = CacheConfig;
+
+/**
+ * @brief Expands a grid description into every combination of its values.
+ * @details The grid is `key=v1,v2,...` groups separated by `;`, keys are `block`, `lines`, `assoc`, `policy`,
+ * `victim` (victim cache entries), `victim_latency`, `mshrs` (0 for a blocking cache), `sector` (sector bytes, 0 for
+ * whole-block lines), `sector_fill` (sectors fetched per miss), `partition` (`none`, `fixed` or `ucp`), the fixed
+ * way quotas `ways_code`, `ways_static`, `ways_heap` and `ways_stack` (all 0 for an even split) and `repartition`
+ * (accesses between `ucp` resizes).
+ * \n `assoc` also accepts `full`, `policy` accepts `lru`, `fifo` and `random`. Keys that are left out use the
+ * default `-c 1` geometry. Example: `block=16,32;lines=64,128;assoc=1,2,full;policy=lru,fifo`
+ * @return FALSE if the description can't be parsed, otherwise TRUE
+ */
+bool parseSweepGrid(const string& spec, vector<SweepPoint>& grid);
+
+/**
+ * @brief Runs `binary` once per grid point, each in its own forked emulator process, at most `jobs` at a time.
+ * @details Every run sees the same stdin contents (`input`), is held to `limits` and has its guest output
+ * discarded. `mmu`, when given, is started in every run as `--mmu` would; the cost model and DRAM model are
+ * inherited from this process. One CSV row per grid point, in grid order, is written to `csvFile` (stdout when
+ * empty) with memory cycles, hit/miss counts and the host time spent executing; a run that hit a limit has the
+ * limit as its status.
+ * @return 0 when every point ran to completion, 1 if any of them failed or was stopped, 2 if the CSV can't be
+ * written.
+ */
+int runSweep(const vector<SweepPoint>& grid,
+             const string& binary,
+             uint32_t memSize,
+             const string& input,
+             const string& csvFile,
+             unsigned jobs,
+             const RunLimits& limits = RunLimits(),
+             const MmuConfig* mmu = nullptr);
+
+#endif
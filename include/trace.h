@@ -0,0 +1,67 @@
+#ifndef trace_h_
+#define trace_h_
+
+// memory access traces: recorded while the emulator runs, replayed against any cache geometry without re-executing
+// the program. Replay can split the cache by set across worker threads.
+
+#include <vector>
+
+#include "cache.h"
+
+/**
+ * @brief One guest memory access, as stored in a trace file.
+ * @details A trace file is a 16 byte header (`TRACE_MAGIC`, version, record size, all little endian) followed by
+ * one record per access, in program order.
+ */
+struct AccessRecord {
+    uint32_t addr;
+    uint8_t type;  // AccessType
+    uint8_t cls;   // AccessClass
+    uint8_t part;  // CachePartition
+    uint8_t reserved;
+};
+static_assert(sizeof(AccessRecord) == 8, "trace records are written to disk as-is");
+
+constexpr char TRACE_MAGIC[8] = {'4', '3', '8', '0', 'T', 'R', 'C', '\0'};
+constexpr uint32_t TRACE_VERSION = 2;  // 2 added `AccessRecord::part`
+
+extern bool trace_enabled;
+
+/**
+ * @brief Starts recording every guest memory access into `filename`.
+ * @return FALSE if the file can't be created
+ */
+bool trace_open(const char* filename);
+
+/**
+ * @brief Appends one access to the open trace, buffered.
+ */
+void trace_record(uint32_t addr, AccessType type, AccessClass cls, CachePartition part);
+
+/**
+ * @brief Flushes and closes the trace.
+ * @return FALSE if any write failed
+ */
+bool trace_close();
+
+struct ReplayResult {
+    uint64_t accesses = 0;
+    uint64_t cycles = 0;  // memory cycles a live run with the same cache would have charged
+    CacheStats stats;
+    std::vector<CacheStats> setStats;
+    unsigned shards = 1;  // worker threads the sets were split across
+};
+
+/**
+ * @brief Replays a trace through a cache with geometry `cfg`.
+ * @details Accesses to different sets never interact, so with `threads > 1` the sets are dealt round-robin to that
+ * many workers, each owning a private cache model fed through its own lock-free queue by the reading thread. Each
+ * record keeps its position in the trace as its LRU/FIFO stamp, so every shard makes exactly the replacement
+ * decisions a sequential replay makes and the merged counts match it. A fully associative cache has one set, while
+ * random replacement, a victim cache, miss classification and utility-based partitioning are shared by every set,
+ * so those always replay sequentially.
+ * @return FALSE if the trace can't be read or the geometry is invalid
+ */
+bool replayTrace(const char* filename, const CacheConfig& cfg, unsigned threads, ReplayResult& result);
+
+#endif
@@ -0,0 +1,324 @@
+#include "bpred.h"
+/**
+ * @file bpred.cpp
+ * @brief Branch direction predictors, BTB and return address stack
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+using namespace std;
+
+bool bpred_enabled = false;
+vector<BranchUnit> bpred_units;
+uint64_t bpred_instructions = 0;
+
+static bool bpred_per_site = false;
+static unordered_map<uint32_t, BranchSite> bpred_sites;
+
+static const char* PREDICTOR_NAMES[PRED_COUNT] = {"static", "bimodal", "gshare", "tage"};
+
+// saturating 2-bit counter, taken from 2 up
+static inline void train2(uint8_t& c, bool taken) {
+    if (taken && c < 3) c++;
+    if (!taken && c > 0) c--;
+}
+
+class StaticPredictor : public DirectionPredictor {
+   public:
+    bool predict(uint32_t pc, uint32_t target) override { return target < pc; }
+    void update(uint32_t, bool) override {}
+};
+
+class BimodalPredictor : public DirectionPredictor {
+   public:
+    static constexpr uint32_t ENTRIES = 4096;
+
+    bool predict(uint32_t pc, uint32_t) override { return table[index(pc)] >= 2; }
+    void update(uint32_t pc, bool taken) override { train2(table[index(pc)], taken); }
+
+   private:
+    vector<uint8_t> table = vector<uint8_t>(ENTRIES, 1);
+    static uint32_t index(uint32_t pc) { return (pc >> 3) & (ENTRIES - 1); }
+};
+
+class GsharePredictor : public DirectionPredictor {
+   public:
+    static constexpr uint32_t HISTORY_BITS = 12;
+
+    bool predict(uint32_t pc, uint32_t) override { return table[index(pc)] >= 2; }
+    void update(uint32_t pc, bool taken) override {
+        train2(table[index(pc)], taken);
+        history = ((history << 1) | taken) & ((1u << HISTORY_BITS) - 1);
+    }
+
+   private:
+    vector<uint8_t> table = vector<uint8_t>(1u << HISTORY_BITS, 1);
+    uint32_t history = 0;
+    uint32_t index(uint32_t pc) const { return ((pc >> 3) ^ history) & ((1u << HISTORY_BITS) - 1); }
+};
+
+/**
+ * @brief Cut down TAGE: a bimodal base and four tagged tables indexed by PC and 4, 8, 16 and 32 bits of global
+ * history. The longest matching table provides the prediction; a misprediction allocates an entry in a longer
+ * table whose useful counter is zero, or ages those counters when there is none.
+ */
+class TagePredictor : public DirectionPredictor {
+   public:
+    static constexpr uint32_t TABLES = 4;
+    static constexpr uint32_t INDEX_BITS = 10;
+    static constexpr uint32_t TAG_BITS = 8;
+    static constexpr uint32_t HISTORY[TABLES] = {4, 8, 16, 32};
+
+    bool predict(uint32_t pc, uint32_t) override {
+        provider = -1;
+        alt = -1;
+        for (uint32_t t = 0; t < TABLES; t++) {
+            idx[t] = index(pc, t);
+            tags[t] = tag(pc, t);
+        }
+        for (int t = TABLES - 1; t >= 0; t--) {
+            if (tables[t][idx[t]].tag != tags[t]) continue;
+            if (provider < 0)
+                provider = t;
+            else if (alt < 0)
+                alt = t;
+        }
+        basePred = base[baseIndex(pc)] >= 2;
+        altPred = alt >= 0 ? tables[alt][idx[alt]].ctr >= 0 : basePred;
+        pred = provider >= 0 ? tables[provider][idx[provider]].ctr >= 0 : basePred;
+        return pred;
+    }
+
+    void update(uint32_t pc, bool taken) override {
+        if (provider >= 0) {
+            Entry& e = tables[provider][idx[provider]];
+            if (pred != altPred) e.useful = pred == taken ? min(e.useful + 1, 3) : max(e.useful - 1, 0);
+            e.ctr = static_cast<int8_t>(taken ? min(e.ctr + 1, 3) : max(e.ctr - 1, -4));
+        } else {
+            train2(base[baseIndex(pc)], taken);
+        }
+
+        if (pred != taken && provider < static_cast<int>(TABLES) - 1) {
+            bool allocated = false;
+            for (uint32_t t = provider + 1; t < TABLES && !allocated; t++) {
+                Entry& e = tables[t][idx[t]];
+                if (e.useful != 0) continue;
+                e.tag = tags[t];
+                e.ctr = taken ? 0 : -1;
+                allocated = true;
+            }
+            if (!allocated)
+                for (uint32_t t = provider + 1; t < TABLES; t++) tables[t][idx[t]].useful--;
+        }
+
+        history = (history << 1) | taken;
+    }
+
+   private:
+    struct Entry {
+        uint16_t tag = 0xFFFF;  // never a real tag
+        int8_t ctr = 0;         // taken from 0 up, -4..3
+        int8_t useful = 0;      // 0..3
+    };
+
+    vector<uint8_t> base = vector<uint8_t>(1u << 12, 1);
+    vector<Entry> tables[TABLES] = {vector<Entry>(1u << INDEX_BITS), vector<Entry>(1u << INDEX_BITS),
+                                    vector<Entry>(1u << INDEX_BITS), vector<Entry>(1u << INDEX_BITS)};
+    uint64_t history = 0;
+
+    // lookup of the branch in flight, reused by `update()`
+    uint32_t idx[TABLES] = {};
+    uint16_t tags[TABLES] = {};
+    int provider = -1;
+    int alt = -1;
+    bool pred = false;
+    bool altPred = false;
+    bool basePred = false;
+
+    static uint32_t baseIndex(uint32_t pc) { return (pc >> 3) & ((1u << 12) - 1); }
+
+    // the newest `length` history bits xor-folded down to `bits`
+    uint32_t fold(uint32_t length, uint32_t bits) const {
+        uint64_t h = length < 64 ? history & ((uint64_t(1) << length) - 1) : history;
+        uint32_t out = 0;
+        for (; h; h >>= bits) out ^= static_cast<uint32_t>(h & ((1u << bits) - 1));
+        return out;
+    }
+    uint32_t index(uint32_t pc, uint32_t t) const {
+        return ((pc >> 3) ^ (pc >> (3 + INDEX_BITS)) ^ fold(HISTORY[t], INDEX_BITS)) & ((1u << INDEX_BITS) - 1);
+    }
+    uint16_t tag(uint32_t pc, uint32_t t) const {
+        return static_cast<uint16_t>(((pc >> 3) ^ fold(HISTORY[t], TAG_BITS) ^ (fold(HISTORY[t], TAG_BITS - 1) << 1)) &
+                                     ((1u << TAG_BITS) - 1));
+    }
+};
+
+constexpr uint32_t TagePredictor::HISTORY[TagePredictor::TABLES];
+
+unique_ptr<DirectionPredictor> make_predictor(PredictorKind kind) {
+    switch (kind) {
+        case PRED_BIMODAL:
+            return unique_ptr<DirectionPredictor>(new BimodalPredictor());
+        case PRED_GSHARE:
+            return unique_ptr<DirectionPredictor>(new GsharePredictor());
+        case PRED_TAGE:
+            return unique_ptr<DirectionPredictor>(new TagePredictor());
+        default:
+            return unique_ptr<DirectionPredictor>(new StaticPredictor());
+    }
+}
+
+BranchUnit::BranchUnit(PredictorKind kind) : kind(kind), direction(make_predictor(kind)), btb(BTB_ENTRIES) {}
+
+bool BranchUnit::btbHas(uint32_t pc, uint32_t target) {
+    BtbEntry& e = btbEntry(pc);
+    bool hit = e.valid && e.pc == pc && e.target == target;
+    e.valid = true;
+    e.pc = pc;
+    e.target = target;
+    return hit;
+}
+
+bool BranchUnit::retire(const RetiredInstr& r) {
+    const bool taken = (r.flags & RETIRE_TAKEN) != 0;
+    bool miss = false;
+
+    if (r.flags & RETIRE_BRANCH) {
+        stats.branches++;
+        bool predicted = direction->predict(r.pc, r.target);
+        direction->update(r.pc, taken);
+        if (predicted != taken) {
+            stats.directionMisses++;
+            miss = true;
+        } else if (taken && !btbHas(r.pc, r.nextPc)) {
+            stats.targetMisses++;
+            miss = true;
+        }
+        if (taken && miss) btbHas(r.pc, r.nextPc);  // train the target on a direction miss too
+        return miss;
+    }
+
+    stats.jumps++;
+    if (r.op == OP_RET || r.op == OP_JMR) {
+        uint32_t top = rasDepth ? ras[(rasTop + RAS_ENTRIES - 1) % RAS_ENTRIES] : 0;
+        bool fromStack = rasDepth && top == r.nextPc;
+        if (r.op == OP_RET) {
+            miss = !fromStack;
+        } else {
+            // JMR: the BTB first, a return to the top of the stack otherwise
+            BtbEntry& e = btbEntry(r.pc);
+            bool btbHit = e.valid && e.pc == r.pc;
+            miss = btbHit ? e.target != r.nextPc : !fromStack;
+            btbHas(r.pc, r.nextPc);
+        }
+        if ((r.op == OP_RET || fromStack) && rasDepth) {
+            rasTop = (rasTop + RAS_ENTRIES - 1) % RAS_ENTRIES;
+            rasDepth--;
+        }
+    } else {
+        miss = !btbHas(r.pc, r.nextPc);
+        if (r.op == OP_CALL) {
+            ras[rasTop] = r.pc + 8;
+            rasTop = (rasTop + 1) % RAS_ENTRIES;
+            rasDepth = min(rasDepth + 1, RAS_ENTRIES);
+        }
+    }
+    if (miss) stats.targetMisses++;
+    return miss;
+}
+
+bool parsePredictorList(const string& spec, vector<PredictorKind>& kinds) {
+    vector<PredictorKind> parsed;
+    stringstream in(spec);
+    string name;
+    while (getline(in, name, ',')) {
+        const char** found = find(begin(PREDICTOR_NAMES), end(PREDICTOR_NAMES), name);
+        if (found == end(PREDICTOR_NAMES)) return false;
+        parsed.push_back(static_cast<PredictorKind>(found - begin(PREDICTOR_NAMES)));
+    }
+    if (parsed.empty()) return false;
+    kinds = parsed;
+    return true;
+}
+
+const char* predictor_name(PredictorKind kind) {
+    return kind < PRED_COUNT ? PREDICTOR_NAMES[kind] : "unknown";
+}
+
+void bpred_start(const vector<PredictorKind>& kinds, bool perSite) {
+    bpred_units.clear();
+    for (PredictorKind k : kinds) bpred_units.emplace_back(k);
+    bpred_instructions = 0;
+    bpred_per_site = perSite;
+    bpred_sites.clear();
+    bpred_enabled = true;
+}
+
+void bpred_retire(RetiredInstr& r) {
+    bpred_instructions++;
+    if (!(r.flags & (RETIRE_BRANCH | RETIRE_JUMP))) return;
+
+    BranchSite* site = nullptr;
+    if (bpred_per_site) {
+        site = &bpred_sites[r.pc];
+        if (site->misses.empty()) {
+            site->op = r.op;
+            site->misses.assign(bpred_units.size(), 0);
+        }
+        site->executed++;
+        if (r.flags & RETIRE_TAKEN) site->taken++;
+    }
+
+    r.flags |= RETIRE_PREDICTED;
+    for (size_t i = 0; i < bpred_units.size(); i++) {
+        if (!bpred_units[i].retire(r)) continue;
+        if (i == 0) r.flags |= RETIRE_MISPREDICTED;
+        if (site) site->misses[i]++;
+    }
+}
+
+static const char* controlName(uint8_t op) {
+    switch (op) {
+        case OP_JMP:
+            return "JMP";
+        case OP_JMR:
+            return "JMR";
+        case OP_BNZ:
+            return "BNZ";
+        case OP_BGT:
+            return "BGT";
+        case OP_BLT:
+            return "BLT";
+        case OP_BRZ:
+            return "BRZ";
+        case OP_CALL:
+            return "CALL";
+        case OP_RET:
+            return "RET";
+        default:
+            return "?";
+    }
+}
+
+bool write_bpred_report(const char* filename) {
+    if (!bpred_per_site) return false;
+    ofstream out(filename);
+    if (!out) return false;
+
+    out << "pc,op,executed,taken";
+    for (const BranchUnit& u : bpred_units) out << ',' << predictor_name(u.kind) << "_mispredicts";
+    out << '\n';
+
+    map<uint32_t, const BranchSite*> byPc;
+    for (const auto& s : bpred_sites) byPc[s.first] = &s.second;
+    for (const auto& s : byPc) {
+        out << s.first << ',' << controlName(s.second->op) << ',' << s.second->executed << ',' << s.second->taken;
+        for (uint64_t m : s.second->misses) out << ',' << m;
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,806 @@
+#include "cache.h"
+/**
+ * @file cache.cpp
+ * @brief Cache timing model shared by the emulator and trace replay
+ */
+
+#include <algorithm>
+#include <thread>
+
+#include "costs.h"
+
+constexpr size_t PIPELINE_BATCH = 256;  // accesses handed to a worker per push
+
+CacheModel cache_model;
+bool cache_pipelined = false;
+
+static CacheWorker* pipeline = nullptr;
+static std::thread pipeline_thread;
+static std::vector<CacheAccess> pipeline_pending;
+static uint64_t pipeline_stamp = 0;
+static uint64_t pipeline_pushed = 0;   // queue entries handed to the worker
+static uint64_t pipeline_charged = 0;  // worker cycles already in `mem_cycle_cntr`
+
+bool CacheModel::configure(const CacheConfig& cfg) {
+    const auto isPow2 = [](uint32_t v) { return v != 0 && (v & (v - 1)) == 0; };
+
+    uint32_t w = cfg.ways ? cfg.ways : cfg.lines;
+    if (!isPow2(cfg.blockSize) || cfg.blockSize < 4 || cfg.blockSize > MAX_BLOCK_SIZE) return false;
+    uint32_t sector = cfg.sectorSize ? cfg.sectorSize : cfg.blockSize;
+    if (!isPow2(sector) || sector < 4 || sector > cfg.blockSize) return false;
+    if (!isPow2(cfg.sectorFill) || cfg.sectorFill > cfg.blockSize / sector) return false;
+
+    // every partition needs a way of its own, fixed quotas have to add up to the associativity
+    uint32_t quotas[PART_COUNT] = {};
+    if (cfg.partition != PARTITION_NONE) {
+        if (w < PART_COUNT || (cfg.partition == PARTITION_UTILITY && cfg.repartition == 0)) return false;
+        uint32_t total = 0;
+        for (uint32_t p = 0; p < PART_COUNT; p++)
+            total += quotas[p] = cfg.quotas[p];
+        if (cfg.partition == PARTITION_UTILITY || total == 0) {
+            for (uint32_t p = 0; p < PART_COUNT; p++)
+                quotas[p] = w / PART_COUNT + (p < w % PART_COUNT);
+        } else if (total != w || std::count(quotas, quotas + PART_COUNT, 0u)) {
+            return false;
+        }
+    }
+    if (!isPow2(cfg.lines) || !isPow2(w) || w > cfg.lines) return false;
+    if (cfg.victims > MAX_VICTIMS || cfg.victimLatency == 0 || cfg.mshrs > MAX_MSHRS) return false;
+
+    release();
+
+    blockSize = cfg.blockSize;
+    numLines = cfg.lines;
+    ways = w;
+    numSets = numLines / ways;
+    policy = cfg.policy;
+    rng = 0x2545F491;
+
+    offsetBits = log2(blockSize);
+    setBits = log2(numSets);
+    offsetMask = (1u << offsetBits) - 1;
+    setMask = (1u << setBits) - 1;
+
+    sectorSize = sector;
+    sectorBits = log2(sectorSize);
+    sectorsPerLine = blockSize / sectorSize;
+    sectorFill = cfg.sectorFill;
+    fillGroup = sectorFill == 32 ? UINT32_MAX : (1u << sectorFill) - 1;
+
+    partition = cfg.partition;
+    if (partition != PARTITION_NONE) setQuotas(quotas);
+    utility.reset(partition == PARTITION_UTILITY ? new UtilityMonitor(ways, numSets) : nullptr);
+    repartition = untilRepartition = cfg.repartition;
+
+    sets = new Line*[numSets];
+    for (size_t s = 0; s < numSets; ++s) {
+        sets[s] = new Line[ways];
+        for (size_t way = 0; way < ways; ++way)
+            sets[s][way].badline();
+    }
+
+    victims.assign(cfg.victims, Line());
+    for (Line& v : victims)
+        v.badline();
+    victimLatency = cfg.victimLatency;
+    classifier.reset(cfg.classify ? new MissClassifier(numLines) : nullptr);
+
+    mshrCount = cfg.mshrs;
+    mshrs.clear();
+    mshrs.reserve(mshrCount);
+    clock = 0;
+    busyUntil = 0;
+
+    stats = CacheStats();
+    setStats.assign(numSets, CacheStats());
+    return true;
+}
+
+void CacheModel::release() {
+    if (!sets) return;
+    for (size_t s = 0; s < numSets; s++)
+        delete[] sets[s];
+    delete[] sets;
+    sets = nullptr;
+}
+
+void CacheModel::flush() {
+    for (size_t s = 0; sets && s < numSets; s++) {
+        for (size_t way = 0; way < ways; way++) {
+            Line& line = sets[s][way];
+            if (line.valid && line.dirty) copyBack(line, (line.tag << (setBits + offsetBits)) | (s << offsetBits));
+            line.badline();
+        }
+    }
+    for (Line& v : victims) {
+        if (v.valid && v.dirty) copyBack(v, v.tag << offsetBits);
+        v.badline();
+    }
+}
+
+uint32_t CacheModel::handleCacheHit(Line& line, AccessType accessType, uint64_t stamp, uint32_t sectors) {
+    if (ways > 1 && policy == POLICY_LRU) line.lastused = stamp;
+    line.usedSectors |= sectors;
+    if (accessType == WRITEBYTE || accessType == WRITEWORD) {
+        line.dirty = true;
+        line.dirtySectors |= sectors;
+    }
+    return cost_model.hit;
+}
+
+// first 4-byte word is 8 cycles, then every cycle after that is 2 cycles, unless the cost model says otherwise
+static uint32_t cyclesneeded(uint32_t words) {
+    return cost_model.transfer(words);
+}
+
+// moves `words` words starting at `address` between the cache and memory, in one request
+uint32_t CacheModel::transfer(uint32_t address, uint32_t words, bool write) {
+    if (memory) return memory->access(address, words, write);
+    if (burst && !write) return cost_model.fillNextWord * words;
+    return cyclesneeded(words);
+}
+
+// fetches the `sectorFill` aligned groups `sectors` fall in, all but the sectors `line` already holds
+uint32_t CacheModel::fillSectors(Line& line, uint32_t base, uint32_t sectors) {
+    uint32_t wanted = 0;
+    for (uint32_t s = 0; s < sectorsPerLine; s += sectorFill)
+        if (sectors & (fillGroup << s)) wanted |= fillGroup << s;
+    uint32_t missing = wanted & ~line.validSectors;
+
+    uint32_t first = __builtin_ctz(missing);
+    uint32_t count = __builtin_popcount(missing);
+    for (uint32_t s = first; backing && s < sectorsPerLine; s++)
+        if (missing & (1u << s)) memcpy(&line.data[s * sectorSize], &backing[base + s * sectorSize], sectorSize);
+    line.validSectors |= missing;
+
+    uint32_t cycles = transfer(base + first * sectorSize, count * (sectorSize / 4), false);
+    if (burst && !memory) stats.batchedFills++;
+    stats.sectorFills += count;
+    filled = true;
+    return cycles;
+}
+
+// copies the dirty sectors of `line`, which holds the block at `base`, into `backing`
+void CacheModel::copyBack(const Line& line, uint32_t base) {
+    if (!backing) return;
+    for (uint32_t s = 0; s < sectorsPerLine; s++)
+        if (line.dirtySectors & (1u << s))
+            memcpy(&backing[base + s * sectorSize], &line.data[s * sectorSize], sectorSize);
+}
+
+uint32_t CacheModel::writeBack(const Line& line, uint32_t base) {
+    copyBack(line, base);
+    stats.writebacks++;
+    setStats[setIndex(base)].writebacks++;
+    uint32_t first = __builtin_ctz(line.dirtySectors);
+    return transfer(base + first * sectorSize, __builtin_popcount(line.dirtySectors) * (sectorSize / 4), true);
+}
+
+// counts `line` leaving set `setidx` to make room for another block
+void CacheModel::noteEviction(const Line& line, uint32_t setidx) {
+    stats.evictions++;
+    setStats[setidx].evictions++;
+    if (sectorsPerLine > 1) {
+        stats.evictedSectors += sectorsPerLine;
+        stats.evictedValid += __builtin_popcount(line.validSectors);
+        stats.evictedUsed += __builtin_popcount(line.usedSectors);
+    }
+}
+
+void CacheModel::retireMshrs(uint64_t now) {
+    mshrs.erase(std::remove_if(mshrs.begin(), mshrs.end(), [now](const Mshr& m) { return m.ready <= now; }),
+                mshrs.end());
+}
+
+Mshr* CacheModel::pendingFill(uint32_t block) {
+    for (Mshr& m : mshrs)
+        if (m.fill && m.block == block) return &m;
+    return nullptr;
+}
+
+// issues a transfer at `now`, or once the earliest MSHR frees up if none is free. Returns the cycles waited.
+uint32_t CacheModel::allocateMshr(uint32_t block, uint32_t cycles, bool fill, uint64_t now) {
+    retireMshrs(now);
+    uint64_t start = now;
+    if (mshrs.size() >= mshrCount) {
+        start = std::min_element(mshrs.begin(), mshrs.end(), [](const Mshr& a, const Mshr& b) {
+                    return a.ready < b.ready;
+                })->ready;
+        retireMshrs(start);
+    }
+
+    // transfers are issued in time order, so the busy intervals only ever grow at the end
+    uint64_t ready = start + cycles;
+    stats.missCycles += cycles;
+    if (ready > busyUntil) {
+        stats.missBusyCycles += ready - std::max(start, busyUntil);
+        busyUntil = ready;
+    }
+    mshrs.push_back({block, ready, fill});
+    stats.mshrStallCycles += start - now;
+    return static_cast<uint32_t>(start - now);
+}
+
+// cycles a miss costs the access when its write-back and fill go through MSHRs
+uint32_t CacheModel::nonBlockingMiss(uint32_t block,
+                                     uint32_t writeBackCycles,
+                                     uint32_t fillCycles,
+                                     AccessType accessType) {
+    uint64_t now = clock;
+    if (writeBackCycles) now += allocateMshr(block, writeBackCycles, false, now);
+    now += allocateMshr(block, fillCycles, true, now);
+
+    uint64_t cycles = now - clock;
+    if (accessType == READBYTE || accessType == READWORD) cycles += fillCycles;
+    return static_cast<uint32_t>(cycles);
+}
+
+// parks a block evicted from `setidx` in the victim cache, pushing out the least recently used entry
+uint32_t CacheModel::retireToVictims(const Line& line, uint32_t setidx, uint64_t stamp) {
+    Line* slot = &victims[0];
+    for (Line& v : victims) {
+        if (!v.valid) {
+            slot = &v;
+            break;
+        }
+        if (v.lastused < slot->lastused) slot = &v;
+    }
+
+    uint32_t cycles = 0;
+    if (slot->valid && slot->dirty) cycles += writeBack(*slot, slot->tag << offsetBits);
+
+    *slot = line;
+    slot->tag = (line.tag << setBits) | setidx;
+    slot->lastused = stamp;
+    return cycles;
+}
+
+uint32_t CacheModel::handleCacheMiss(uint32_t address,
+                                     uint32_t setidx,
+                                     Line& line,
+                                     AccessType accessType,
+                                     uint64_t stamp) {
+    uint32_t block = address >> offsetBits;
+    uint32_t tag = address >> (offsetBits + setBits);
+    uint32_t base = address & ~(blockSize - 1);
+    uint32_t sectors = sectorsOf(address, accessType);
+
+    for (Line& v : victims) {
+        if (!v.valid || v.tag != block) continue;
+
+        // ******VICTIM HIT****** the two blocks trade places
+        stats.victimHits++;
+        setStats[setidx].victimHits++;
+        if (line.valid) noteEviction(line, setidx);
+
+        Line evicted = line;
+        line = v;
+        line.tag = tag;
+        line.lastused = stamp;
+        if (evicted.valid) {
+            v = evicted;
+            v.tag = (evicted.tag << setBits) | setidx;
+            v.lastused = stamp;
+        } else {
+            v.badline();
+        }
+
+        // the victim may not hold every sector the access needs
+        uint32_t cycles = victimLatency;
+        if ((line.validSectors & sectors) != sectors) cycles += fillSectors(line, base, sectors);
+        handleCacheHit(line, accessType, stamp, sectors);
+        if (mshrCount) stats.blockingCycles += cycles;
+        return cycles;
+    }
+
+    uint32_t writeBackCycles = 0;
+
+    if (line.valid) noteEviction(line, setidx);
+    if (line.valid && !victims.empty()) {
+        writeBackCycles = retireToVictims(line, setidx, stamp);
+    } else if (line.valid && line.dirty) {
+        writeBackCycles = writeBack(line, (line.tag << (setBits + offsetBits)) | (setidx << offsetBits));
+    }
+
+    line.validSectors = line.dirtySectors = line.usedSectors = 0;
+    uint32_t fillCycles = fillSectors(line, base, sectors);
+
+    uint32_t cycles = writeBackCycles + fillCycles;
+    if (mshrCount) {
+        stats.blockingCycles += cycles + cost_model.hit;
+        cycles = nonBlockingMiss(block, writeBackCycles, fillCycles, accessType);
+    }
+
+    line.tag = tag;
+    line.valid = true;
+    line.dirty = false;
+    line.lastused = stamp;
+
+    return cycles + handleCacheHit(line, accessType, stamp, sectors);
+}
+
+uint32_t CacheModel::handleSectorMiss(uint32_t address,
+                                      uint32_t setidx,
+                                      Line& line,
+                                      AccessType accessType,
+                                      uint64_t stamp,
+                                      uint32_t sectors) {
+    stats.misses++;
+    stats.sectorMisses++;
+    setStats[setidx].misses++;
+    setStats[setidx].sectorMisses++;
+    if (classifier) classifier->access(address >> offsetBits, false);  // the block itself was resident
+
+    uint32_t cycles = fillSectors(line, address & ~(blockSize - 1), sectors);
+    if (mshrCount) {
+        stats.blockingCycles += cycles + cost_model.hit;
+        cycles = nonBlockingMiss(address >> offsetBits, 0, cycles, accessType);
+    }
+    return cycles + handleCacheHit(line, accessType, stamp, sectors);
+}
+
+void CacheModel::setQuotas(const uint32_t quotas[PART_COUNT]) {
+    uint32_t way = 0;
+    for (uint32_t p = 0; p < PART_COUNT; p++) {
+        quota[p] = quotas[p];
+        firstWay[p] = way;
+        way += quotas[p];
+    }
+}
+
+CacheResult CacheModel::checkCache(uint32_t addr,
+                                   AccessType accessType,
+                                   uint64_t stamp,
+                                   uint8_t region,
+                                   uint8_t part) {
+    filled = false;
+    if (utility) {
+        utility->access(part, setIndex(addr), addr >> offsetBits);
+        if (--untilRepartition == 0) {
+            uint32_t quotas[PART_COUNT];
+            utility->allocate(ways, quotas);
+            setQuotas(quotas);
+            stats.repartitions++;
+            untilRepartition = repartition;
+        }
+    }
+    CacheResult result = lookup(addr, accessType, stamp, part);
+    if (regionStats) {
+        RegionStats& r = regionStats[region];
+        (result.hit ? r.hits : r.misses)++;
+        r.cycles += result.cycles;
+    }
+    if (heat && !result.hit) heat->miss(addr);
+    if (mshrCount) {
+        clock += result.cycles;
+        stats.cycles += result.cycles;
+    }
+    return result;
+}
+
+CacheResult CacheModel::checkSecondHalf(uint32_t addr,
+                                        AccessType accessType,
+                                        uint64_t stamp,
+                                        uint8_t region,
+                                        uint8_t part,
+                                        bool continues) {
+    stats.splits++;
+    burst = filled && continues;
+    CacheResult result = checkCache(addr, accessType, stamp, region, part);
+    burst = false;
+    return result;
+}
+
+uint32_t CacheModel::timeAccess(uint32_t addr, AccessType accessType, uint64_t stamp, uint8_t region, uint8_t part) {
+    uint32_t cycles = checkCache(addr, accessType, stamp, region, part).cycles;
+    if (straddles(addr, accessType))
+        cycles += checkSecondHalf((addr | offsetMask) + 1, accessType, stamp + 1, region, part).cycles;
+    return cycles;
+}
+
+CacheResult CacheModel::lookup(uint32_t addr, AccessType accessType, uint64_t stamp, uint8_t part) {
+    uint32_t tagbits = addr >> (offsetBits + setBits);
+    uint32_t setidx = setIndex(addr);
+    Line* set = sets[setidx];
+
+    // the ways a miss may fill: all of them, or the partition's own
+    const size_t lo = partition == PARTITION_NONE ? 0 : firstWay[part];
+    const size_t fillable = partition == PARTITION_NONE ? ways : quota[part];
+    size_t victim = lo;
+    bool foundempty = false;
+    uint64_t oldest = UINT64_MAX;
+
+    CacheResult result;
+
+    // ******CACHE HIT******
+    for (size_t way = 0; way < ways; ++way) {
+        Line& current = set[way];
+
+        if (current.valid && current.tag == tagbits) {
+            result.line = &current;
+            const uint32_t sectors = sectorsOf(addr, accessType);
+            if ((current.validSectors & sectors) != sectors) {
+                // ******SECTOR MISS****** the block is here, part of what the access needs isn't
+                stats.partMisses[part]++;
+                result.cycles = handleSectorMiss(addr, setidx, current, accessType, stamp, sectors);
+                return result;
+            }
+
+            stats.hits++;
+            stats.partHits[part]++;
+            setStats[setidx].hits++;
+            if (classifier) classifier->access(addr >> offsetBits, false);
+
+            result.cycles = handleCacheHit(current, accessType, stamp, sectors);
+            result.hit = true;
+            if (mshrCount) {
+                stats.blockingCycles += result.cycles;
+                retireMshrs(clock);
+                if (Mshr* fill = pendingFill(addr >> offsetBits)) {
+                    // ******SECONDARY MISS****** reads wait for the rest of the fill
+                    stats.secondaryMisses++;
+                    if (accessType == READBYTE || accessType == READWORD)
+                        result.cycles += static_cast<uint32_t>(fill->ready - clock);
+                }
+            }
+            return result;
+        }
+
+        if (way - lo >= fillable) continue;
+        if (!current.valid && !foundempty) {
+            victim = way;
+            foundempty = true;
+
+        } else if (!foundempty && current.valid && current.lastused < oldest) {
+            oldest = current.lastused;
+            victim = way;
+        }
+
+    }  // ******CACHE MISS******
+
+    if (!foundempty && policy == POLICY_RANDOM) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        victim = lo + rng % fillable;
+    }
+
+    stats.misses++;
+    stats.partMisses[part]++;
+    setStats[setidx].misses++;
+    if (classifier) {
+        switch (classifier->access(addr >> offsetBits, true)) {
+            case MISS_COMPULSORY:
+                stats.compulsory++;
+                setStats[setidx].compulsory++;
+                break;
+            case MISS_CAPACITY:
+                stats.capacity++;
+                setStats[setidx].capacity++;
+                break;
+            case MISS_CONFLICT:
+                stats.conflict++;
+                setStats[setidx].conflict++;
+                break;
+            case MISS_NONE:
+                break;
+        }
+    }
+
+    result.line = &set[victim];
+    result.cycles = handleCacheMiss(addr, setidx, set[victim], accessType, stamp);
+    return result;
+}
+
+void CacheWorker::run() {
+    CacheAccess batch[PIPELINE_BATCH];
+    while (true) {
+        size_t n = queue.popBulk(batch, PIPELINE_BATCH);
+        if (n == 0) {
+            if (queue.drained()) return;
+            std::this_thread::yield();
+            continue;
+        }
+        uint64_t charged = 0;
+        for (size_t i = 0; i < n; i++) {
+            const CacheAccess& a = batch[i];
+            if (a.half == HALF_NONE) {
+                charged += model->timeAccess(a.addr, static_cast<AccessType>(a.type), a.stamp, a.region, a.part);
+                continue;
+            }
+            if (a.half == HALF_FRAME_FIRST) {
+                charged += model->checkCache(a.addr, static_cast<AccessType>(a.type), a.stamp, a.region, a.part).cycles;
+                continue;
+            }
+            if (a.half == HALF_FRAME_SECOND) {
+                charged += model->checkSecondHalf(a.addr, static_cast<AccessType>(a.type), a.stamp, a.region, a.part,
+                                                  false).cycles;
+                continue;
+            }
+            charged += model->checkCache(a.addr, static_cast<AccessType>(a.type), a.stamp, a.region, a.part).cycles;
+            if (model->filled) filledHalves[a.half - 1].push_back(a.stamp);
+        }
+        // only this thread writes them; the release on `consumed` publishes the model along with the counts
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        cycles.store(cycles.load(std::memory_order_relaxed) + charged, std::memory_order_relaxed);
+        hits.store(model->stats.hits, std::memory_order_relaxed);
+        misses.store(model->stats.misses, std::memory_order_relaxed);
+        writebacks.store(model->stats.writebacks, std::memory_order_relaxed);
+        consumed.store(consumed.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+}
+
+bool start_cache_pipeline() {
+    if (!cacheUsed || !cache_model.sets) return false;
+    if (cache_pipelined) return true;
+
+    cache_model.backing = nullptr;
+    pipeline = new CacheWorker(&cache_model);
+    pipeline_pending.clear();
+    pipeline_pending.reserve(PIPELINE_BATCH);
+    pipeline_stamp = 0;
+    pipeline_pushed = 0;
+    pipeline_charged = 0;
+
+    pipeline_thread = std::thread(&CacheWorker::run, pipeline);
+    cache_pipelined = true;
+    return true;
+}
+
+static void flushPipeline() {
+    pipeline_pushed += pipeline_pending.size();
+    const CacheAccess* items = pipeline_pending.data();
+    size_t left = pipeline_pending.size();
+    while (left) {
+        size_t n = pipeline->queue.pushBulk(items, left);
+        if (n == 0) std::this_thread::yield();
+        items += n;
+        left -= n;
+    }
+    pipeline_pending.clear();
+}
+
+void pipeline_access(uint32_t address, AccessType accessType, uint8_t region, uint8_t part, uint32_t head, uint32_t next) {
+    const uint8_t type = static_cast<uint8_t>(accessType);
+    if (head) {
+        pipeline_pending.push_back({++pipeline_stamp, address, type, region, HALF_FRAME_FIRST, part});
+        if (pipeline_pending.size() == PIPELINE_BATCH) flushPipeline();
+        pipeline_pending.push_back({++pipeline_stamp, next, type, region, HALF_FRAME_SECOND, part});
+    } else {
+        pipeline_pending.push_back({++pipeline_stamp, address, type, region, HALF_NONE, part});
+        if (cache_model.straddles(address, accessType)) ++pipeline_stamp;  // the worker gives the second half its own
+    }
+    if (pipeline_pending.size() == PIPELINE_BATCH) flushPipeline();
+}
+
+// adds the cycles the worker charged since the last call to `mem_cycle_cntr`
+static void chargePipeline() {
+    const uint64_t total = pipeline->cycles.load(std::memory_order_relaxed);
+    mem_cycle_cntr += total - pipeline_charged;
+    pipeline_charged = total;
+}
+
+void sync_cache_pipeline() {
+    if (!cache_pipelined) return;
+
+    // hand over everything queued so far and wait for the worker to model it, which leaves the model safe to read
+    flushPipeline();
+    while (pipeline->consumed.load(std::memory_order_acquire) != pipeline_pushed)
+        std::this_thread::yield();
+    chargePipeline();
+}
+
+PipelineCounters cache_pipeline_counters() {
+    flushPipeline();  // hand over the partial batch, so the lag is only what the worker hasn't got to yet
+    PipelineCounters c;
+    uint64_t before, after, cycles;
+    do {  // retried only if the worker was publishing a batch right then
+        before = pipeline->version.load(std::memory_order_acquire);
+        c.accesses = pipeline->consumed.load(std::memory_order_relaxed);
+        cycles = pipeline->cycles.load(std::memory_order_relaxed);
+        c.hits = pipeline->hits.load(std::memory_order_relaxed);
+        c.misses = pipeline->misses.load(std::memory_order_relaxed);
+        c.writebacks = pipeline->writebacks.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = pipeline->version.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    c.memCycles = mem_cycle_cntr + cycles - pipeline_charged;
+    return c;
+}
+
+void stop_cache_pipeline() {
+    if (!cache_pipelined) return;
+
+    flushPipeline();
+    pipeline->queue.close();
+    pipeline_thread.join();
+    chargePipeline();
+    delete pipeline;
+    pipeline = nullptr;
+    cache_pipelined = false;
+}
+
+UtilityMonitor::UtilityMonitor(uint32_t w, uint32_t sets)
+    : ways(w),
+      sampleMask(sets >= 32 ? 31 : 0),
+      tags(PART_COUNT * (sets >= 32 ? sets / 32 : sets) * w, UINT32_MAX),
+      hits(PART_COUNT * w, 0) {}
+
+void UtilityMonitor::access(uint8_t part, uint32_t setidx, uint32_t block) {
+    if (setidx & sampleMask) return;
+    const size_t monitored = tags.size() / (PART_COUNT * ways);
+    uint32_t* stack = &tags[(part * monitored + (setidx >> (sampleMask ? 5 : 0))) * ways];
+
+    // move the block to the front, counting a hit at the position it was found
+    uint32_t pos = 0;
+    while (pos < ways - 1 && stack[pos] != block)
+        pos++;
+    if (stack[pos] == block) hits[part * ways + pos]++;
+    for (; pos > 0; pos--)
+        stack[pos] = stack[pos - 1];
+    stack[0] = block;
+}
+
+void UtilityMonitor::allocate(uint32_t total, uint32_t quotas[PART_COUNT]) {
+    const auto gain = [&](uint32_t p, uint32_t from, uint32_t n) {
+        uint64_t sum = 0;
+        for (uint32_t i = from; i < from + n; i++)
+            sum += hits[p * ways + i];
+        return sum;
+    };
+
+    for (uint32_t p = 0; p < PART_COUNT; p++)
+        quotas[p] = 1;
+    uint32_t left = total - PART_COUNT;
+    while (left) {
+        // the partition, and the number of extra ways, with the most hits per way
+        uint32_t best = 0, bestWays = 0;
+        double bestRate = 0.0;
+        for (uint32_t p = 0; p < PART_COUNT; p++) {
+            for (uint32_t n = 1; n <= left && quotas[p] + n <= ways; n++) {
+                double rate = static_cast<double>(gain(p, quotas[p], n)) / n;
+                if (rate > bestRate) {
+                    best = p;
+                    bestWays = n;
+                    bestRate = rate;
+                }
+            }
+        }
+        if (!bestWays) break;
+        quotas[best] += bestWays;
+        left -= bestWays;
+    }
+    // ways nobody would hit in are dealt round-robin
+    for (uint32_t p = 0; left; p = (p + 1) % PART_COUNT, left--)
+        quotas[p]++;
+
+    for (uint64_t& h : hits)
+        h /= 2;
+}
+
+const char* partition_name(CachePartition part) {
+    static const char* NAMES[] = {"code", "static", "heap", "stack"};
+    return NAMES[part];
+}
+
+MissClass MissClassifier::access(uint32_t block, bool miss) {
+    auto it = blocks.find(block);
+    bool seen = it != blocks.end();
+    bool shadowHit = seen && it->second != lru.end();
+
+    if (shadowHit) {
+        lru.splice(lru.begin(), lru, it->second);
+    } else {
+        lru.push_front(block);
+        if (seen)
+            it->second = lru.begin();
+        else
+            blocks.emplace(block, lru.begin());
+
+        if (lru.size() > capacity) {
+            blocks.find(lru.back())->second = lru.end();
+            lru.pop_back();
+        }
+    }
+
+    if (!miss) return MISS_NONE;
+    if (!seen) return MISS_COMPULSORY;
+    return shadowHit ? MISS_CONFLICT : MISS_CAPACITY;
+}
+
+bool write_cache_report(const char* filename,
+                        const CacheConfig& cfg,
+                        const CacheStats& stats,
+                        const std::vector<CacheStats>& setStats) {
+    static const char* POLICY_NAMES[] = {"lru", "fifo", "random"};
+
+    ofstream out(filename);
+    if (!out) return false;
+
+    uint64_t accesses = stats.hits + stats.misses;
+    const auto percent = [](uint64_t part, uint64_t whole) { return whole ? 100.0 * part / whole : 0.0; };
+
+    out << "Cache: " << cfg.blockSize << " byte blocks, " << cfg.lines << " lines, ";
+    if (cfg.ways)
+        out << cfg.ways << "-way";
+    else
+        out << "fully associative";
+    out << ", " << POLICY_NAMES[cfg.policy] << ", " << cfg.victims << " victim entries";
+    if (cfg.sectorSize && cfg.sectorSize < cfg.blockSize)
+        out << ", " << cfg.sectorSize << " byte sectors fetched " << cfg.sectorFill << " at a time";
+    out << "\n\n";
+
+    out << fixed << setprecision(2) << left;
+    out << setw(16) << "accesses" << accesses << '\n';
+    out << setw(16) << "hits" << stats.hits << '\n';
+    out << setw(16) << "misses" << stats.misses << "  (" << percent(stats.misses, accesses) << "%)\n";
+    const bool sectored = cfg.sectorSize && cfg.sectorSize < cfg.blockSize;
+    // a sector miss finds its block resident, so none of the three C's apply: it is the fourth bucket, and with it
+    // the classes add up to the misses
+    if (cfg.classify) {
+        out << setw(16) << "  compulsory" << stats.compulsory << "  (" << percent(stats.compulsory, stats.misses) << "% of misses)\n";
+        out << setw(16) << "  capacity" << stats.capacity << "  (" << percent(stats.capacity, stats.misses) << "% of misses)\n";
+        out << setw(16) << "  conflict" << stats.conflict << "  (" << percent(stats.conflict, stats.misses) << "% of misses)\n";
+    }
+    if (sectored)
+        out << setw(16) << "  sector" << stats.sectorMisses << "  (" << percent(stats.sectorMisses, stats.misses)
+            << "% of misses, block resident)\n";
+    out << setw(16) << "evictions" << stats.evictions << '\n';
+    out << setw(16) << "write-backs" << stats.writebacks << '\n';
+    if (cfg.victims) out << setw(16) << "victim hits" << stats.victimHits << '\n';
+    if (sectored) {
+        out << setw(16) << "sectors filled" << stats.sectorFills << '\n';
+        out << setw(16) << "  evicted" << stats.evictedValid << " of " << stats.evictedSectors << " filled, "
+            << stats.evictedUsed << " used (" << percent(stats.evictedUsed, stats.evictedSectors) << "%)\n";
+    }
+    if (stats.splits) {
+        out << setw(16) << "split words" << stats.splits << '\n';
+        out << setw(16) << "  batched fills" << stats.batchedFills << '\n';
+    }
+    if (cfg.mshrs) {
+        out << setw(16) << "MSHRs" << cfg.mshrs << '\n';
+        out << setw(16) << "  secondary" << stats.secondaryMisses << '\n';
+        out << setw(16) << "  full stalls" << stats.mshrStallCycles << " cycles\n";
+        out << setw(16) << "  MLP" << stats.mlp() << '\n';
+        out << setw(16) << "  saved" << static_cast<int64_t>(stats.blockingCycles - stats.cycles) << " of "
+            << stats.blockingCycles << " blocking cycles\n";
+    }
+
+    if (cfg.partition != PARTITION_NONE) {
+        out << "\nPer partition, ways " << (cfg.partition == PARTITION_FIXED ? "fixed" : "utility-based");
+        if (cfg.partition == PARTITION_UTILITY) out << " (" << stats.repartitions << " resizes)";
+        out << '\n' << right << setw(10) << "partition" << setw(12) << "hits" << setw(10) << "misses" << setw(13)
+            << "miss rate %" << '\n';
+        for (uint32_t p = 0; p < PART_COUNT; p++)
+            out << setw(10) << partition_name(static_cast<CachePartition>(p)) << setw(12) << stats.partHits[p]
+                << setw(10) << stats.partMisses[p] << setw(13)
+                << percent(stats.partMisses[p], stats.partHits[p] + stats.partMisses[p]) << '\n';
+        out << left;
+    }
+
+    std::vector<uint32_t> order;
+    for (uint32_t set = 0; set < setStats.size(); set++)
+        if (setStats[set].hits + setStats[set].misses) order.push_back(set);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return setStats[a].misses > setStats[b].misses;
+    });
+
+    out << "\nPer set, most misses first (" << order.size() << " of " << setStats.size() << " sets accessed)\n";
+    out << right << setw(6) << "set" << setw(12) << "accesses" << setw(10) << "misses" << setw(11) << "evictions"
+        << setw(13) << "% of misses";
+    if (cfg.classify) out << setw(12) << "compulsory" << setw(10) << "capacity" << setw(10) << "conflict";
+    if (sectored) out << setw(8) << "sector";
+    out << '\n';
+
+    for (uint32_t set : order) {
+        const CacheStats& st = setStats[set];
+        out << setw(6) << set << setw(12) << st.hits + st.misses << setw(10) << st.misses << setw(11) << st.evictions
+            << setw(13) << percent(st.misses, stats.misses);
+        if (cfg.classify) out << setw(12) << st.compulsory << setw(10) << st.capacity << setw(10) << st.conflict;
+        if (sectored) out << setw(8) << st.sectorMisses;
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
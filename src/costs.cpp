@@ -0,0 +1,87 @@
+#include "costs.h"
+/**
+ * @file costs.cpp
+ * @brief Cost model file
+ */
+
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+CostModel cost_model;
+
+// "ADD" rather than the padded "OP_ADD  " the stream operator prints
+static string mnemonic(uint32_t op) {
+    stringstream ss;
+    ss << static_cast<Opcode>(op);
+    string name = ss.str();
+    if (name.compare(0, 3, "OP_") == 0) name = name.substr(3);
+    name.erase(name.find_last_not_of(' ') + 1);
+    return name;
+}
+
+static string trim(const string& s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool load_cost_model(const char* filename, CostModel& model, string& error) {
+    ifstream in(filename);
+    if (!in) {
+        error = "cannot open file";
+        return false;
+    }
+
+    CostModel parsed = model;
+    string line;
+    for (int n = 1; getline(in, line); n++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        string key = trim(line.substr(0, eq));
+        string val = eq == string::npos ? "" : trim(line.substr(eq + 1));
+        if (val.empty() || val.size() > 9 || val.find_first_not_of("0123456789") != string::npos) {
+            error = "line " + to_string(n) + ": expected <key> = <cycles>";
+            return false;
+        }
+        uint32_t v = static_cast<uint32_t>(stoul(val));
+
+        if (key == "uncached_byte")
+            parsed.uncachedByte = v;
+        else if (key == "uncached_word")
+            parsed.uncachedWord = v;
+        else if (key == "uncached_fetch_word")
+            parsed.uncachedFetchWord = v;
+        else if (key == "hit")
+            parsed.hit = v;
+        else if (key == "fill_first_word")
+            parsed.fillFirstWord = v;
+        else if (key == "fill_next_word")
+            parsed.fillNextWord = v;
+        else if (key == "trap_io")
+            parsed.trapIo = v;
+        else if (key == "execute.*") {
+            for (uint32_t op = OP_JMP; op <= OP_RET; op++) parsed.execute[op] = v;
+        } else if (key.compare(0, 8, "execute.") == 0) {
+            uint32_t op = OP_JMP;
+            while (op <= OP_RET && mnemonic(op) != key.substr(8)) op++;
+            if (op > OP_RET) {
+                error = "line " + to_string(n) + ": unknown opcode " + key.substr(8);
+                return false;
+            }
+            parsed.execute[op] = v;
+        } else {
+            error = "line " + to_string(n) + ": unknown key " + key;
+            return false;
+        }
+    }
+
+    parsed.executeCosts = false;
+    for (uint32_t c : parsed.execute)
+        if (c) parsed.executeCosts = true;
+    model = parsed;
+    return true;
+}
@@ -0,0 +1,107 @@
+#include "dram.h"
+/**
+ * @file dram.cpp
+ * @brief DRAM banks, row buffers and page policy
+ */
+
+#include <sstream>
+
+#include "emu4380.h"
+
+using namespace std;
+
+DramModel dram;
+bool dram_enabled = false;
+
+constexpr uint32_t DramModel::NO_ROW;
+
+void DramModel::reset(const DramConfig& cfg) {
+    config = cfg;
+    stats = DramStats();
+    rowBits = 0;
+    while ((1u << rowBits) < cfg.rowSize)
+        rowBits++;
+    bankMask = cfg.banks - 1;
+    openRow.assign(cfg.banks, NO_ROW);
+}
+
+uint32_t DramModel::access(uint32_t address, uint32_t words, bool write) {
+    const uint32_t bank = (address >> rowBits) & bankMask;
+    const uint32_t row = (address >> rowBits) / config.banks;
+
+    uint32_t cycles = config.tCAS + config.burst * (words - 1);
+    uint32_t& open = openRow[bank];
+    if (open == row) {
+        stats.rowHits++;
+    } else if (open == NO_ROW) {
+        stats.rowMisses++;
+        cycles += config.tRCD;
+    } else {
+        stats.rowConflicts++;
+        cycles += config.tRP + config.tRCD;
+    }
+    open = config.policy == PAGE_OPEN ? row : NO_ROW;
+
+    (write ? stats.writes : stats.reads)++;
+    stats.cycles += cycles;
+    return cycles;
+}
+
+bool parseDramSpec(const string& spec, DramConfig& cfg) {
+    const auto isPow2 = [](uint32_t v) { return v != 0 && (v & (v - 1)) == 0; };
+
+    DramConfig parsed;
+    if (spec == "default") {
+        cfg = parsed;
+        return true;
+    }
+
+    stringstream in(spec);
+    string field;
+    while (getline(in, field, ',')) {
+        size_t eq = field.find('=');
+        if (eq == string::npos || eq + 1 == field.size()) return false;
+        string key = field.substr(0, eq);
+        string val = field.substr(eq + 1);
+
+        if (key == "page") {
+            if (val == "open")
+                parsed.policy = PAGE_OPEN;
+            else if (val == "closed")
+                parsed.policy = PAGE_CLOSED;
+            else
+                return false;
+            continue;
+        }
+
+        if (val.find_first_not_of("0123456789") != string::npos || val.size() > 9) return false;
+        uint32_t v = static_cast<uint32_t>(stoul(val));
+        if (key == "banks")
+            parsed.banks = v;
+        else if (key == "row")
+            parsed.rowSize = v;
+        else if (key == "trcd")
+            parsed.tRCD = v;
+        else if (key == "tcas")
+            parsed.tCAS = v;
+        else if (key == "trp")
+            parsed.tRP = v;
+        else if (key == "burst")
+            parsed.burst = v;
+        else
+            return false;
+    }
+    // a block never straddles two rows
+    if (!isPow2(parsed.banks) || !isPow2(parsed.rowSize) || parsed.rowSize < MAX_BLOCK_SIZE) return false;
+    cfg = parsed;
+    return true;
+}
+
+void dram_start(const DramConfig& cfg) {
+    dram.reset(cfg);
+    dram_enabled = true;
+}
+
+const char* page_policy_name(PagePolicy policy) {
+    return policy == PAGE_OPEN ? "open" : "closed";
+}
@@ -1,4 +1,23 @@
 #include "emu4380.h"
+
+#include <charconv>  // std::to_chars
+#include <chrono>
+
+#include "bpred.h"
+#include "cache.h"
+#include "costs.h"
+#include "dram.h"
+#include "inorder.h"
+#include "mmu.h"
+#include "interval.h"
+#include "ooo.h"
+#include "opstats.h"
+#include "regions.h"
+#include "roi.h"
+#include "sampling.h"
+#include "stackdist.h"
+#include "summary.h"
+#include "trace.h"
 /**
  * @file emu4380.cpp
  * @brief Core Emulator logic
@@ -14,6 +33,7 @@ constexpr size_t INSTR_SIZE = 8;
 // using constant syntax because it needs to be calculated at runtime, but still will act like a constant afterwards
 uint32_t SET_BITS;
 uint32_t TAG_BITS;
+uint32_t OFFSET_BITS = 4;  // log2(BLOCK_SIZE) until a cache is configured
 
 uint32_t OFFSET_MASK;
 uint32_t SET_MASK;
@@ -28,17 +48,34 @@ uint32_t data_regs[DATA_REG_SIZE] = {};
 uint32_t mem_size = 0;
 bool runBool = true;
 
-unsigned int mem_cycle_cntr = 0;
+uint64_t mem_cycle_cntr = 0;
 
 CacheType current_cache_type = NO_CACHE;
 bool cacheUsed;
 
 bool fetching_second = false;
+bool access_hooks = false;
+bool functional_mode = false;
+uint64_t instructions_retired = 0;
+uint64_t next_event = UINT64_MAX;
+StopReason stop_reason = STOP_NONE;
+TrapCode trap_code = TRAP_NONE;
+
+static RunLimits run_limits;
+static bool limits_enabled = false;
+static uint64_t limit_next = UINT64_MAX;   // instruction count of the next limit check
+static uint64_t output_left = UINT64_MAX;  // guest output bytes still allowed
+static chrono::steady_clock::time_point run_started;
 size_t associativity = -1;  // user provided, completely unused if not using a cache
 size_t num_sets = -1;       // set index is log2(#sets)
 // size_t num_tag_bits = -1;   // whatever's left
+uint32_t block_size = BLOCK_SIZE;
+uint32_t num_cache_lines = NUM_CACHE_LINES;
+
+ReplacementPolicy replacement_policy = POLICY_LRU;
 
-Line** cache = nullptr;
+Line** cache = nullptr;       // `cache_model.sets`, kept for the dump functions
+uint64_t cache_accesses = 0;  // stamps cache accesses for LRU/FIFO ordering
 
 uint64_t lineCounter = 0;
 uint64_t STARTPOINT = 0;
@@ -177,31 +214,88 @@ bool addr_in_range(uint32_t addr, size_t bytes = 1) {
     return addr + bytes <= mem_size;
 }
 
-void updateSP(uint32_t val) {
-    // proj 4 req 5
-    if (val > reg_file[SB] || val < reg_file[SL]) {
-        invalidInstruction();
-    } else {
-        reg_file[SP] = val;
+void set_functional_mode(bool on) {
+    if (on == functional_mode) return;
+    if (on && cacheUsed) {
+        if (cache_pipelined) sync_cache_pipeline();
+        cache_model.flush();
+    }
+    functional_mode = on;
+}
+
+// little endian word straight out of guest memory
+static inline uint32_t memWord(uint32_t address) {
+    return (prog_mem[address + 0]) |
+           (prog_mem[address + 1] << 8) |
+           (prog_mem[address + 2] << 16) |
+           (prog_mem[address + 3] << 24);
+}
+
+static inline void setMemWord(uint32_t address, uint32_t word) {
+    for (size_t i = 0; i < 4; i++) {
+        prog_mem[address + i] = static_cast<unsigned char>(((word) >> (i * 8)) & 0xFFu);
     }
 }
 
+// the same for a word split across two page frames, its first `head` bytes at `address` and the rest at `next`
+static uint32_t memWord(uint32_t address, uint32_t head, uint32_t next) {
+    if (!head) return memWord(address);
+    uint32_t word = 0;
+    for (uint32_t i = 0; i < 4; i++)
+        word |= static_cast<uint32_t>(prog_mem[i < head ? address + i : next + i - head]) << (8 * i);
+    return word;
+}
+
+static void setMemWord(uint32_t address, uint32_t word, uint32_t head, uint32_t next) {
+    if (!head) {
+        setMemWord(address, word);
+        return;
+    }
+    for (uint32_t i = 0; i < 4; i++)
+        prog_mem[i < head ? address + i : next + i - head] = static_cast<unsigned char>(word >> (8 * i));
+}
+
+bool updateSP(uint32_t val) noexcept {
+    // proj 4 req 5
+    if (val < reg_file[SL]) return raiseTrap(TRAP_STACK_OVERFLOW);
+    if (val > reg_file[SB]) return raiseTrap(TRAP_STACK_UNDERFLOW);
+    reg_file[SP] = val;
+    return true;
+}
+
 //---------------------------------------------------------
 
 //----------- MEMORY ACCESS FUNCTIONS -----------
 
-bool handleCacheHit(Line& line,
-                    uint32_t offset,
-                    AccessType accessType,
-                    uint32_t& outWord,
-                    unsigned char writeByte = 0,
-                    uint32_t writeWord = 0) {
-    // cout << "did we just die at the start?" << endl;
+// hands every guest memory access to whichever analyses are switched on. Only reached when `access_hooks` is set,
+// so runs without analyses pay a single branch per access.
+void noteAccess(uint32_t address, AccessType accessType, AccessClass cls) {
+    if (stackdist_enabled) stackdist.access(address, cls);
+    if (heatmap_enabled) {
+        HeatCounts* block = heatmap.at(address);
+        if (block) (accessType == READBYTE || accessType == READWORD ? block->reads : block->writes)++;
+    }
+    if (region_stats_enabled) {
+        current_region = regionOf(address);
+        RegionStats& r = region_stats[current_region];
+        (accessType == READBYTE || accessType == READWORD ? r.reads : r.writes)++;
+    }
+    if (trace_enabled) trace_record(address, accessType, cls, partitionOf(address, cls));
+}
 
-    if (!line.valid) return false;
-    if (associativity > 1) line.lastused = mem_cycle_cntr;
+// charges an access that bypasses the cache
+void chargeUncached(uint32_t cycles) {
+    mem_cycle_cntr += cycles;
+    if (region_stats_enabled) region_stats[current_region].cycles += cycles;
+}
 
-    mem_cycle_cntr++;
+// moves the requested byte or word between the register side and the line that now holds its block
+void accessLine(Line& line,
+                uint32_t offset,
+                AccessType accessType,
+                uint32_t& outWord,
+                unsigned char writeByte = 0,
+                uint32_t writeWord = 0) {
     switch (accessType) {
         case READBYTE:
             outWord = line.data[offset];
@@ -214,187 +308,185 @@ bool handleCacheHit(Line& line,
             break;
         case WRITEBYTE:
             line.data[offset] = writeByte;
-            line.dirty = true;
             break;
         case WRITEWORD:
             for (size_t i = 0; i < 4; i++) {
                 line.data[offset + i] = static_cast<uint8_t>((writeWord >> (8 * i)) & 0xFF);
             }
-            line.dirty = true;
             break;
     }
-    return true;
-}
-
-void handleCacheMiss(uint32_t address,
-                     uint32_t setidx,
-                     Line& line,
-                     uint32_t offset,
-                     AccessType accessType,
-                     uint32_t& outWord,
-                     unsigned char writeByte = 0,
-                     uint32_t writeWord = 0) {
-    // handy debug lines below
-    //  cout << "PC is at " << reg_file[PC] << endl;
-    // cout << "\t" << "address:" << address << "\n"
-    //      << "\t" << "setidx:" << setidx << "\n"
-    //      //"\t" <<<< "line:" << line << "\n"
-    //      << "\t" << "offset:" << offset << "\n"
-    //      << "\t" << "accessType:" << accessType << "\n"
-    //      << "\t" << "outWord:" << outWord << "\n"
-    //      << "\t" << "writeByte:" << writeByte << "\n"
-    //      << "\t" << "writeWord:" << writeWord << "\n";
-
-    std::cout << "MISS on 0x" << std::hex << address
-              << " → set " << std::dec << setidx << "\n";
-
-    constexpr int WORDS_PER_BLOCK = BLOCK_SIZE / 4;
-
-    // first 4-byte word is 8 cycles, then every cycle after that is 2 cycles.
-    const auto cyclesneeded = [](int words) { return 6 + 2 * words; };
-
-    if (line.valid && line.dirty) {
-        uint32_t writebackaddr = (line.tag << (SET_BITS + OFFSET_BITS)) | (setidx << OFFSET_BITS);
-        mem_cycle_cntr += cyclesneeded(WORDS_PER_BLOCK);
-
-        memcpy(&prog_mem[writebackaddr], line.data, BLOCK_SIZE);
-        line.dirty = false;
-    }
-
-    uint32_t base = address & ~(BLOCK_SIZE - 1);
-    mem_cycle_cntr += cyclesneeded(WORDS_PER_BLOCK);
-    memcpy(line.data, &prog_mem[base], BLOCK_SIZE);
-
-    line.tag = address >> (OFFSET_BITS + SET_BITS);
-    line.valid = true;
-    line.dirty = (accessType == WRITEBYTE || accessType == WRITEWORD);
-    line.lastused = mem_cycle_cntr;
-
-    handleCacheHit(line, offset, accessType, outWord, writeByte, writeWord);
 }
 
+// `head` and `next` are set for a word split across two page frames: its first `head` bytes are at `addr`, the rest
+// at `next`
 void checkCache(uint32_t addr,
                 AccessType accessType,
+                AccessClass cls,
                 uint32_t& outWord,
                 unsigned char writeByte = 0,
-                uint32_t writeWord = 0) {
-    uint32_t tagbits = addr >> (OFFSET_BITS + SET_BITS);
-    uint32_t offset = addr & OFFSET_MASK;
-    uint32_t setidx = (addr >> OFFSET_BITS) & SET_MASK;
-
-    size_t victim = 0;
-    bool foundempty = false;
-    uint64_t oldest = UINT64_MAX;
-
+                uint32_t writeWord = 0,
+                uint32_t head = 0,
+                uint32_t next = 0) {
     // dumpCacheVerbose(false, 0, true);
 
-    // ******CACHE HIT******
-    for (size_t way = 0; way < associativity; ++way) {
-        Line& current = cache[setidx][way];
-
-        if (current.valid && current.tag == tagbits) {
-            // cout << "Did we ever actually hit on anything? " << endl;
-
-            handleCacheHit(current, offset, accessType, outWord, writeByte, writeWord);
+    const CachePartition part = partitionOf(addr, cls);
+    CacheResult result = cache_model.checkCache(addr, accessType, ++cache_accesses, current_region, part);
+    mem_cycle_cntr += result.cycles;
+    if (!head) {
+        if (!cache_model.straddles(addr, accessType)) {
+            accessLine(*result.line, addr & OFFSET_MASK, accessType, outWord, writeByte, writeWord);
             return;
         }
+        head = cache_model.blockSize - (addr & OFFSET_MASK);
+        next = addr + head;
+    }
 
-        if (!current.valid && !foundempty) {
-            // cout << "was it inside the current.valid and found empty section? " << endl;
-            victim = way;
-            foundempty = true;
-
-        } else if (current.valid && current.lastused < oldest) {
-            // cout << "was it inside the current.valid and current.lastused < oldest section? " << endl;
-            oldest = current.lastused;
-            victim = way;
+    // the word runs into another block: its bytes move one line at a time, each before the next lookup can evict it
+    const auto move = [&](Line& line, uint32_t offset, uint32_t from, uint32_t to) {
+        for (uint32_t i = from; i < to; i++, offset++) {
+            if (accessType == WRITEWORD)
+                line.data[offset] = static_cast<uint8_t>((writeWord >> (8 * i)) & 0xFF);
+            else
+                outWord |= static_cast<uint32_t>(line.data[offset]) << (8 * i);
         }
-
-    }  // ******CACHE MISS******
-
-    handleCacheMiss(addr, setidx, cache[setidx][victim], offset, accessType, outWord, writeByte, writeWord);
+    };
+    if (accessType == READWORD) outWord = 0;
+    move(*result.line, addr & OFFSET_MASK, 0, head);
+    result = cache_model.checkSecondHalf(next, accessType, ++cache_accesses, current_region, part, next == addr + head);
+    mem_cycle_cntr += result.cycles;
+    move(*result.line, next & OFFSET_MASK, head, 4);
 }
 
-unsigned char readByte(uint32_t address) {
-    if (cacheUsed) {
+// reads the byte at a physical address, through the cache if there is one
+static unsigned char readPhysicalByte(uint32_t address, AccessClass cls) {
+    if (functional_mode) return prog_mem[address];
+    if (access_hooks) noteAccess(address, READBYTE, cls);
+
+    if (cacheUsed && !cache_pipelined) {
         uint32_t outbyte;
-        checkCache(address, READBYTE, outbyte);
+        checkCache(address, READBYTE, cls, outbyte);
         return static_cast<unsigned char>(outbyte);
 
     } else {
-        mem_cycle_cntr += 8;
-
-        if (!addr_in_range(address)) {
-            cerr << "Address was not in range for readByte. Returning a null character." << endl;
-            return 0;
-        }
+        // a pipelined cache only times the access, the data always comes from memory
+        if (cache_pipelined)
+            pipeline_access(address, READBYTE, current_region, partitionOf(address, cls));
+        else
+            chargeUncached(dram_enabled ? dram.access(address, 1, false) : cost_model.uncachedByte);
 
         return prog_mem[address];
     }
 }
 
-unsigned int readWord(uint32_t address) {
-    if (cacheUsed) {
-        uint32_t outword;
-        checkCache(address, READWORD, outword);
-        return outword;
+// writes the byte at a physical address, through the cache if there is one
+static void writePhysicalByte(uint32_t address, unsigned char byte) {
+    if (functional_mode) {
+        prog_mem[address] = byte;
+        return;
+    }
+    if (access_hooks) noteAccess(address, WRITEBYTE, CLASS_DATA);
 
+    if (cacheUsed && !cache_pipelined) {
+        uint32_t dummyvar = 0;
+        checkCache(address, WRITEBYTE, CLASS_DATA, dummyvar, byte);
     } else {
-        if (!fetching_second)
-            mem_cycle_cntr += 8;
+        if (cache_pipelined)
+            pipeline_access(address, WRITEBYTE, current_region, partitionOf(address, CLASS_DATA));
         else
-            mem_cycle_cntr += 2;
+            chargeUncached(dram_enabled ? dram.access(address, 1, true) : cost_model.uncachedByte);
 
-        if (!addr_in_range(address, 4)) {
-            cerr << "Address was not in range for readWord. Returning a garbage int of -1." << endl;
-            return UINT32_MAX;
-        }
+        prog_mem[address] = byte;
+    }
+}
 
-        uint32_t val = (prog_mem[address + 0]) |
-                       (prog_mem[address + 1] << 8) |
-                       (prog_mem[address + 2] << 16) |
-                       (prog_mem[address + 3] << 24);
+// translates a word access under `--mmu`; a word whose two pages sit in frames apart comes back with `head` set, its
+// first `head` bytes at `address` and the rest at `next`. It is still one word access, looked up in two halves like
+// a word that runs past its block
+static bool translateWord(uint32_t& address, bool write, uint32_t& next, uint32_t& head) {
+    head = 0;
+    if (!mmu.crossesPage(address, 4)) return mmu.translate(address, write);
+    return mmu.translateSplit(address, write, next, head);
+}
 
-        return static_cast<uint32_t>(val);
+unsigned char readByte(uint32_t address) noexcept {
+    if (!addr_in_range(address)) {
+        raiseTrap(TRAP_OUT_OF_BOUNDS);
+        return 0;
     }
+    if (mmu_enabled && !mmu.translate(address, false)) return 0;
+    return readPhysicalByte(address, CLASS_DATA);
 }
 
-void writeByte(uint32_t address, unsigned char byte) {
-    if (cacheUsed) {
-        uint32_t dummyvar = 0;
-        checkCache(address, WRITEBYTE, dummyvar, byte);
+unsigned int readWord(uint32_t address, AccessClass cls) noexcept {
+    if (!addr_in_range(address, 4)) {
+        raiseTrap(TRAP_OUT_OF_BOUNDS);
+        return UINT32_MAX;
+    }
+    uint32_t next = 0, head = 0;
+    if (mmu_enabled && !translateWord(address, false, next, head)) return UINT32_MAX;
+    if (functional_mode) return memWord(address, head, next);
+    if (access_hooks) noteAccess(address, READWORD, cls);
+
+    if (cacheUsed && !cache_pipelined) {
+        uint32_t outword;
+        checkCache(address, READWORD, cls, outword, 0, 0, head, next);
+        return outword;
+
     } else {
-        mem_cycle_cntr += 8;
-        if (!addr_in_range(address)) {
-            cout << "Address not in range" << endl;
-            // noop
-            return;
-        }
+        if (cache_pipelined)
+            pipeline_access(address, READWORD, current_region, partitionOf(address, cls), head, next);
+        else if (head)
+            // the second frame is a request of its own
+            chargeUncached(dram_enabled ? dram.access(address, 1, false) + dram.access(next, 1, false)
+                                        : cost_model.uncachedWord);
+        else if (dram_enabled)
+            // the immediate continues the burst the first word of the fetch opened
+            chargeUncached(fetching_second ? dram.configuration().burst : dram.access(address, 1, false));
+        else if (!fetching_second)
+            chargeUncached(cost_model.uncachedWord);
+        else
+            chargeUncached(cost_model.uncachedFetchWord);
 
-        prog_mem[address] = byte;
+        return memWord(address, head, next);
     }
 }
 
-void writeWord(uint32_t address, unsigned int word) {
-    if (cacheUsed) {
+void writeByte(uint32_t address, unsigned char byte) noexcept {
+    if (!addr_in_range(address)) {
+        raiseTrap(TRAP_OUT_OF_BOUNDS);
+        return;
+    }
+    if (mmu_enabled && !mmu.translate(address, true)) return;
+    writePhysicalByte(address, byte);
+}
+
+void writeWord(uint32_t address, unsigned int word) noexcept {
+    if (!addr_in_range(address, 4)) {
+        raiseTrap(TRAP_OUT_OF_BOUNDS);
+        return;
+    }
+    uint32_t next = 0, head = 0;
+    // both pages are checked before a byte moves
+    if (mmu_enabled && !translateWord(address, true, next, head)) return;
+    if (functional_mode) {
+        setMemWord(address, word, head, next);
+        return;
+    }
+    if (access_hooks) noteAccess(address, WRITEWORD, CLASS_DATA);
+
+    if (cacheUsed && !cache_pipelined) {
         uint32_t dummyvar = 0;
-        checkCache(address, WRITEWORD, dummyvar, 0, word);
+        checkCache(address, WRITEWORD, CLASS_DATA, dummyvar, 0, word, head, next);
 
     } else {
-        if (address + sizeof(word) > mem_size) {
-            cerr << "[writeWord] OUT OF BOUNDS: addr=" << address
-                 << " prog_mem_size=" << mem_size << "\n";
-            std::abort();
-        }
-        mem_cycle_cntr += 8;
-        if (!addr_in_range(address, 4)) {
-            // noop
-            return;
-        }
+        if (cache_pipelined)
+            pipeline_access(address, WRITEWORD, current_region, partitionOf(address, CLASS_DATA), head, next);
+        else if (dram_enabled)
+            chargeUncached(dram.access(address, 1, true) + (head ? dram.access(next, 1, true) : 0));
+        else
+            chargeUncached(cost_model.uncachedWord);
 
-        for (size_t i = 0; i < 4; i++) {
-            prog_mem[address + i] = static_cast<unsigned char>(((word) >> (i * 8)) & 0xFFu);
-        }
+        setMemWord(address, word, head, next);
     }
 }
 
@@ -425,6 +517,7 @@ uint32_t load_binary(const char* filename) {
     reg_file[PC] = entry;
     reg_file[HP] = reg_file[SL];
     STARTPOINT = entry;
+    trap_code = TRAP_NONE;
     return 0;
 }
 
@@ -453,6 +546,7 @@ bool init_mem(unsigned int size) {
         prog_mem = static_cast<unsigned char*>(new_block_of_memory);
     }
     mem_size = size;
+    if (cache_model.backing) cache_model.backing = prog_mem;  // lines write back into the moved memory
 
     if (!init_registers()) return false;  // couldn't initialize registers
 
@@ -462,6 +556,9 @@ bool init_mem(unsigned int size) {
     reg_file[FP] = reg_file[SP];
 
     mem_cycle_cntr = 0;
+    instructions_retired = 0;
+    trap_code = TRAP_NONE;
+    stack_low = reg_file[SP];
 
     return true;
 }
@@ -473,54 +570,76 @@ void init_cache(uint32_t cacheType) {
             cacheUsed = false;
             return;
         case DIRECT_MAPPED:
-            current_cache_type = DIRECT_MAPPED;
-            associativity = 1;
+            configure_cache(BLOCK_SIZE, NUM_CACHE_LINES, 1);
             break;
         case FULLY_ASSOCIATIVE:
-            current_cache_type = FULLY_ASSOCIATIVE;
-            associativity = NUM_CACHE_LINES;
+            configure_cache(BLOCK_SIZE, NUM_CACHE_LINES, NUM_CACHE_LINES);
             break;
         case TWO_WAY_SET_ASSOCIATIVE:
-            current_cache_type = TWO_WAY_SET_ASSOCIATIVE;
-            associativity = 2;
+            configure_cache(BLOCK_SIZE, NUM_CACHE_LINES, 2);
             break;
     }
-    cacheUsed = true;
-    num_sets = NUM_CACHE_LINES / associativity;
+}
 
-    SET_BITS = log2(num_sets);
-    TAG_BITS = 32u - OFFSET_BITS - SET_BITS;
-    OFFSET_MASK = (1u << OFFSET_BITS) - 1;
-    SET_MASK = (1u << SET_BITS) - 1;
+bool configure_cache(uint32_t blockSize, uint32_t lines, uint32_t ways, ReplacementPolicy policy) {
+    CacheConfig cfg;
+    cfg.blockSize = blockSize;
+    cfg.lines = lines;
+    cfg.ways = ways;
+    cfg.policy = policy;
+    return ways != 0 && configure_cache(cfg);
+}
 
-    cache = new Line*[num_sets];
+bool configure_cache(const CacheConfig& cfg) {
+    if (cache_pipelined) stop_cache_pipeline();
+    if (!cache_model.configure(cfg)) return false;
 
-    for (size_t s = 0; s < num_sets; ++s) {
-        cache[s] = new Line[associativity];
-    }
+    if (cache_model.ways == 1)
+        current_cache_type = DIRECT_MAPPED;
+    else if (cache_model.ways == cache_model.numLines)
+        current_cache_type = FULLY_ASSOCIATIVE;
+    else if (cache_model.ways == 2)
+        current_cache_type = TWO_WAY_SET_ASSOCIATIVE;
+    else
+        current_cache_type = SET_ASSOCIATIVE;
 
-    for (size_t s = 0; s < num_sets; ++s) {
-        for (size_t w = 0; w < associativity; ++w)
-            cache[s][w].badline();
-    }
+    cacheUsed = true;
+    cache_model.backing = prog_mem;
+    cache_model.regionStats = region_stats_enabled ? region_stats : nullptr;
+    cache_model.heat = heatmap_enabled ? &heatmap : nullptr;
+    cache_model.memory = dram_enabled ? &dram : nullptr;
+    cache = cache_model.sets;
+    cache_accesses = 0;
+
+    block_size = cache_model.blockSize;
+    num_cache_lines = cache_model.numLines;
+    associativity = cache_model.ways;
+    replacement_policy = cache_model.policy;
+    num_sets = cache_model.numSets;
+
+    OFFSET_BITS = cache_model.offsetBits;
+    SET_BITS = cache_model.setBits;
+    TAG_BITS = 32u - OFFSET_BITS - SET_BITS;
+    OFFSET_MASK = cache_model.offsetMask;
+    SET_MASK = cache_model.setMask;
+    return true;
 }
 
 // used for debugging problems with cache initialization
 void free_cache() {
-    if (!cache) return;
-    for (size_t s = 0; s < num_sets; s++)
-        delete[] cache[s];
-    delete[] cache;
+    if (cache_pipelined) stop_cache_pipeline();
+    cache_model.release();
     cache = nullptr;
 }
 //-------------------------------
 
 //----------- MAIN FETCH DECODE EXECUTE LOOP -----------56
 
-bool fetch() {
-    if (reg_file[PC] + INSTR_SIZE > mem_size) return false;  // about to run out of memory
+bool fetch() noexcept {
+    if (reg_file[PC] + INSTR_SIZE > mem_size) return raiseTrap(TRAP_OUT_OF_BOUNDS);  // about to run out of memory
 
-    uint32_t inter = readWord(reg_file[PC]);
+    const uint64_t faults = mmu.stats.faults;  // readWord can't fail, a fault only shows as another one counted
+    uint32_t inter = readWord(reg_file[PC], CLASS_IFETCH);
     cntrl_regs[OPERATION] = inter & 0xFF;  // unrolled
     cntrl_regs[OPERAND_1] = (inter >> 8) & 0xFF;
     cntrl_regs[OPERAND_2] = (inter >> 16) & 0xFF;
@@ -530,17 +649,18 @@ bool fetch() {
 
     reg_file[PC] += 4;
 
-    cntrl_regs[IMMEDIATE] = (readWord(reg_file[PC]));
+    cntrl_regs[IMMEDIATE] = readWord(reg_file[PC], CLASS_IFETCH);
     reg_file[PC] += 4;
 
     if (!cacheUsed) fetching_second = false;
     lineCounter = reg_file[PC] - STARTPOINT;
+    if (mmu_enabled && mmu.stats.faults != faults) return false;  // a page fault, the instruction never arrived
 
     // cout << "Opcode: " << static_cast<Opcode>(cntrl_regs[OPERATION]) << " oprnd 1: " << cntrl_regs[OPERAND_1] << " oprnd 2: " << cntrl_regs[OPERAND_2] << " oprnd 3: " << cntrl_regs[OPERAND_3] << " immediate: " << cntrl_regs[IMMEDIATE] << endl;
     return true;
 }
 
-bool decode() {
+bool decode() noexcept {
     // verifies that the specified operation (or TRP) and operands as specified cntrl_regs are valid
 
     // ex, MOV operates on state registers, and there are a limited number of these. A MOV with an RD value of 55 would be a
@@ -558,7 +678,7 @@ bool decode() {
             //  operand 2         DC
             //  operand 3         DC
             //  immediate value   Address
-            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return false;  // malformed instruction
+            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return raiseTrap(TRAP_OUT_OF_BOUNDS);  // malformed instruction
 
             return true;
         }
@@ -566,7 +686,7 @@ bool decode() {
         case OP_JMR: {
             const uint32_t rs = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rs)) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -575,8 +695,8 @@ bool decode() {
         case OP_BNZ: {
             const uint32_t rs = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rs)) return false;
-            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -585,8 +705,8 @@ bool decode() {
         case OP_BGT: {
             const uint32_t rs = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rs)) return false;
-            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -595,8 +715,8 @@ bool decode() {
         case OP_BLT: {
             const uint32_t rs = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rs)) return false;
-            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -605,8 +725,8 @@ bool decode() {
         case OP_BRZ: {
             const uint32_t rs = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rs)) return false;
-            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -620,8 +740,8 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rs = cntrl_regs[OPERAND_2];
 
-            if (!igr(rd)) return false;
-            if (!igr(rs)) return false;
+            if (!igr(rd)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!igr(rs)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -635,7 +755,7 @@ bool decode() {
 
             const uint32_t rd = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rd)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
 
             return true;
         }
@@ -647,8 +767,8 @@ bool decode() {
             // immediate value IMM
             const uint32_t rd = cntrl_regs[OPERAND_1];
 
-            if (!is_valid_rg(rd)) return false;
-            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_addr(cntrl_regs[IMMEDIATE])) return raiseTrap(TRAP_OUT_OF_BOUNDS);
             return true;
         }
 
@@ -659,7 +779,7 @@ bool decode() {
             // immediate value ADDRESS
             // store integer in RS at address
             const uint32_t rs = cntrl_regs[OPERAND_1];
-            if (!is_valid_rg(rs)) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
         }
@@ -671,7 +791,7 @@ bool decode() {
             // operand 3 DC
             // immediate value ADDRESS
             const uint32_t rd = cntrl_regs[OPERAND_1];
-            if (!is_valid_rg(rd)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
             return true;
         }
 
@@ -682,7 +802,7 @@ bool decode() {
             // operand 3 DC
             // immediate value ADDRESS
             const uint32_t rs = cntrl_regs[OPERAND_1];
-            if (!is_valid_rg(rs)) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs] & 0xFFu;  // least significant byte
             return true;
@@ -695,7 +815,7 @@ bool decode() {
             // operand 3 DC
             // immediate value ADDRESS
             const uint32_t rd = cntrl_regs[OPERAND_1];
-            if (!is_valid_rg(rd)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
 
             return true;
         }
@@ -704,8 +824,8 @@ bool decode() {
             const uint32_t rs = cntrl_regs[OPERAND_1];
             const uint32_t rg = cntrl_regs[OPERAND_2];
 
-            if (!is_valid_rg(rs)) return false;
-            if (!is_valid_rg(rg)) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rg)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             data_regs[REG_VAL_2] = reg_file[rg];
@@ -716,8 +836,8 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rg = cntrl_regs[OPERAND_2];
 
-            if (!is_valid_rg(rd)) return false;
-            if (!is_valid_rg(rg)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rg)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rg];
 
@@ -728,8 +848,8 @@ bool decode() {
             const uint32_t rs = cntrl_regs[OPERAND_1];
             const uint32_t rg = cntrl_regs[OPERAND_2];
 
-            if (!is_valid_rg(rs)) return false;
-            if (!is_valid_rg(rg)) return false;
+            if (!is_valid_rg(rs)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rg)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             data_regs[REG_VAL_2] = reg_file[rg];
@@ -740,8 +860,8 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rg = cntrl_regs[OPERAND_2];
 
-            if (!is_valid_rg(rd)) return false;
-            if (!is_valid_rg(rg)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rg)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rg];
 
@@ -758,7 +878,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -775,7 +895,7 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
 
-            if (!igr(rd) || !igr(rs1)) return false;
+            if (!igr(rd) || !igr(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
 
@@ -792,7 +912,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -804,7 +924,7 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
 
-            if (!igr(rd) || !igr(rs1)) return false;
+            if (!igr(rd) || !igr(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
 
@@ -816,7 +936,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -828,7 +948,7 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
 
-            if (!igr(rd) || !igr(rs1)) return false;
+            if (!igr(rd) || !igr(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
 
@@ -840,7 +960,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -853,7 +973,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -865,7 +985,7 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
 
-            if (!igr(rd) || !igr(rs1)) return false;
+            if (!igr(rd) || !igr(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
 
@@ -877,7 +997,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -890,7 +1010,7 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return false;
+            if (!igr(rd) || !igr(rs1) || !igr(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -903,9 +1023,9 @@ bool decode() {
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
             const uint32_t rs2 = cntrl_regs[OPERAND_3];
 
-            if (!is_valid_rg(rd)) return false;
-            if (!is_valid_rg(rs1)) return false;
-            if (!is_valid_rg(rs2)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rs2)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             data_regs[REG_VAL_2] = reg_file[rs2];
@@ -917,28 +1037,28 @@ bool decode() {
             const uint32_t rd = cntrl_regs[OPERAND_1];
             const uint32_t rs1 = cntrl_regs[OPERAND_2];
 
-            if (!is_valid_rg(rd)) return false;
-            if (!is_valid_rg(rs1)) return false;
+            if (!is_valid_rg(rd)) return raiseTrap(TRAP_BAD_REGISTER);
+            if (!is_valid_rg(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             return true;
         }
 
         case OP_TRP: {
-            // valid values are 0-4 unsigned ints, and 98
+            // valid values are 0-10 unsigned ints, and 98
             uint32_t imm = cntrl_regs[IMMEDIATE];
 
-            if (imm <= 6 || imm == 98)
+            if (imm <= TRP_PT_SET || imm == 98)
                 return true;
             else
-                return false;
+                return raiseTrap(TRAP_BAD_TRAP);
         }
 
         case OP_ALCI: {
             // opcode, rd, dc dc imm
             uint32_t rd = cntrl_regs[OPERAND_1];
 
-            if (!igr(rd)) return false;
+            if (!igr(rd)) return raiseTrap(TRAP_BAD_REGISTER);
 
             return true;
         }
@@ -946,7 +1066,7 @@ bool decode() {
         case OP_ALLC: {
             // opcode, rd, dc dc address
             uint32_t rd = cntrl_regs[OPERAND_1];
-            if (!igr(rd)) return false;
+            if (!igr(rd)) return raiseTrap(TRAP_BAD_REGISTER);
 
             return true;
         }
@@ -956,7 +1076,7 @@ bool decode() {
             uint32_t rd = cntrl_regs[OPERAND_1];
             uint32_t rs1 = cntrl_regs[OPERAND_2];
 
-            if (!igr(rd) || !igr(rs1)) return false;
+            if (!igr(rd) || !igr(rs1)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs1];
             return true;
@@ -966,7 +1086,7 @@ bool decode() {
             // opcode oprd1 oprd2 oprd3 imm
             // OP_PSHR rs    dc    dc    dc
             uint32_t rs = cntrl_regs[OPERAND_1];
-            if (!igr(rs)) return false;
+            if (!igr(rs)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -976,7 +1096,7 @@ bool decode() {
             // opcode oprd1 oprd2 oprd3 imm
             // OP_PSHB rs    dc    dc    dc
             uint32_t rs = cntrl_regs[OPERAND_1];
-            if (!igr(rs)) return false;
+            if (!igr(rs)) return raiseTrap(TRAP_BAD_REGISTER);
 
             data_regs[REG_VAL_1] = reg_file[rs];
             return true;
@@ -987,7 +1107,7 @@ bool decode() {
             // OP_POPR rd      dc    dc    dc
             uint32_t rd = cntrl_regs[OPERAND_1];
 
-            if (!igr(rd)) return false;
+            if (!igr(rd)) return raiseTrap(TRAP_BAD_REGISTER);
 
             return true;
         }
@@ -997,7 +1117,7 @@ bool decode() {
             // OP_POPB rd      dc    dc    dc
             uint32_t rd = cntrl_regs[OPERAND_1];
 
-            if (!igr(rd)) return false;
+            if (!igr(rd)) return raiseTrap(TRAP_BAD_REGISTER);
 
             return true;
         }
@@ -1015,14 +1135,17 @@ bool decode() {
         }
     }
 
-    return false;  // something went wrong, or a malformed instruction or SOMETHING happend. Return false, emulator errors instead of crashing.
+    return raiseTrap(TRAP_BAD_OPCODE);  // something went wrong, or a malformed instruction or SOMETHING happend. Return false, emulator errors instead of crashing.
 }
 
-bool execute() {
+bool execute() noexcept {
     // Executes the effects of decoded and validated instruction or TRP on the state members (regs, memory, etc.) as
     // indicated by cntrl_regs and data_regs, and in accordance with instruction or TRP's specification
 
     // returns FALSE if illegal operation is encountered (does not execute instruction), otherwise TRUE
+    if (cost_model.executeCosts && !functional_mode)
+        mem_cycle_cntr += cost_model.execute[cntrl_regs[OPERATION] & (COST_OPCODES - 1)];
+
     switch (cntrl_regs[OPERATION]) {
         case OP_JMP:
             return JMP();
@@ -1104,11 +1227,121 @@ bool execute() {
             return CALL();
         case OP_RET:
             return RET();
-        defaut:
-            return false;
     }
 
-    return false;  // catch in case something went horribly wrong
+    return raiseTrap(TRAP_BAD_OPCODE);
+}
+
+// next instruction count at which a limit has to be looked at
+static void scheduleLimits() {
+    limit_next = UINT64_MAX;
+    if (run_limits.cycles || run_limits.seconds > 0) limit_next = instructions_retired + LIMIT_POLL;
+    if (run_limits.instructions && run_limits.instructions < limit_next) limit_next = run_limits.instructions;
+}
+
+void set_run_limits(const RunLimits& limits) {
+    run_limits = limits;
+    if (limits.instructions) run_limits.instructions += instructions_retired;  // kept as an absolute count
+    stop_reason = STOP_NONE;
+    run_started = chrono::steady_clock::now();
+    output_left = limits.outputBytes ? limits.outputBytes : UINT64_MAX;
+
+    limits_enabled = limits.instructions || limits.cycles || limits.seconds > 0;
+    scheduleLimits();
+    if (limit_next < next_event) next_event = limit_next;
+}
+
+int stop_exit_code(StopReason reason) {
+    return reason == STOP_NONE ? 0 : 2 + reason;
+}
+
+const char* stop_reason_name(StopReason reason) {
+    static const char* NAMES[] = {"completed", "instruction_limit", "cycle_limit", "output_limit", "watchdog"};
+    return NAMES[reason];
+}
+
+static void stopGuest(StopReason reason) {
+    stop_reason = reason;
+    STOP();
+}
+
+// counts guest output against --max-output-bytes. FALSE, and the guest stopped, if `bytes` would cross it.
+static bool takeOutput(uint64_t bytes) {
+    if (bytes > output_left) {
+        stopGuest(STOP_OUTPUT);
+        return false;
+    }
+    output_left -= bytes;
+    return true;
+}
+
+static void checkLimits() {
+    if (run_limits.instructions && instructions_retired >= run_limits.instructions) stopGuest(STOP_INSTRUCTIONS);
+    if (runBool && run_limits.cycles) {
+        if (cache_pipelined) sync_cache_pipeline();  // the worker's cycles only reach the counter on a sync
+        if (mem_cycle_cntr >= run_limits.cycles) stopGuest(STOP_CYCLES);
+    }
+    if (runBool && run_limits.seconds > 0 &&
+        chrono::duration<double>(chrono::steady_clock::now() - run_started).count() >= run_limits.seconds)
+        stopGuest(STOP_WATCHDOG);
+    scheduleLimits();
+}
+
+// work done every so many instructions rather than on each one, so the loop only pays one compare
+static void runEvents() {
+    if (interval_enabled && instructions_retired >= interval_next) interval_record();
+    if (limits_enabled && instructions_retired >= limit_next) checkLimits();
+    if (sampling_enabled && instructions_retired >= sampling_next) sampling_event();
+
+    next_event = UINT64_MAX;
+    if (interval_enabled) next_event = interval_next;
+    if (limits_enabled && limit_next < next_event) next_event = limit_next;
+    if (sampling_enabled && sampling_next < next_event) next_event = sampling_next;
+}
+
+// hands the instruction that just retired to the branch predictors, which also run functionally, and then to the
+// timing models
+static void retireInstr(uint32_t fallthrough, uint64_t fetchCycles, uint64_t memCycles) {
+    RetiredInstr r = retired_instr(fallthrough, fetchCycles, memCycles);
+    if (bpred_enabled) bpred_retire(r);
+    if (functional_mode) return;
+    if (inorder_enabled) inorder.retire(r);
+    if (ooo_enabled) ooo_feed(r);
+}
+
+const char* trap_name(TrapCode code) {
+    static const char* NAMES[TRAP_COUNT] = {"none", "bad_opcode", "bad_register", "out_of_bounds",
+                                            "stack_overflow", "stack_underflow", "heap_exhausted",
+                                            "divide_by_zero", "bad_trap", "input", "page_fault"};
+    return code < TRAP_COUNT ? NAMES[code] : "unknown";
+}
+
+bool runLoop() {
+    bool completed = true;
+    trap_code = TRAP_NONE;  // a caller may have stepped the machine into a trap since it was loaded
+    while (runBool) {
+        const uint64_t startCycles = mem_cycle_cntr;
+        if (!fetch() || !decode()) {
+            completed = false;
+            break;
+        }
+        const uint32_t fallthrough = reg_file[PC];
+        const uint64_t fetchedCycles = mem_cycle_cntr;
+        // memory accessors can't fail the instruction themselves, so a trap from one only shows in `trap_code`
+        if (!execute() || trap_code != TRAP_NONE) {
+            completed = false;
+            break;
+        }
+#ifdef EMU_OPCODE_STATS
+        if (opstats_enabled) opstats.retire(cntrl_regs[OPERATION], cntrl_regs[IMMEDIATE], reg_file[PC] != fallthrough);
+#endif
+        if (bpred_enabled || ((inorder_enabled || ooo_enabled) && !functional_mode))
+            retireInstr(fallthrough, fetchedCycles - startCycles, mem_cycle_cntr - fetchedCycles);
+        if (reg_file[SP] < stack_low) stack_low = reg_file[SP];
+        if (++instructions_retired == next_event) runEvents();
+    }
+    if (cache_pipelined) sync_cache_pipeline();
+    return completed;
 }
 
 int runEmulator(int argc, char** argv) {
@@ -1210,11 +1443,9 @@ int runEmulator(int argc, char** argv) {
         return 2;
     }
 
-    while (runBool) {
-        if (!fetch() || !decode() || !execute()) {
-            invalidInstruction();
-            return 1;
-        }
+    if (!runLoop()) {
+        invalidInstruction();
+        return 1;
     }
 
     // dumpCacheSummary();
@@ -1224,412 +1455,283 @@ int runEmulator(int argc, char** argv) {
 //------------------ START OF EXECUTE HELPER FUNCTIONS ------------------
 
 // jump execution functions
-bool JMP() {
-    try {
-        reg_file[PC] = cntrl_regs[IMMEDIATE];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in JMP" << endl;
-        return false;
-    }
+bool JMP() noexcept {
+    reg_file[PC] = cntrl_regs[IMMEDIATE];
+    return true;
 }
 
-bool JMR() {
+bool JMR() noexcept {
     // update PC to value in RS
     //  operand 1 RS
     //  operand 2 DC
     //  operand 3 DC
     //  immediate DC
-    try {
-        reg_file[PC] = data_regs[REG_VAL_1];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in JMR" << endl;
-        return false;
-    }
+    reg_file[PC] = data_regs[REG_VAL_1];
+    return true;
 }
 
-bool BNZ() {
+bool BNZ() noexcept {
     // update PC to address if rs != 0
     // operand 1 RS
     // operand 2 DC
     // operand 3 DC
     // immediate ADDRESS
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr, 4)) return false;
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        if (data_regs[REG_VAL_1] != 0)
-            reg_file[PC] = addr;
+    if (data_regs[REG_VAL_1] != 0)
+        reg_file[PC] = addr;
 
-        return true;
-
-    } catch (const exception&) {
-        cerr << "Error in BNZ" << endl;
-        return false;
-    }
+    return true;
 }
 
-bool BGT() {
+bool BGT() noexcept {
     // operand 1 RS
     // operand 2 DC
     // operand 3 DC
     // immediate ADDRESS
 
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr, 4)) return false;
-
-        if (static_cast<int32_t>(data_regs[REG_VAL_1]) > 0)
-            reg_file[PC] = addr;
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        return true;
+    if (static_cast<int32_t>(data_regs[REG_VAL_1]) > 0)
+        reg_file[PC] = addr;
 
-    } catch (const exception&) {
-        cerr << "Error in BGT" << endl;
-        return false;
-    }
+    return true;
 }
 
-bool BLT() {
+bool BLT() noexcept {
     // operand 1 RS
     // operand 2 DC
     // operand 3 DC
     // immediate  ADDRESS
 
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr, 4)) return false;
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        if (static_cast<int32_t>(data_regs[REG_VAL_1]) < 0)
-            reg_file[PC] = addr;
+    if (static_cast<int32_t>(data_regs[REG_VAL_1]) < 0)
+        reg_file[PC] = addr;
 
-        return true;
-
-    } catch (const exception&) {
-        cerr << "Error in BLT" << endl;
-        return false;
-    }
+    return true;
 }
 
-bool BRZ() {
+bool BRZ() noexcept {
     // operand 1 RS
     // operand 2 DC
     // operand 3 DC
     // immediate ADDRESS
 
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr, 4)) return false;
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        if (static_cast<int32_t>(data_regs[REG_VAL_1]) == 0)
-            reg_file[PC] = addr;
+    if (static_cast<int32_t>(data_regs[REG_VAL_1]) == 0)
+        reg_file[PC] = addr;
 
-        return true;
-
-    } catch (const exception&) {
-        cerr << "Error in BRZ" << endl;
-        return false;
-    }
+    return true;
 }
 
 // move execution functions
-bool MOV() {
+bool MOV() noexcept {
     // operand 1 RD
     // operand 2 RS
     // operand 3 DC
     // immediate value DC
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in MOV" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1];
+    return true;
 }
 
-bool MOVI() {
+bool MOVI() noexcept {
     // operand 1 RD
     // operand 2 DC
     // operand 3 DC
     // immediate value IMM
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = cntrl_regs[IMMEDIATE];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in MOVI" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = cntrl_regs[IMMEDIATE];
+    return true;
 }
 
-bool LDA() {
+bool LDA() noexcept {
     // operand 1 RD
     // operand 2 DC
     // operand 3 DC
     // immediate value IMM
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = cntrl_regs[IMMEDIATE];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in LDA" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = cntrl_regs[IMMEDIATE];
+    return true;
 }
 
-bool STR() {
+bool STR() noexcept {
     // operand 1 RS
     // operand 2 DC
     // operand 3 DC
     // immediate value ADDRESS
-    try {
-        uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr, 4)) return false;
-
-        uint32_t val = data_regs[REG_VAL_1];
-        writeWord(addr, val);
+    uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        return true;
+    uint32_t val = data_regs[REG_VAL_1];
+    writeWord(addr, val);
 
-    } catch (const exception&) {
-        cerr << "Error in STR" << endl;
-        return false;
-    }
+    return true;
 }
 
-bool LDR() {
+bool LDR() noexcept {
     // operand 1 RD
     // operand 2 DC
     // operand 3 DC
     // immediate value ADDRESS
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr, 4)) return false;
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        reg_file[cntrl_regs[OPERAND_1]] = readWord(addr);
-        return true;
-
-    } catch (const exception&) {
-        cerr << "Error in LDR" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = readWord(addr);
+    return true;
 }
 
-bool STB() {
+bool STB() noexcept {
     // operand 1 RS
     // operand 2 DC
     // operand 3 DC
     // immediate value ADDRESS
     // store leasssssst ___|^~ (that's a snake) significant byte in RS at address
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr)) return false;
-
-        writeByte(addr, static_cast<unsigned char>(data_regs[REG_VAL_1]));
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in STB" << endl;
-        return false;
-    }
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
+
+    writeByte(addr, static_cast<unsigned char>(data_regs[REG_VAL_1]));
+    return true;
 }
 
-bool LDB() {
+bool LDB() noexcept {
     // operand 1 RD
     // operand 2 DC
     // operand 3 DC
     // immediate value ADDRESS
     // load byte at address to RD
-    try {
-        const uint32_t addr = cntrl_regs[IMMEDIATE];
-        if (!addr_in_range(addr)) return false;
-
-        reg_file[cntrl_regs[OPERAND_1]] = static_cast<uint32_t>(readByte(addr));
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in LDB" << endl;
-        return false;
-    }
+    const uint32_t addr = cntrl_regs[IMMEDIATE];
+    if (!addr_in_range(addr)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
+
+    reg_file[cntrl_regs[OPERAND_1]] = static_cast<uint32_t>(readByte(addr));
+    return true;
 }
 
-bool ISTR() {
+bool ISTR() noexcept {
     // Store integer in RS at address in RG
     //  operand 1 RS
     //  operand 2 RG
     //  operand 3 DC
     //  immediate DC
-    try {
-        uint32_t value = data_regs[REG_VAL_1];  // rs
-        uint32_t addr = data_regs[REG_VAL_2];   // rg
-
-        if (!addr_in_range(addr, 4)) return false;
+    uint32_t value = data_regs[REG_VAL_1];  // rs
+    uint32_t addr = data_regs[REG_VAL_2];   // rg
 
-        writeWord(addr, value);
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        return true;
+    writeWord(addr, value);
 
-    } catch (const exception&) {
-        cerr << "Error in ISTR" << endl;
-        return false;
-    }
-    return false;
+    return true;
 }
 
-bool ILDR() {
+bool ILDR() noexcept {
     // Load integer at address in RG into RD
     //   operand 1 RD
     //   operand 2 RG
     //   operand 3 DC
     //   immediate DC
 
-    try {
-        uint32_t addr = data_regs[REG_VAL_1];
-
-        if (!addr_in_range(addr, sizeof(uint32_t))) return false;
+    uint32_t addr = data_regs[REG_VAL_1];
 
-        uint32_t rd = cntrl_regs[OPERAND_1];
-        uint32_t val = readWord(addr);
+    if (!addr_in_range(addr, sizeof(uint32_t))) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        reg_file[rd] = val;
+    uint32_t rd = cntrl_regs[OPERAND_1];
+    uint32_t val = readWord(addr);
 
-        return true;
+    reg_file[rd] = val;
 
-    } catch (const exception&) {
-        cerr << "Error in ILDR" << endl;
-        return false;
-    }
-    return false;
+    return true;
 }
 
-bool ISTB() {
+bool ISTB() noexcept {
     // Store byte in RS at address in RG
     //  operand 1 RS
     //  operand 2 RG
     //  operand 3 DC
     //  immediate DC
 
-    try {
-        uint32_t val = data_regs[REG_VAL_1] & 0xFFu;
-        uint32_t addr = data_regs[REG_VAL_2];
-
-        if (!addr_in_range(addr, 4)) return false;
+    uint32_t val = data_regs[REG_VAL_1] & 0xFFu;
+    uint32_t addr = data_regs[REG_VAL_2];
 
-        writeByte(addr, static_cast<unsigned char>(val));
-        return true;
+    if (!addr_in_range(addr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-    } catch (const exception&) {
-        cerr << "Error in ISTB" << endl;
-        return false;
-    }
-    return false;
+    writeByte(addr, static_cast<unsigned char>(val));
+    return true;
 }
 
-bool ILDB() {
+bool ILDB() noexcept {
     // Load byte at address in RG into RD
     // operand 1 RD
     // operand 2 RG
     // operand 3 DC
     // immediate DC
-    try {
-        const uint32_t addr = data_regs[REG_VAL_1];
-        if (!addr_in_range(addr)) return false;
-        uint32_t rd = cntrl_regs[OPERAND_1];
-
-        reg_file[rd] = static_cast<uint8_t>(readByte(addr));
-        return true;
+    const uint32_t addr = data_regs[REG_VAL_1];
+    if (!addr_in_range(addr)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
+    uint32_t rd = cntrl_regs[OPERAND_1];
 
-    } catch (const exception&) {
-        cerr << "Error in ILDB" << endl;
-        return false;
-    }
-    return false;
+    reg_file[rd] = static_cast<uint8_t>(readByte(addr));
+    return true;
 }
 
 // arithmetic execution functions
-bool ADD() {
+bool ADD() noexcept {
     // add rs1 to rs2, store result in rd
     //  operand 1 RD
     //  operand 2 RS1
     //  operand 3 RS2
     //  immediate value DC
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] + data_regs[REG_VAL_2];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in ADD" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] + data_regs[REG_VAL_2];
+    return true;
 }
 
-bool ADDI() {
+bool ADDI() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 DC
     // immediate value IMM
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] + cntrl_regs[IMMEDIATE];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in ADDI" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] + cntrl_regs[IMMEDIATE];
+    return true;
 }
 
-bool SUB() {
+bool SUB() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 RS2
     // immediate value DC
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] - data_regs[REG_VAL_2];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in SUB" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] - data_regs[REG_VAL_2];
+    return true;
 }
 
-bool SUBI() {
+bool SUBI() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 DC
     // immediate value IMM
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] - cntrl_regs[IMMEDIATE];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in SUBI" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] - cntrl_regs[IMMEDIATE];
+    return true;
 }
 
-bool MUL() {
+bool MUL() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 RS2
     // immediate value DC
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] * data_regs[REG_VAL_2];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in MUL" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] * data_regs[REG_VAL_2];
+    return true;
 }
 
-bool MULI() {
+bool MULI() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 DC
     // immediate value IMM
-    try {
-        reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] * cntrl_regs[IMMEDIATE];
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in MULI" << endl;
-        return false;
-    }
+    reg_file[cntrl_regs[OPERAND_1]] = data_regs[REG_VAL_1] * cntrl_regs[IMMEDIATE];
+    return true;
 }
 
-bool DIV() {
+bool DIV() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 RS2
@@ -1637,13 +1739,13 @@ bool DIV() {
     uint32_t dividend = data_regs[REG_VAL_1];
     uint32_t divisor = data_regs[REG_VAL_2];
 
-    if (divisor == 0) return false;  // illegal, cannot divide by zero.
+    if (divisor == 0) return raiseTrap(TRAP_DIVIDE_BY_ZERO);  // illegal, cannot divide by zero.
 
     reg_file[cntrl_regs[OPERAND_1]] = dividend / divisor;  // unsigned division
     return true;
 }
 
-bool SDIV() {
+bool SDIV() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 RS2
@@ -1651,13 +1753,13 @@ bool SDIV() {
     int32_t dividend = static_cast<int32_t>(data_regs[REG_VAL_1]);
     int32_t divisor = static_cast<int32_t>(data_regs[REG_VAL_2]);
 
-    if (divisor == 0) return false;  // illegal, cannot divide by zero
+    if (divisor == 0) return raiseTrap(TRAP_DIVIDE_BY_ZERO);  // illegal, cannot divide by zero
 
     reg_file[cntrl_regs[OPERAND_1]] = static_cast<uint32_t>(dividend / divisor);  // signed divison
     return true;
 }
 
-bool DIVI() {
+bool DIVI() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 DC
@@ -1666,56 +1768,46 @@ bool DIVI() {
     int32_t dividend = static_cast<int32_t>(data_regs[REG_VAL_1]);
     int32_t divisor = static_cast<int32_t>(cntrl_regs[IMMEDIATE]);
 
-    if (divisor == 0) return false;  // illegal, cannot divide by zero
+    if (divisor == 0) return raiseTrap(TRAP_DIVIDE_BY_ZERO);  // illegal, cannot divide by zero
 
     reg_file[cntrl_regs[OPERAND_1]] = static_cast<uint32_t>(dividend / divisor);
 
     return true;
 }
 
-bool AND() {
+bool AND() noexcept {
     // operand 1 RD
     // operand 2 RS1
     // operand 3 RS2
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
+    uint32_t rd = cntrl_regs[OPERAND_1];
 
-        uint32_t rs1 = data_regs[REG_VAL_1];
-        uint32_t rs2 = data_regs[REG_VAL_2];
+    uint32_t rs1 = data_regs[REG_VAL_1];
+    uint32_t rs2 = data_regs[REG_VAL_2];
 
-        if (rs1 && rs2) {
-            reg_file[rd] = 1;
-        } else {
-            reg_file[rd] = 0;
-        }
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in AND" << endl;
-        return false;
+    if (rs1 && rs2) {
+        reg_file[rd] = 1;
+    } else {
+        reg_file[rd] = 0;
     }
+    return true;
 }
 
-bool OR() {
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
+bool OR() noexcept {
+    uint32_t rd = cntrl_regs[OPERAND_1];
 
-        uint32_t rs1 = data_regs[REG_VAL_1];
-        uint32_t rs2 = data_regs[REG_VAL_2];
+    uint32_t rs1 = data_regs[REG_VAL_1];
+    uint32_t rs2 = data_regs[REG_VAL_2];
 
-        if (rs1 || rs2) {
-            reg_file[rd] = 1;
-        } else {
-            reg_file[rd] = 0;
-        }
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in OR" << endl;
-        return false;
+    if (rs1 || rs2) {
+        reg_file[rd] = 1;
+    } else {
+        reg_file[rd] = 0;
     }
+    return true;
 }
 
 // compare execution functions
-bool CMP() {
+bool CMP() noexcept {
     // Performs a signed comparison between RS1 and RS2, and stores the result in RD
     // Set RD = 0 if RS1 == RS2 OR set RD = 1 if RS1 >RS2 OR set RD = -1 if RS1 < RS2
 
@@ -1724,28 +1816,21 @@ bool CMP() {
     //  operand 3 RS2
     //  immediate DC
     //  SIGNED COMPARISON
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
-        int32_t rs1 = static_cast<int32_t>(data_regs[REG_VAL_1]);
-        int32_t rs2 = static_cast<int32_t>(data_regs[REG_VAL_2]);
-
-        if (rs1 > rs2)
-            reg_file[rd] = 1;
-        else if (rs1 < rs2)
-            reg_file[rd] = static_cast<uint32_t>(-1);
-        else
-            reg_file[rd] = 0;
+    uint32_t rd = cntrl_regs[OPERAND_1];
+    int32_t rs1 = static_cast<int32_t>(data_regs[REG_VAL_1]);
+    int32_t rs2 = static_cast<int32_t>(data_regs[REG_VAL_2]);
 
-        return true;
+    if (rs1 > rs2)
+        reg_file[rd] = 1;
+    else if (rs1 < rs2)
+        reg_file[rd] = static_cast<uint32_t>(-1);
+    else
+        reg_file[rd] = 0;
 
-    } catch (const exception&) {
-        cerr << "Error in CMP" << endl;
-        return false;
-    }
-    return false;
+    return true;
 }
 
-bool CMPI() {
+bool CMPI() noexcept {
     // Performs a signed comparison between RS1 and IMM and stores the result in RD
     // Set RD = 0 if RS1 == IMM OR set RD = 1 if RS1 >IMM OR set RD = -1 if RS1 < IMM
 
@@ -1754,35 +1839,32 @@ bool CMPI() {
     //  operand 3 DC
     //  immediate IMM
     //  SIGNED COMPARISON
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
-        int32_t rs1 = static_cast<int32_t>(data_regs[REG_VAL_1]);
-        int32_t imm = cntrl_regs[IMMEDIATE];
-
-        if (rs1 > imm)
-            reg_file[rd] = 1;
-        else if (rs1 < imm)
-            reg_file[rd] = static_cast<uint32_t>(-1);
-        else
-            reg_file[rd] = 0;
+    uint32_t rd = cntrl_regs[OPERAND_1];
+    int32_t rs1 = static_cast<int32_t>(data_regs[REG_VAL_1]);
+    int32_t imm = cntrl_regs[IMMEDIATE];
 
-        return true;
+    if (rs1 > imm)
+        reg_file[rd] = 1;
+    else if (rs1 < imm)
+        reg_file[rd] = static_cast<uint32_t>(-1);
+    else
+        reg_file[rd] = 0;
 
-    } catch (const exception&) {
-        cerr << "Error in CMPI" << endl;
-        return false;
-    }
-    return false;
+    return true;
 }
 
 // trap/interrupt execution functions
-bool TRP() {
+bool TRP() noexcept {
     // IMM 1    -> WRITE INT IN R3 TO STDOUT (CONSOLE)
     //      print the above without any leading or trailing whitespace
     // IMM 2    -> READ AN INTEGER INTO R3 FROM STDIN
     // IMM 3    -> WRITE CHAR IN R3 TO STDOUT
     //      print the above without any leading or trailing whitespace
     // IMM 4    -> READ A CHAR INTO R3 FROM STDIN
+    // IMM 7    -> BEGIN THE REGION OF INTEREST
+    // IMM 8    -> END THE REGION OF INTEREST
+    // IMM 9    -> READ THE PAGE TABLE BASE INTO R3 (--mmu only)
+    // IMM 10   -> SET THE PAGE TABLE BASE FROM R3 AND FLUSH THE TLB (--mmu only)
     // IMM 98   -> PRINT ALL REGISTER CONTENTS TO STDOUT
     //      format above as follows:
     //          -one register name and value per line
@@ -1793,10 +1875,18 @@ bool TRP() {
     //              -R3 34
     //              -HP 10045
     uint32_t imm = cntrl_regs[IMMEDIATE];
+    if (imm >= 1 && imm <= 6 && !functional_mode) mem_cycle_cntr += cost_model.trapIo;
 
     switch (imm) {
         case 0: {
+            if (cache_pipelined) sync_cache_pipeline();
+            bool roiUsed = roi_active || roi_stats.regions;
+            roi_end();
             cout << "Execution completed. Total memory cycles: " << mem_cycle_cntr << endl;
+            if (roiUsed)
+                cout << "Region of interest: " << roi_stats.instructions << " instructions, memory cycles: "
+                     << roi_stats.cycles << ", cache hits: " << roi_stats.hits << ", misses: " << roi_stats.misses
+                     << endl;
             // dumpCacheSummary();
             // dumpRegisterContents();
             // dumpMemory(prog_mem, mem_size);
@@ -1805,125 +1895,117 @@ bool TRP() {
         }
         // write int in r3 to stdout (console)
         case 1: {
-            cout << static_cast<uint32_t>(reg_file[R3]) << flush;  // flush the buffer to make sure that it writes. cast to make sure that its an int going out
+            char digits[10];  // UINT32_MAX, formatted on the stack so the noexcept path doesn't allocate
+            const size_t length = to_chars(digits, digits + sizeof digits, reg_file[R3]).ptr - digits;
+            if (!takeOutput(length)) return true;
+            cout.write(digits, length) << flush;  // flush the buffer to make sure that it writes
             return true;
         }
         // read an integer into R3 from stdin
         case 2: {
             uint32_t inInt;
-            if (!(cin >> inInt)) return false;            // fails if it wasnt able to get anything from cin
+            if (!(cin >> inInt)) return raiseTrap(TRAP_INPUT);  // fails if it wasnt able to get anything from cin
             reg_file[R3] = static_cast<uint32_t>(inInt);  // casts to unsigned int
             return true;
         }
         // write char in R3 to stdout
         case 3: {
+            if (!takeOutput(1)) return true;
             cout << static_cast<char>(reg_file[R3]) << flush;  // cast to make sure a char gets out there, flush to make sure that buffer goes out
             return true;
         }
         // read a char into R3 from stdin
         case 4: {
             char inChar;
-            if (!(cin >> inChar)) return false;
+            if (!(cin >> inChar)) return raiseTrap(TRAP_INPUT);
             reg_file[R3] = static_cast<uint32_t>(inChar);
             return true;
         }
         // Write the full null-terminated pascal-style string whose starting address is in r3 to stdout
         case 5: {
-            try {
-                uint32_t addr = reg_file[R3];
-                uint8_t length = readByte(addr);
+            uint32_t addr = reg_file[R3];
+            uint8_t length = readByte(addr);
+            if (!takeOutput(length)) return true;
 
-                for (int i = 1; i <= length; i++) {
-                    char c = readByte(reg_file[R3] + i);
-                    cout << c;
-                }
-                cout << std::flush;
+            for (int i = 1; i <= length; i++) {
+                char c = readByte(reg_file[R3] + i);
+                cout << c;
+            }
+            cout << std::flush;
 
-                uint8_t terminator = readByte(addr + length + 1);
-                if (terminator != '\0') invalidInstruction();
+            uint8_t terminator = readByte(addr + length + 1);
+            if (terminator != '\0') return raiseTrap(TRAP_BAD_TRAP);  // not a pascal string
 
-                return true;
-            } catch (const exception&) {
-                cerr << "ERROR IN TRAP 5";
-                invalidInstruction();
-            }
+            return true;
         }
         // Read a newline terminated string from stdin and store it in memory as a null-terminated pascal-style string whose starting address is in R3.
         // Do not store the newline
         case 6: {
-            try {
-                uint32_t addr = reg_file[R3];
-                string ln;
-                if (!getline(cin, ln)) return false;
+            uint32_t addr = reg_file[R3];
+            string ln;
+            if (!getline(cin, ln)) return raiseTrap(TRAP_INPUT);
 
-                const size_t N = ln.size();
-                uint8_t stringbuild[N + 2];
+            // length byte, the characters, then the terminator, all of which must fit in guest memory
+            const size_t N = ln.size();
+            if (static_cast<uint64_t>(addr) + N + 2 > mem_size) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-                stringbuild[0] = static_cast<uint8_t>(N);
-
-                for (size_t i = 0; i < N; ++i) {
-                    stringbuild[i + 1] = static_cast<uint8_t>(ln[i]);
-                    // cout << stringbuild[i];
-                }
-                stringbuild[N + 1] = '\0';
+            writeByte(addr, static_cast<uint8_t>(N));
+            for (size_t i = 0; i < N; ++i)
+                writeByte(addr + 1 + i, static_cast<uint8_t>(ln[i]));
+            writeByte(addr + N + 1, '\0');
 
-                for (size_t i = 0; i < N + 2; ++i) {
-                    writeByte(addr + i, stringbuild[i]);
-                }
-
-                // cout << stringbuild << endl;
-
-                return true;
-            } catch (const exception&) {
-                cout << "ERROR IN TRP 6";
-                return false;
-            }
+            return true;
+        }
+        case TRP_ROI_BEGIN: {
+            roi_begin();
+            return true;
+        }
+        case TRP_ROI_END: {
+            roi_end();
+            return true;
+        }
+        case TRP_PT_GET: {
+            if (!mmu_enabled) return raiseTrap(TRAP_BAD_TRAP);
+            reg_file[R3] = mmu.tableBase;
+            return true;
+        }
+        case TRP_PT_SET: {
+            if (!mmu_enabled) return raiseTrap(TRAP_BAD_TRAP);
+            return mmu_set_table(reg_file[R3]);
         }
         case 98: {
-            try {
-                dumpRegisterContents();
-                return true;
-            } catch (const exception&) {
-                cout << "ERROR IN TRP 98:" << endl;
-                return false;
-            }
-            return false;
+            dumpRegisterContents();
+            return true;
         }
         default: {
-            return false;  // in case something went horribly wrong, say it went wrong
+            return raiseTrap(TRAP_BAD_TRAP);
         }
     }
 
     // IMM 0    -> EXECUTE STOP / EXIT ROUTINE
 }
 
-bool ALCI() {
+bool ALCI() noexcept {
     // Allocate imm bytes of space on the heap and increment HP accordingly. The imm value is a 4-byte unsigned integer. Store the
     // initial heap pointer in RD
 
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
-        uint32_t nBytes = cntrl_regs[IMMEDIATE];
-
-        uint32_t oldHP = reg_file[HP];
-        uint64_t newHP = uint64_t(oldHP) + nBytes;
+    uint32_t rd = cntrl_regs[OPERAND_1];
+    uint32_t nBytes = cntrl_regs[IMMEDIATE];
 
-        if (newHP > reg_file[SP] || newHP > mem_size) {
-            return false;
-        }
+    uint32_t oldHP = reg_file[HP];
+    uint64_t newHP = uint64_t(oldHP) + nBytes;
 
-        reg_file[rd] = oldHP;
-        reg_file[HP] = uint32_t(newHP);
+    if (newHP > reg_file[SP] || newHP > mem_size) {
+        return raiseTrap(TRAP_HEAP_EXHAUSTED);
+    }
 
-        return true;
+    reg_file[rd] = oldHP;
+    reg_file[HP] = uint32_t(newHP);
 
-    } catch (const exception&) {
-        cerr << "Error in ALCI" << endl;
-        return false;
-    }
+    return true;
 }
 
-bool ALLC() {
+bool ALLC() noexcept {
     // allocate a number of bytes on the heap according to the value of the 4-byte unsigned integer stored at Address (and increment hp accordingly).
 
     // store the initial heap pointer in RD.
@@ -1932,13 +2014,13 @@ bool ALLC() {
     uint32_t reg_dest = cntrl_regs[OPERAND_1];
     uint32_t nBytesAddr = cntrl_regs[IMMEDIATE];
 
-    if (nBytesAddr + 3 > mem_size) return false;
+    if (!addr_in_range(nBytesAddr, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
     uint32_t bytesToAllocate = readWord(nBytesAddr);
 
-    uint64_t newHP = reg_file[HP] + bytesToAllocate;
+    uint64_t newHP = uint64_t(reg_file[HP]) + bytesToAllocate;  // widened first, so a huge size can't wrap
 
     if (newHP > reg_file[SP] || newHP > mem_size) {
-        return false;
+        return raiseTrap(TRAP_HEAP_EXHAUSTED);
     }
 
     reg_file[reg_dest] = reg_file[HP];
@@ -1947,7 +2029,7 @@ bool ALLC() {
     return true;
 }
 
-bool IALLC() {
+bool IALLC() noexcept {
     // indirectly allocate a number of bytes on the heap according to the value of the 4-byte unsigned int at the memory address stored in RS1
     //  and increment HP accordingly. Store the initial heap pointer in RD.
 
@@ -1956,13 +2038,13 @@ bool IALLC() {
     uint32_t rd = cntrl_regs[OPERAND_1];
     uint32_t sizeAddress = data_regs[REG_VAL_1];
 
-    if (!addr_in_range(sizeAddress, 4)) return false;
+    if (!addr_in_range(sizeAddress, 4)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
     uint32_t bytesToAllocate = readWord(sizeAddress);
-    uint64_t newHP = reg_file[HP] + bytesToAllocate;
+    uint64_t newHP = uint64_t(reg_file[HP]) + bytesToAllocate;  // widened first, so a huge size can't wrap
 
     if (newHP > reg_file[SP] || newHP > mem_size) {
-        return false;
+        return raiseTrap(TRAP_HEAP_EXHAUSTED);
     }
 
     reg_file[rd] = reg_file[HP];
@@ -1971,159 +2053,107 @@ bool IALLC() {
     return true;
 }
 
-bool PSHR() {
+bool PSHR() noexcept {
     // set sp = sp - 4, place the word in RS onto the stack.ˇ
-    try {
-        uint32_t val = data_regs[REG_VAL_1];
-        uint32_t newsp = reg_file[SP] - 4;
-
-        updateSP(newsp);
+    uint32_t val = data_regs[REG_VAL_1];
+    uint32_t newsp = reg_file[SP] - 4;
 
-        writeWord(newsp, val);
-        return true;
+    if (!updateSP(newsp)) return false;
 
-    } catch (const exception&) {
-        cerr << "Error in PSHR" << endl;
-        return false;
-    }
-
-    return false;
+    writeWord(newsp, val);
+    return true;
 }
 
-bool PSHB() {
+bool PSHB() noexcept {
     // set sp = sp - 1, place the least significant byte in RS onto the stack.
-    try {
-        uint32_t val = data_regs[REG_VAL_1];
-        uint8_t byteval = static_cast<uint8_t>(val & 0xFF);
-        uint32_t newsp = reg_file[SP] - 1;
-
-        updateSP(newsp);
+    uint32_t val = data_regs[REG_VAL_1];
+    uint8_t byteval = static_cast<uint8_t>(val & 0xFF);
+    uint32_t newsp = reg_file[SP] - 1;
 
-        writeByte(newsp, byteval);
-        return true;
+    if (!updateSP(newsp)) return false;
 
-    } catch (const exception&) {
-        cerr << "Error in PSHB" << endl;
-        return false;
-    }
-
-    return false;  // in case something went horribly wrong
+    writeByte(newsp, byteval);
+    return true;
 }
 
-bool POPR() {
+bool POPR() noexcept {
     // place the word on top of the stack into RD, update SP = SP + 4
 
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
-        uint32_t sp = reg_file[SP];
-
-        reg_file[rd] = readWord(sp);
-
-        updateSP(sp + 4);
-        return true;
+    uint32_t rd = cntrl_regs[OPERAND_1];
+    uint32_t sp = reg_file[SP];
+    if (sp + 4 > reg_file[SB]) return raiseTrap(TRAP_STACK_UNDERFLOW);
 
-    } catch (const exception&) {
-        cerr << "Error in POPR" << endl;
-        return false;
-    }
+    reg_file[rd] = readWord(sp);
 
-    return false;
+    reg_file[SP] = sp + 4;
+    return true;
 }
 
-bool POPB() {
+bool POPB() noexcept {
     // Place the byte on top of the stack into RD, update SP = sp + 1
-    try {
-        uint32_t rd = cntrl_regs[OPERAND_1];
-        uint32_t sp = reg_file[SP];
+    uint32_t rd = cntrl_regs[OPERAND_1];
+    uint32_t sp = reg_file[SP];
+    if (sp + 1 > reg_file[SB]) return raiseTrap(TRAP_STACK_UNDERFLOW);
 
-        reg_file[rd] = readByte(sp);
-        updateSP(sp + 1);
+    reg_file[rd] = readByte(sp);
+    reg_file[SP] = sp + 1;
 
-        return true;
-    } catch (const exception&) {
-        cerr << "Error in POPB" << endl;
-    }
-
-    return false;
+    return true;
 }
 
-bool CALL() {
+bool CALL() noexcept {
     // Push PC onto stack, update PC to address
-    try {
-        uint32_t returnPC = reg_file[PC];
+    uint32_t returnPC = reg_file[PC];
 
-        uint32_t newSP = reg_file[SP] - sizeof(uint32_t);
+    uint32_t newSP = reg_file[SP] - sizeof(uint32_t);
 
-        if (newSP < reg_file[SL] || newSP + sizeof(uint32_t) > reg_file[SB]) {
-            invalidInstruction();
-            return false;
-        }
+    if (newSP < reg_file[SL] || newSP + sizeof(uint32_t) > reg_file[SB]) return raiseTrap(TRAP_STACK_OVERFLOW);
 
-        writeWord(newSP, returnPC);
-        reg_file[SP] = newSP;
+    reg_file[SP] = newSP;  // move SP first so the return address is written inside the stack
+    writeWord(newSP, returnPC);
 
-        uint32_t target = cntrl_regs[IMMEDIATE];
+    uint32_t target = cntrl_regs[IMMEDIATE];
 
-        if (!is_valid_addr(target)) {
-            invalidInstruction();
-            return false;
-        }
+    if (!is_valid_addr(target)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        reg_file[PC] = target;
-        return true;
-
-        // uint32_t retAddr = reg_file[PC];
-        // uint32_t newSP = reg_file[SP] - 4;
-        // updateSP(newSP);
-        //
-        // writeWord(newSP, retAddr);
-        //
-        // uint32_t targetJmp = cntrl_regs[IMMEDIATE];
-        //
-        // if (!is_valid_addr(targetJmp)) return false;
-        //
-        // reg_file[PC] = targetJmp;
-        //
-        // return true;
-
-    } catch (const exception&) {
-        cerr << "Error in CALL" << endl;
-        return false;
-    }
-}
+    reg_file[PC] = target;
+    return true;
 
-bool RET() {
+    // uint32_t retAddr = reg_file[PC];
+    // uint32_t newSP = reg_file[SP] - 4;
+    // updateSP(newSP);
+    //
+    // writeWord(newSP, retAddr);
+    //
+    // uint32_t targetJmp = cntrl_regs[IMMEDIATE];
+    //
+    // if (!is_valid_addr(targetJmp)) return false;
+    //
+    // reg_file[PC] = targetJmp;
+    //
+    // return true;
+}
+
+bool RET() noexcept {
     // pop stack into PC
-    try {
-        uint32_t sp0 = reg_file[SP];
-        uint32_t returnPC = readWord(sp0);
+    uint32_t sp0 = reg_file[SP];
+    uint32_t newSP = sp0 + sizeof(uint32_t);
 
-        uint32_t newSP = sp0 + sizeof(uint32_t);
+    if (newSP > reg_file[SB] || sp0 < reg_file[SL]) return raiseTrap(TRAP_STACK_UNDERFLOW);
 
-        if (newSP > reg_file[SB] || sp0 < reg_file[SL]) {
-            invalidInstruction();
-            return false;
-        }
+    uint32_t returnPC = readWord(sp0);
 
-        reg_file[SP] = newSP;
+    reg_file[SP] = newSP;
 
-        if (!is_valid_addr(returnPC)) {
-            invalidInstruction();
-            return false;
-        }
+    if (!is_valid_addr(returnPC)) return raiseTrap(TRAP_OUT_OF_BOUNDS);
 
-        reg_file[PC] = returnPC;
-        return true;
-        // uint32_t sp = reg_file[SP];
-        //
-        // reg_file[PC] = readWord(sp);
-        // updateSP(sp + 4);
-        //  return true;
-
-    } catch (const exception&) {
-        cerr << "Error in RET" << endl;
-        return false;
-    }
+    reg_file[PC] = returnPC;
+    return true;
+    // uint32_t sp = reg_file[SP];
+    //
+    // reg_file[PC] = readWord(sp);
+    // updateSP(sp + 4);
+    //  return true;
 }
 
 void STOP() {
@@ -2190,7 +2220,7 @@ void dumpCacheVerbose(bool showEmpty = false,
     cout << "\n================ Complete cache dump ================\n";
     cout << "  Sets   : " << num_sets << '\n';
     cout << "  Ways   : " << associativity << '\n';
-    cout << "  BlkSz  : " << BLOCK_SIZE << " bytes\n";
+    cout << "  BlkSz  : " << block_size << " bytes\n";
     cout << "-----------------------------------------------------\n\n";
 
     size_t setsShown = 0;
@@ -2219,7 +2249,7 @@ void dumpCacheVerbose(bool showEmpty = false,
                  << "  LRU:" << line.lastused
                  << '\n';
 
-            dumpBlock(line.data, BLOCK_SIZE, showOffsets);
+            dumpBlock(line.data, block_size, showOffsets);
         }
         cout << '\n';
 
@@ -2249,17 +2279,21 @@ void dumpCacheSummary() {
         case TWO_WAY_SET_ASSOCIATIVE:
             typeStr = "2-way set associative";
             break;
+        case SET_ASSOCIATIVE:
+            typeStr = "Set associative";
+            break;
     }
     // dumpCacheVerbose(true, 99);
     size_t lineSize = sizeof(Line);                  // bytes / line object
-    size_t cacheBytes = NUM_CACHE_LINES * lineSize;  // total capacity
+    size_t cacheBytes = num_cache_lines * lineSize;  // total capacity
 
     cout << "\n=========== Cache summary ===========\n";
     cout << left << setw(22) << "Cache type:" << typeStr << '\n';
-    cout << setw(22) << "Block size:" << BLOCK_SIZE << "  bytes\n";
-    cout << setw(22) << "# cache lines:" << NUM_CACHE_LINES << '\n';
+    cout << setw(22) << "Block size:" << block_size << "  bytes\n";
+    cout << setw(22) << "# cache lines:" << num_cache_lines << '\n';
     cout << setw(22) << "Associativity:" << associativity << ((associativity == 1) ? " (direct-mapped)" : "") << '\n';
     cout << setw(22) << "# sets:" << num_sets << '\n';
+    cout << setw(22) << "Victim cache:" << cache_model.victims.size() << "  entries\n";
     cout << setw(22) << "Line object size:" << lineSize << "  bytes\n";
     cout << setw(22) << "Total cache size:" << cacheBytes << "  bytes\n";
     cout << "======================================\n";
@@ -2273,6 +2307,4 @@ void invalidInstruction() {
     // dumpCacheVerbose();
     //  dumpMemory(prog_mem, mem_size);
     cout << "INVALID INSTRUCTION AT LINE: " << line_num << endl;
-
-    exit(1);
 }
@@ -0,0 +1,65 @@
+#include "heatmap.h"
+/**
+ * @file heatmap.cpp
+ * @brief Memory access heat map collection and file format
+ */
+
+#include <cstdio>
+#include <cstring>
+
+HeatMap heatmap;
+bool heatmap_enabled = false;
+
+bool HeatMap::init(uint32_t size, uint32_t memBytes) {
+    if (size == 0 || (size & (size - 1)) != 0) return false;
+
+    blockSize = size;
+    shift = 0;
+    while ((1u << shift) < size) shift++;
+
+    memSize = memBytes;
+    blocks = (static_cast<uint64_t>(memBytes) + size - 1) >> shift;
+
+    pages.clear();
+    pages.resize((blocks + PAGE_MASK) >> PAGE_SHIFT);
+    return true;
+}
+
+bool HeatMap::write(const char* filename) const {
+    std::vector<HeatRecord> records;
+    for (size_t p = 0; p < pages.size(); p++) {
+        if (!pages[p]) continue;
+        for (uint32_t i = 0; i <= PAGE_MASK; i++) {
+            const HeatCounts& c = pages[p][i];
+            if (c.reads || c.writes || c.misses) records.push_back({static_cast<uint32_t>((p << PAGE_SHIFT) | i), c});
+        }
+    }
+
+    FILE* out = fopen(filename, "wb");
+    if (!out) return false;
+
+    HeatmapHeader header;
+    memcpy(header.magic, HEATMAP_MAGIC, sizeof(header.magic));
+    header.version = HEATMAP_VERSION;
+    header.blockSize = blockSize;
+    header.memSize = memSize;
+    header.records = static_cast<uint32_t>(records.size());
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(records.data(), sizeof(HeatRecord), records.size(), out) == records.size();
+    return fclose(out) == 0 && ok;
+}
+
+bool read_heatmap(const char* filename, HeatmapHeader& header, std::vector<HeatRecord>& records) {
+    FILE* in = fopen(filename, "rb");
+    if (!in) return false;
+
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 &&
+              memcmp(header.magic, HEATMAP_MAGIC, sizeof(header.magic)) == 0 && header.version == HEATMAP_VERSION;
+    if (ok) {
+        records.resize(header.records);
+        ok = fread(records.data(), sizeof(HeatRecord), records.size(), in) == records.size();
+    }
+    fclose(in);
+    return ok;
+}
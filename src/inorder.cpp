@@ -0,0 +1,105 @@
+#include "inorder.h"
+/**
+ * @file inorder.cpp
+ * @brief Five stage in-order pipeline timing
+ */
+
+#include <algorithm>
+
+using namespace std;
+
+InOrderModel inorder;
+bool inorder_enabled = false;
+
+void inorder_start(const PipelineConfig& cfg) {
+    inorder.reset(cfg);
+    inorder_enabled = true;
+}
+
+const char* stall_cause_name(StallCause cause) {
+    static const char* NAMES[STALL_COUNT] = {"raw", "load_use", "branch", "fetch", "memory", "execute", "other"};
+    return cause < STALL_COUNT ? NAMES[cause] : "unknown";
+}
+
+void InOrderModel::reset(const PipelineConfig& cfg) {
+    *this = InOrderModel();
+    config = cfg;
+}
+
+void charge_stalls(uint64_t stalls[STALL_COUNT], const uint64_t delay[STALL_COUNT], uint64_t bubbles) {
+    for (StallCause c : {STALL_MEMORY, STALL_EXECUTE, STALL_LOAD_USE, STALL_RAW, STALL_FETCH, STALL_BRANCH}) {
+        uint64_t charged = min(bubbles, delay[c]);
+        stalls[c] += charged;
+        bubbles -= charged;
+    }
+    // an instruction should only fall behind the one ahead through its own delays; if the model ever drifts from
+    // that, the rest still shows in the breakdown rather than vanishing from it
+    stalls[STALL_OTHER] += bubbles;
+}
+
+void InOrderModel::retire(const RetiredInstr& r) {
+    uint64_t delay[STALL_COUNT] = {};
+
+    // IF: free once the previous instruction moved on to ID, and on the right path
+    uint64_t ifStart = max(lastId, fetchReady);
+    delay[STALL_BRANCH] = ifStart - lastId;
+    delay[STALL_FETCH] = beyondHits(r.fetchCycles, 2, config.hitCycles);
+    uint64_t idStart = max(ifStart + 1 + delay[STALL_FETCH], lastEx);
+
+    // operands: read in ID after write-back, or caught on a bypass at the start of EX
+    uint64_t operands = 0;
+    bool loadOperand = false;
+    for (uint8_t s : r.src) {
+        if (s >= TIMED_REGS || ready[s] <= operands) continue;
+        operands = ready[s];
+        loadOperand = fromLoad[s];
+    }
+    StallCause operandCause = loadOperand ? STALL_LOAD_USE : STALL_RAW;
+
+    if (!config.forwarding && operands > idStart) {
+        delay[operandCause] = operands - idStart;
+        idStart = operands;
+    }
+    uint64_t exStart = max(idStart + 1, lastMem);
+    if (config.forwarding && operands > exStart) {
+        delay[operandCause] = operands - exStart;
+        exStart = operands;
+    }
+
+    delay[STALL_EXECUTE] = r.exCycles;
+    const uint64_t exDone = exStart + 1 + r.exCycles;
+    delay[STALL_MEMORY] = beyondHits(r.memCycles, r.memAccesses, config.hitCycles);
+    uint64_t memStart = max(exDone, lastWb);
+    uint64_t wbStart = max(memStart + 1 + delay[STALL_MEMORY], lastWb + 1);
+
+    // results: ALU ones leave EX, loaded ones leave MEM
+    for (uint8_t d : r.dst) {
+        if (d >= TIMED_REGS) continue;
+        bool loaded = (r.flags & RETIRE_LOAD) && d != SP;
+        ready[d] = !config.forwarding || loaded ? wbStart : exDone;
+        fromLoad[d] = loaded;
+    }
+
+    // where the next fetch can start when this one changed the path
+    if (r.flags & RETIRE_BRANCH) {
+        stats.branches++;
+        if (r.flags & RETIRE_TAKEN) stats.taken++;
+    }
+    if (redirects(r)) {
+        if (r.op == OP_RET)
+            fetchReady = wbStart;
+        else if (r.flags & (RETIRE_BRANCH | RETIRE_INDIRECT))
+            fetchReady = exDone;
+        else
+            fetchReady = idStart + 1;
+    }
+
+    charge_stalls(stats.stalls, delay, wbStart - lastWb - 1);  // the bubbles in front of this write-back
+
+    lastId = idStart;
+    lastEx = exStart;
+    lastMem = memStart;
+    lastWb = wbStart;
+    stats.instructions++;
+    stats.cycles = wbStart + 1;
+}
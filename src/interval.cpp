@@ -0,0 +1,126 @@
+#include "interval.h"
+/**
+ * @file interval.cpp
+ * @brief Interval statistics with a background writer
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "cache.h"
+#include "spsc.h"
+
+constexpr size_t INTERVAL_RING = 1u << 12;  // snapshots the writer may fall behind by
+constexpr size_t INTERVAL_BATCH = 64;
+
+bool interval_enabled = false;
+uint64_t interval_next = UINT64_MAX;
+
+static uint64_t interval_every = 0;
+static uint64_t interval_last = 0;  // instruction count of the latest snapshot
+static FILE* interval_file = nullptr;
+static bool interval_csv = false;
+static bool interval_failed = false;
+static std::unique_ptr<SpscRing<IntervalRecord>> interval_ring;
+static std::thread interval_writer;
+
+static void writeRecords() {
+    IntervalRecord batch[INTERVAL_BATCH];
+    while (true) {
+        size_t n = interval_ring->popBulk(batch, INTERVAL_BATCH);
+        if (n == 0) {
+            if (interval_ring->drained()) return;
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (!interval_csv) {
+            if (fwrite(batch, sizeof(IntervalRecord), n, interval_file) != n) interval_failed = true;
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            const IntervalRecord& r = batch[i];
+            if (fprintf(interval_file, "%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%u\n",
+                        static_cast<unsigned long long>(r.instructions), static_cast<unsigned long long>(r.cycles),
+                        static_cast<unsigned long long>(r.hits), static_cast<unsigned long long>(r.misses),
+                        static_cast<unsigned long long>(r.writebacks), r.sp, r.hp, r.pc, r.pcBucket) < 0)
+                interval_failed = true;
+        }
+    }
+}
+
+bool interval_start(uint64_t every, const char* filename) {
+    if (every == 0) return false;
+
+    size_t len = strlen(filename);
+    interval_csv = len >= 4 && strcmp(filename + len - 4, ".csv") == 0;
+    interval_file = fopen(filename, interval_csv ? "w" : "wb");
+    if (!interval_file) return false;
+
+    if (interval_csv) {
+        interval_failed = fputs("instructions,mem_cycle_cntr,hits,misses,writebacks,sp,hp,pc,pc_bucket\n",
+                                interval_file) < 0;
+    } else {
+        uint32_t header[3] = {INTERVAL_VERSION, sizeof(IntervalRecord), static_cast<uint32_t>(every)};
+        interval_failed = fwrite(INTERVAL_MAGIC, sizeof(INTERVAL_MAGIC), 1, interval_file) != 1 ||
+                          fwrite(header, sizeof(header), 1, interval_file) != 1;
+    }
+
+    interval_ring.reset(new SpscRing<IntervalRecord>(INTERVAL_RING));
+    interval_writer = std::thread(writeRecords);
+
+    interval_every = every;
+    interval_last = instructions_retired;
+    interval_next = instructions_retired + every;
+    if (interval_next < next_event) next_event = interval_next;
+    interval_enabled = true;
+    return true;
+}
+
+static void snapshot() {
+    IntervalRecord r;
+    r.instructions = instructions_retired;
+    if (cache_pipelined) {
+        // whatever the worker has published, so execution never waits on it; the counts lag by what is still queued
+        PipelineCounters c = cache_pipeline_counters();
+        r.cycles = c.memCycles;
+        r.hits = c.hits;
+        r.misses = c.misses;
+        r.writebacks = c.writebacks;
+    } else {
+        r.cycles = mem_cycle_cntr;
+        r.hits = cache_model.stats.hits;
+        r.misses = cache_model.stats.misses;
+        r.writebacks = cache_model.stats.writebacks;
+    }
+    r.sp = reg_file[SP];
+    r.hp = reg_file[HP];
+    r.pc = reg_file[PC];
+    r.pcBucket = reg_file[PC] >> INTERVAL_BUCKET_SHIFT;
+
+    while (!interval_ring->push(r))
+        std::this_thread::yield();
+    interval_last = instructions_retired;
+}
+
+void interval_record() {
+    snapshot();
+    interval_next = instructions_retired + interval_every;
+}
+
+bool interval_finish() {
+    if (!interval_enabled) return true;
+
+    if (cache_pipelined) sync_cache_pipeline();  // the run is over, so the last record can be exact
+    if (instructions_retired != interval_last) snapshot();
+    interval_ring->close();
+    interval_writer.join();
+
+    interval_enabled = false;
+    interval_next = UINT64_MAX;
+    bool ok = fclose(interval_file) == 0 && !interval_failed;
+    interval_file = nullptr;
+    return ok;
+}
@@ -1,4 +1,25 @@
 #include "emu4380.h"
+#include <unistd.h>
+
+#include <sstream>
+#include <thread>
+
+#include "bpred.h"
+#include "costs.h"
+#include "dram.h"
+#include "heatmap.h"
+#include "inorder.h"
+#include "mmu.h"
+#include "interval.h"
+#include "ooo.h"
+#include "opstats.h"
+#include "regions.h"
+#include "roi.h"
+#include "sampling.h"
+#include "stackdist.h"
+#include "summary.h"
+#include "sweep.h"
+#include "trace.h"
 #include "utils.h"
 
 using namespace std;
@@ -19,6 +40,67 @@ void printInvalidArgs(string str) {
         << "                   Default: 131,072 bytes (128 KiB)\n"
         << "  -c <config>    Cache configuration.  One of:\n"
         << "\t\t    0 No Cache\n\t\t    1 Direct Mapped Cache\n\t\t    2 Fully Associative Cache\n\t\t    3 2-Way Set Associative Cache\n"
+        << "  --mrc <file>   Write the LRU miss-ratio curve for every fully associative cache size (CSV).\n"
+        << "  --mrc-granularity <bytes>\n"
+        << "                 Block size used by --mrc, a power of two. Default: 16\n"
+        << "  --mrc-sample <rate>\n"
+        << "                 Analyze only this fraction of blocks (SHARDS sampling), 0 < rate <= 1.\n"
+        << "  --sweep <grid> Run every cache configuration in the grid in parallel and print a CSV, e.g.\n"
+        << "                   \"block=16,32;lines=64,128;assoc=1,2,full;policy=lru,fifo,random\"\n"
+        << "  --sweep-out <file>    Write the sweep CSV to a file instead of stdout.\n"
+        << "  --sweep-input <file>  Guest stdin for every sweep run. Default: this process' stdin.\n"
+        << "  --cache <spec> Any single cache geometry, in --sweep grid syntax, e.g. \"block=32;lines=128;assoc=4\"\n"
+        << "                 Add \"victim=<entries>\" (up to 16) for a victim cache.\n"
+        << "  --costs <file> Cycle costs for memory accesses, cache hits and fills, TRP I/O and each opcode's\n"
+        << "                 execution, as \"key = cycles\" lines. Unset keys keep the defaults.\n"
+        << "  --cache-report <file>\n"
+        << "                 Write cache totals, compulsory/capacity/conflict misses and per-set counts.\n"
+        << "  --region-report <file>\n"
+        << "                 Write reads, writes, hits, misses and cycles for code/data, heap and stack.\n"
+        << "  --heatmap <file>\n"
+        << "                 Write per-block read, write and miss counts (binary, render with heatview).\n"
+        << "  --heatmap-block <bytes>\n"
+        << "                 Heat map block size, a power of two. Default: 64\n"
+        << "  --opstats <file>      Write the executed opcode mix, pairs, triples, TRP and branch counts.\n"
+        << "  --opstats-csv <file>  Same counts as CSV. Both need a build with -DEMU_OPCODE_STATS=ON.\n"
+        << "  --interval <n> Write instructions, cycles, hits, misses, write-backs, SP, HP and PC every <n>\n"
+        << "                 retired instructions.\n"
+        << "  --interval-out <file>\n"
+        << "                 Where the intervals go, CSV if it ends in .csv, binary otherwise. Default: interval.csv\n"
+        << "  --stats-json <file>   Write instructions, cycles, CPI, host time, cache counts, peak stack depth and\n"
+        << "                        final HP as JSON at exit, also after an invalid instruction.\n"
+        << "  --max-instructions <n>  Stop the guest after <n> instructions, exit code 3.\n"
+        << "  --max-cycles <n>        Stop the guest after about <n> memory cycles, exit code 4.\n"
+        << "  --max-output-bytes <n>  Stop the guest before it prints more than <n> bytes, exit code 5.\n"
+        << "  --timeout <seconds>     Stop the guest after this much host time, exit code 6.\n"
+        << "  --sample <ff,warm,detail,n>\n"
+        << "                 Sampled simulation: n windows of <detail> timed instructions, each after <ff>\n"
+        << "                 functional ones and <warm> cache warm-up ones. Prints the extrapolated cycles.\n"
+        << "  --roi-only     Run functionally (no cache, no cycles) outside TRP #7 / TRP #8 regions of interest.\n"
+        << "  --pipeline     Time a five stage in-order pipeline over the run and print its cycles, CPI and\n"
+        << "                 stalls by cause (RAW, load-use, branch, fetch, memory).\n"
+        << "  --no-forwarding       Pipeline without bypasses: operands wait for write-back.\n"
+        << "  --ooo <spec>   Time an out-of-order core over the run, on a thread of its own, and print IPC,\n"
+        << "                 mean occupancy and memory-level parallelism. <spec> is \"default\" or any of\n"
+        << "                 \"width=4,rob=64,rs=32,lsq=16,alu=1,mul=3,div=12,load=2\".\n"
+        << "  --ooo-report <file>   Write the --ooo reorder buffer, station and queue occupancy histograms (CSV).\n"
+        << "  --bpred <list> Predict every branch, jump and return with each of static, bimodal, gshare, tage\n"
+        << "                 (comma separated) and print accuracy and MPKI. The first one also decides which\n"
+        << "                 branches cost --pipeline and --ooo a refetch.\n"
+        << "  --bpred-report <file> Write executions, taken and mispredictions per predictor for every branch PC.\n"
+        << "  --dram <spec>  Time fills, write-backs and uncached accesses on DRAM banks with open rows instead\n"
+        << "                 of flat costs, and print row hits, misses and conflicts. <spec> is \"default\" or\n"
+        << "                 any of \"banks=8,row=1024,trcd=4,tcas=4,trp=4,burst=2,page=open\" (or page=closed).\n"
+        << "  --mmu <spec>   Translate every guest address through a TLB and a page table in guest memory, set\n"
+        << "                 up as an identity map in the top pages with the stack below it. Misses walk the\n"
+        << "                 table, unmapped or read-only pages trap. TRP #9 reads its base into R3, TRP #10\n"
+        << "                 sets it from R3 and flushes the TLB. <spec> is \"default\" or any of\n"
+        << "                 \"page=4096,tlb=64,assoc=4,policy=lru,walk=8\" (assoc=full, policy=fifo|random).\n"
+        << "  --cache-thread Run the cache model on a second thread, overlapped with execution.\n"
+        << "  --trace-out <file>    Record every guest memory access into a binary trace.\n"
+        << "  --replay <trace>      Replay a recorded trace through the cache picked by -c/--cache instead of\n"
+        << "                        running a binary. Sets are split across -j worker threads.\n"
+        << "  -j <jobs>      Sweep runs, or replay threads, in flight at once. Default: number of host cores.\n"
         << "\n"
         << "INPUT_BINARY_FILE:\n"
         << "                   Path to 4380 bytecode binary.\n";
@@ -29,6 +111,95 @@ void printBadCacheConfig() {
 void printBadMem() {
     cout << "Invalid memory configuaration. Aborting.\n";
 }
+void printBadMrc() {
+    cout << "Invalid miss-ratio curve configuration. Aborting.\n";
+}
+void printBadSweep() {
+    cout << "Invalid sweep configuration. Aborting.\n";
+}
+// the `-c` presets as geometries, for trace replay. No cache replays through the direct mapped one.
+CacheConfig presetConfig(int cacheType) {
+    CacheConfig cfg;
+    if (cacheType == FULLY_ASSOCIATIVE)
+        cfg.ways = 0;
+    else if (cacheType == TWO_WAY_SET_ASSOCIATIVE)
+        cfg.ways = 2;
+    return cfg;
+}
+void printMshrStats(const CacheStats& c, uint32_t mshrs) {
+    cerr << "MSHRs (" << mshrs << "): " << c.secondaryMisses << " secondary misses, " << c.mshrStallCycles
+         << " cycles waiting for a free one, memory-level parallelism " << fixed << setprecision(2) << c.mlp()
+         << "\nCache cycles: " << c.cycles << ", blocking would take " << c.blockingCycles << " ("
+         << static_cast<int64_t>(c.blockingCycles - c.cycles) << " saved)\n";
+    cerr.unsetf(ios::floatfield);
+}
+void printSectorStats(const CacheStats& c, uint32_t sectorSize) {
+    cerr << "Sectors (" << sectorSize << " bytes): " << c.sectorMisses << " sector misses, " << c.sectorFills
+         << " sectors filled, " << c.evictedUsed << " of " << c.evictedSectors << " sectors of evicted lines used ("
+         << fixed << setprecision(2) << 100.0 * c.sectorUtilization() << "%), " << c.evictedValid << " filled\n";
+    cerr.unsetf(ios::floatfield);
+}
+// `quotas` are the ways each partition ended the run with, null when replay doesn't know them
+void printPartitionStats(const CacheStats& c, const uint32_t* quotas) {
+    cerr << "Partitions:";
+    for (uint32_t p = 0; p < PART_COUNT; p++) {
+        uint64_t accesses = c.partHits[p] + c.partMisses[p];
+        cerr << (p ? ", " : " ") << partition_name(static_cast<CachePartition>(p));
+        if (quotas) cerr << " (" << quotas[p] << (quotas[p] == 1 ? " way)" : " ways)");
+        cerr << ' ' << c.partHits[p] << " hits " << c.partMisses[p] << " misses " << fixed << setprecision(2)
+             << (accesses ? 100.0 * c.partMisses[p] / accesses : 0.0) << "%";
+    }
+    cerr << ", " << c.repartitions << " resizes\n";
+    cerr.unsetf(ios::floatfield);
+}
+void printTlbStats() {
+    const TlbStats& t = mmu.stats;
+    const MmuConfig& cfg = mmu.configuration();
+    uint64_t accesses = t.hits + t.misses;
+    cerr << "TLB (" << cfg.entries << " entries, ";
+    if (cfg.ways)
+        cerr << cfg.ways << "-way";
+    else
+        cerr << "fully associative";
+    cerr << ", " << cfg.pageSize << " byte pages, reach " << static_cast<uint64_t>(cfg.entries) * cfg.pageSize
+         << " bytes): " << t.hits << " hits, " << t.misses << " misses, hit rate " << fixed << setprecision(2)
+         << (accesses ? 100.0 * t.hits / accesses : 0.0) << "%, " << t.walkCycles << " walk cycles, " << t.faults
+         << " page faults, " << t.flushes << " flushes\n";
+    cerr.unsetf(ios::floatfield);
+}
+void printDramStats() {
+    const DramStats& d = dram.stats;
+    const DramConfig& cfg = dram.configuration();
+    uint64_t accesses = d.reads + d.writes;
+    cerr << "DRAM (" << cfg.banks << " banks, " << cfg.rowSize << " byte rows, " << page_policy_name(cfg.policy)
+         << " page): " << d.reads << " reads, " << d.writes << " writes, " << d.cycles << " cycles\nRows: "
+         << d.rowHits << " hits, " << d.rowMisses << " misses, " << d.rowConflicts << " conflicts, hit rate "
+         << fixed << setprecision(2) << (accesses ? 100.0 * d.rowHits / accesses : 0.0) << "%\n";
+    cerr.unsetf(ios::floatfield);
+}
+int replay(const string& traceFile, const CacheConfig& cfg, unsigned threads, const string& reportFile) {
+    ReplayResult result;
+    if (!replayTrace(traceFile.c_str(), cfg, threads, result)) {
+        cerr << "Cannot replay trace: " << traceFile << "\n";
+        return 1;
+    }
+    cout << "Replayed " << result.accesses << " accesses on " << result.shards
+         << " thread(s). Total memory cycles: " << result.cycles << "\n"
+         << "Hits: " << result.stats.hits << "  Misses: " << result.stats.misses
+         << "  Write-backs: " << result.stats.writebacks << "\n";
+    if (cfg.victims)
+        cout << "Victim cache hits: " << result.stats.victimHits << "\n";
+    if (cfg.mshrs) printMshrStats(result.stats, cfg.mshrs);
+    if (cfg.sectorSize && cfg.sectorSize < cfg.blockSize) printSectorStats(result.stats, cfg.sectorSize);
+    if (cfg.partition != PARTITION_NONE) printPartitionStats(result.stats, nullptr);
+    if (dram_enabled) printDramStats();
+
+    if (!reportFile.empty() && !write_cache_report(reportFile.c_str(), cfg, result.stats, result.setStats)) {
+        cerr << "Cannot write cache report: " << reportFile << "\n";
+        return 1;
+    }
+    return 0;
+}
 int main(int argc, char** argv) {
     if (argc < 2) {
         printInvalidArgs(argv[0]);
@@ -38,6 +209,38 @@ int main(int argc, char** argv) {
     uint32_t desired_memory = 131'072;
     int cache_config = 0;
     string input_file;
+    string mrc_file;
+    uint32_t mrc_granularity = BLOCK_SIZE;
+    double mrc_sample = 1.0;
+    string sweep_spec;
+    string sweep_out;
+    string sweep_input;
+    unsigned sweep_jobs = thread::hardware_concurrency();
+    string cache_spec;
+    string trace_out;
+    string replay_file;
+    bool cache_thread = false;
+    string cache_report;
+    string costs_file;
+    string region_report;
+    string heatmap_file;
+    uint32_t heatmap_block = HEATMAP_BLOCK;
+    string opstats_file;
+    string opstats_csv;
+    uint64_t interval = 0;
+    string interval_out = "interval.csv";
+    string stats_json;
+    RunLimits limits;
+    SampleConfig sample;
+    bool roi_functional = false;
+    bool pipeline = false;
+    PipelineConfig pipeline_config;
+    string ooo_spec;
+    string dram_spec;
+    string mmu_spec;
+    string ooo_report;
+    vector<PredictorKind> predictors;
+    string bpred_report;
 
     for (int i = 1; i < argc; ++i) {
         string a = argv[i];
@@ -72,6 +275,205 @@ int main(int argc, char** argv) {
                 }
             }
 
+        } else if (a == "--mrc") {
+            if (i + 1 == argc) {
+                printBadMrc();
+                return 2;
+            }
+            mrc_file = argv[++i];
+
+        } else if (a == "--mrc-granularity" || a == "--mrc-sample") {
+            if (i + 1 == argc) {
+                printBadMrc();
+                return 2;
+            }
+            string val = argv[++i];
+            size_t pos;
+            if (a == "--mrc-granularity") {
+                uint64_t tmp = stoull(val, &pos);
+                if (pos != val.size() || tmp == 0 || tmp > UINT32_MAX) {
+                    printBadMrc();
+                    return 2;
+                }
+                mrc_granularity = static_cast<uint32_t>(tmp);
+            } else {
+                mrc_sample = stod(val, &pos);
+                if (pos != val.size()) {
+                    printBadMrc();
+                    return 2;
+                }
+            }
+
+        } else if (a == "--sweep" || a == "--sweep-out" || a == "--sweep-input") {
+            if (i + 1 == argc) {
+                printBadSweep();
+                return 2;
+            }
+            string val = argv[++i];
+            if (a == "--sweep")
+                sweep_spec = val;
+            else if (a == "--sweep-out")
+                sweep_out = val;
+            else
+                sweep_input = val;
+
+        } else if (a == "--costs") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            costs_file = argv[++i];
+            string error;
+            if (!load_cost_model(costs_file.c_str(), cost_model, error)) {
+                cerr << "Invalid cost model " << costs_file << ": " << error << "\n";
+                return 2;
+            }
+
+        } else if (a == "--cache" || a == "--cache-report") {
+            if (i + 1 == argc) {
+                printBadCacheConfig();
+                return 2;
+            }
+            (a == "--cache" ? cache_spec : cache_report) = argv[++i];
+
+        } else if (a == "--roi-only") {
+            roi_functional = true;
+
+        } else if (a == "--pipeline") {
+            pipeline = true;
+
+        } else if (a == "--no-forwarding") {
+            pipeline_config.forwarding = false;
+
+        } else if (a == "--ooo" || a == "--ooo-report") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            (a == "--ooo" ? ooo_spec : ooo_report) = argv[++i];
+
+        } else if (a == "--dram" || a == "--mmu") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            (a == "--dram" ? dram_spec : mmu_spec) = argv[++i];
+
+        } else if (a == "--bpred" || a == "--bpred-report") {
+            if (i + 1 == argc || (a == "--bpred" && !parsePredictorList(argv[i + 1], predictors))) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            if (a == "--bpred-report") bpred_report = argv[i + 1];
+            i++;
+
+        } else if (a == "--cache-thread") {
+            cache_thread = true;
+
+        } else if (a == "--region-report" || a == "--heatmap") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            (a == "--region-report" ? region_report : heatmap_file) = argv[++i];
+
+        } else if (a == "--opstats" || a == "--opstats-csv") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            (a == "--opstats" ? opstats_file : opstats_csv) = argv[++i];
+
+        } else if (a == "--max-instructions" || a == "--max-cycles" || a == "--max-output-bytes" ||
+                   a == "--timeout") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            string val = argv[++i];
+            size_t pos;
+            if (a == "--timeout") {
+                limits.seconds = stod(val, &pos);
+                if (pos != val.size() || !(limits.seconds > 0)) {
+                    printInvalidArgs(argv[0]);
+                    return 1;
+                }
+                continue;
+            }
+            uint64_t tmp = stoull(val, &pos);
+            if (pos != val.size() || tmp == 0) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            (a == "--max-instructions" ? limits.instructions
+                                       : a == "--max-cycles" ? limits.cycles : limits.outputBytes) = tmp;
+
+        } else if (a == "--sample") {
+            if (i + 1 == argc || !parseSampleSpec(argv[i + 1], sample)) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            i++;
+
+        } else if (a == "--stats-json") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            stats_json = argv[++i];
+
+        } else if (a == "--interval" || a == "--interval-out") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            string val = argv[++i];
+            if (a == "--interval-out") {
+                interval_out = val;
+                continue;
+            }
+            size_t pos;
+            interval = stoull(val, &pos);
+            if (pos != val.size() || interval == 0) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+
+        } else if (a == "--heatmap-block") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            string val = argv[++i];
+            size_t pos;
+            uint64_t tmp = stoull(val, &pos);
+            if (pos != val.size() || tmp == 0 || tmp > UINT32_MAX) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            heatmap_block = static_cast<uint32_t>(tmp);
+
+        } else if (a == "--trace-out" || a == "--replay") {
+            if (i + 1 == argc) {
+                printInvalidArgs(argv[0]);
+                return 1;
+            }
+            (a == "--trace-out" ? trace_out : replay_file) = argv[++i];
+
+        } else if (a == "-j") {
+            if (i + 1 == argc) {
+                printBadSweep();
+                return 2;
+            }
+            string val = argv[++i];
+            size_t pos;
+            uint64_t tmp = stoull(val, &pos);
+            if (pos != val.size() || tmp == 0 || tmp > 4096) {
+                printBadSweep();
+                return 2;
+            }
+            sweep_jobs = static_cast<unsigned>(tmp);
+
         } else if (input_file.empty()) {
             input_file = a;
         } else {
@@ -79,15 +481,165 @@ int main(int argc, char** argv) {
             return 1;
         }
     }
-    if (input_file.empty()) {
+    if (input_file.empty() && replay_file.empty()) {
         printInvalidArgs(argv[0]);
         return 1;
     }
 
+    CacheConfig cache_geometry = presetConfig(cache_config);
+    if (!cache_spec.empty()) {
+        vector<CacheConfig> single;
+        if (!parseSweepGrid(cache_spec, single) || single.size() != 1) {
+            printBadCacheConfig();
+            return 2;
+        }
+        cache_geometry = single[0];
+    }
+    cache_geometry.classify = !cache_report.empty();
+
+    if (!dram_spec.empty()) {
+        DramConfig dram_config;
+        if (!parseDramSpec(dram_spec, dram_config)) {
+            printInvalidArgs(argv[0]);
+            return 1;
+        }
+        dram_start(dram_config);
+    }
+    MmuConfig mmu_config;
+    if (!mmu_spec.empty() && !parseMmuSpec(mmu_spec, mmu_config)) {
+        printInvalidArgs(argv[0]);
+        return 1;
+    }
+
+    if (!replay_file.empty()) return replay(replay_file, cache_geometry, sweep_jobs, cache_report);
+
+    if (!sweep_spec.empty()) {
+        vector<SweepPoint> grid;
+        if (!parseSweepGrid(sweep_spec, grid)) {
+            printBadSweep();
+            return 2;
+        }
+
+        // every run replays the same input, so it is read once up front
+        stringstream guest_input;
+        if (!sweep_input.empty()) {
+            ifstream in(sweep_input);
+            if (!in) {
+                cerr << "Cannot open file: " << sweep_input << "\n";
+                return 1;
+            }
+            guest_input << in.rdbuf();
+        } else if (!isatty(STDIN_FILENO)) {
+            guest_input << cin.rdbuf();
+        }
+
+        return runSweep(grid, input_file, desired_memory, guest_input.str(), sweep_out, sweep_jobs, limits,
+                        mmu_spec.empty() ? nullptr : &mmu_config);
+    }
+
     mem_size = desired_memory;
     if (!init_mem(mem_size)) return 1;
 
     init_cache(cache_config);
+    if (!cache_spec.empty() || !cache_report.empty()) {
+        if ((cache_spec.empty() && !cacheUsed) || !configure_cache(cache_geometry)) {
+            printBadCacheConfig();
+            return 2;
+        }
+    }
+
+    if (!mrc_file.empty()) {
+        if (!stackdist.init(mrc_granularity, mrc_sample)) {
+            printBadMrc();
+            return 2;
+        }
+        stackdist_enabled = true;
+        access_hooks = true;
+    }
+
+    if (!region_report.empty()) {
+        region_stats_start();
+        access_hooks = true;
+    }
+
+    if (!heatmap_file.empty()) {
+        if (!heatmap.init(heatmap_block, mem_size)) {
+            printInvalidArgs(argv[0]);
+            return 1;
+        }
+        heatmap_enabled = true;
+        cache_model.heat = &heatmap;
+        access_hooks = true;
+    }
+
+    if (!opstats_file.empty() || !opstats_csv.empty()) {
+#ifdef EMU_OPCODE_STATS
+        opstats.reset();
+        opstats_enabled = true;
+#else
+        cerr << "Opcode statistics are not compiled in, rebuild with -DEMU_OPCODE_STATS=ON\n";
+        return 2;
+#endif
+    }
+
+    if (pipeline) {
+        // the timing model needs each instruction's memory cycles as it retires
+        if (cache_thread) {
+            cerr << "--pipeline needs the cache on the main thread, drop --cache-thread\n";
+            return 2;
+        }
+        pipeline_config.hitCycles = cost_model.hit;
+        inorder_start(pipeline_config);
+    }
+
+    if (!bpred_report.empty() && predictors.empty()) predictors.push_back(PRED_GSHARE);
+    if (!predictors.empty()) bpred_start(predictors, !bpred_report.empty());
+
+    if (!ooo_spec.empty()) {
+        OooConfig ooo_config;
+        if (!parseOooSpec(ooo_spec, ooo_config)) {
+            printInvalidArgs(argv[0]);
+            return 1;
+        }
+        if (cache_thread) {
+            cerr << "--ooo needs the cache on the main thread, drop --cache-thread\n";
+            return 2;
+        }
+        ooo_config.hitCycles = cost_model.hit;
+        ooo_start(ooo_config);
+        atexit(ooo_finish);  // the model thread must be joined on every way out
+    }
+
+    if (cache_thread) {
+        if (!start_cache_pipeline()) {
+            printBadCacheConfig();
+            return 2;
+        }
+        atexit(stop_cache_pipeline);  // the worker must be joined on every way out
+    }
+
+    if (!trace_out.empty()) {
+        if (!trace_open(trace_out.c_str())) {
+            cerr << "Cannot write trace: " << trace_out << "\n";
+            return 1;
+        }
+        access_hooks = true;
+        atexit([] {
+            if (trace_enabled) trace_close();  // also keeps the accesses leading up to an invalid instruction
+        });
+    }
+
+    if (interval) {
+        if (!interval_start(interval, interval_out.c_str())) {
+            cerr << "Cannot write intervals: " << interval_out << "\n";
+            return 1;
+        }
+        atexit([] {
+            if (interval_enabled) interval_finish();  // runs before the cache worker is stopped
+        });
+    }
+
+    if (!stats_json.empty()) summary_start(stats_json.c_str());
 
     unsigned int rc = load_binary(input_file.c_str());
     if (rc == 1) {
@@ -98,16 +650,112 @@ int main(int argc, char** argv) {
         cerr << "INSUFFICIENT MEMORY SPACE\n";
         return 2;
     }
+    if (!mmu_spec.empty() && !mmu_start(mmu_config)) {
+        cerr << "--mmu needs a memory size that is a multiple of the page size, and room for the page table\n";
+        return 2;
+    }
 
-    while (runBool) {
-        if (!fetch() || !decode() || !execute()) {
-            invalidInstruction();
-            return 1;
-        }
+    if (roi_functional && sample.samples) {
+        cerr << "--roi-only and --sample both decide when to time, pick one\n";
+        return 2;
     }
+    set_run_limits(limits);
+    if (sample.samples) sampling_start(sample);
+    if (roi_functional) roi_start(true);
+
+    // everything a run reports once it is over, however it ended; `status` goes into --stats-json
+    const auto finishRun = [&](const char* status) {
+        sync_cache_pipeline();  // a trap can leave accesses queued
+        if (sampling_enabled) {
+            SampleEstimate est = sampling_finish();
+            cerr << "Sampled " << est.windows << " windows of " << sample.detail << " instructions: estimated "
+                 << fixed << setprecision(0) << est.cycles << " +/- " << est.cyclesHalfWidth
+                 << " memory cycles (95%) over " << est.instructions << " instructions, CPI " << setprecision(4)
+                 << est.cpi << ", miss ratio " << est.missRatio << "\n";
+            cerr.unsetf(ios::floatfield);
+        }
+        if (inorder_enabled) {
+            const PipelineStats& p = inorder.stats;
+            cerr << "Pipeline: " << p.cycles << " cycles for " << p.instructions << " instructions, CPI "
+                 << setprecision(4) << (p.instructions ? static_cast<double>(p.cycles) / p.instructions : 0.0) << "\nStalls:";
+            for (uint32_t c = 0; c < STALL_COUNT; c++)
+                cerr << " " << stall_cause_name(static_cast<StallCause>(c)) << " " << p.stalls[c];
+            cerr << "\nBranches: " << p.branches << ", taken " << p.taken << "\n";
+        }
+        if (ooo_enabled) {
+            ooo_finish();
+            const OooStats& o = ooo.stats;
+            const auto mean = [](const vector<uint64_t>& hist) {
+                uint64_t n = 0, sum = 0;
+                for (size_t i = 0; i < hist.size(); i++) {
+                    n += hist[i];
+                    sum += hist[i] * i;
+                }
+                return n ? static_cast<double>(sum) / n : 0.0;
+            };
+            cerr << "Out-of-order: " << o.cycles << " cycles for " << o.instructions << " instructions, IPC "
+                 << setprecision(4) << o.ipc() << "\nMean occupancy: rob " << mean(o.robOccupancy) << ", rs "
+                 << mean(o.rsOccupancy) << ", lsq " << mean(o.lsqOccupancy) << "\nMemory-level parallelism: " << o.mlp()
+                 << "\n";
+            if (!ooo_report.empty() && !write_ooo_report(ooo_report.c_str()))
+                cerr << "Cannot write out-of-order report: " << ooo_report << "\n";
+        }
+        if (bpred_enabled) {
+            cerr << "Branch prediction over " << bpred_instructions << " instructions:\n";
+            for (const BranchUnit& u : bpred_units) {
+                const BranchStats& b = u.stats;
+                cerr << "  " << left << setw(8) << predictor_name(u.kind) << right << "direction accuracy " << fixed
+                     << setprecision(2) << (b.branches ? 100.0 * (b.branches - b.directionMisses) / b.branches : 100.0)
+                     << "% of " << b.branches << " branches, " << b.targetMisses << " target misses over those and "
+                     << b.jumps << " jumps, MPKI "
+                     << (bpred_instructions ? 1000.0 * b.mispredicts() / bpred_instructions : 0.0) << "\n";
+                cerr.unsetf(ios::floatfield);
+            }
+            if (!bpred_report.empty() && !write_bpred_report(bpred_report.c_str()))
+                cerr << "Cannot write branch report: " << bpred_report << "\n";
+        }
+        if (cacheUsed && cache_model.mshrCount) printMshrStats(cache_model.stats, cache_model.mshrCount);
+        if (cacheUsed && cache_model.sectorsPerLine > 1) printSectorStats(cache_model.stats, cache_model.sectorSize);
+        if (cacheUsed && cache_model.partition != PARTITION_NONE)
+            printPartitionStats(cache_model.stats, cache_model.quota);
+        if (dram_enabled) printDramStats();
+        if (mmu_enabled) printTlbStats();
+        if (stop_reason != STOP_NONE)
+            cerr << "Guest stopped: " << stop_reason_name(stop_reason) << " after " << instructions_retired
+                 << " instructions\n";
 
-    // dumpCacheSummary();
-    free_cache();
+        if (stackdist_enabled && !stackdist.write(mrc_file.c_str()))
+            cerr << "Cannot write miss-ratio curve: " << mrc_file << "\n";
+        if (!cache_report.empty() &&
+            !write_cache_report(cache_report.c_str(), cache_geometry, cache_model.stats, cache_model.setStats))
+            cerr << "Cannot write cache report: " << cache_report << "\n";
+        if (!opstats_file.empty() && !opstats.writeReport(opstats_file.c_str()))
+            cerr << "Cannot write opcode statistics: " << opstats_file << "\n";
+        if (!opstats_csv.empty() && !opstats.writeCsv(opstats_csv.c_str()))
+            cerr << "Cannot write opcode statistics: " << opstats_csv << "\n";
+        if (heatmap_enabled && !heatmap.write(heatmap_file.c_str()))
+            cerr << "Cannot write heat map: " << heatmap_file << "\n";
+        if (region_stats_enabled && !write_region_report(region_report.c_str()))
+            cerr << "Cannot write region report: " << region_report << "\n";
+        if (summary_enabled && !summary_write(status))
+            cerr << "Cannot write run summary: " << stats_json << "\n";
+        if (interval_enabled && !interval_finish())
+            cerr << "Cannot write intervals: " << interval_out << "\n";
+        if (trace_enabled && !trace_close())
+            cerr << "Cannot write trace: " << trace_out << "\n";
 
-    return 0;
+        // dumpCacheSummary();
+        free_cache();
+    };
+
+    if (!runLoop()) {
+        invalidInstruction();
+        cerr << "Trap: " << trap_name(trap_code) << "\n";
+        if (trap_code == TRAP_PAGE_FAULT) cerr << "Page fault at address " << mmu.faultAddress << "\n";
+        finishRun(trap_name(trap_code));
+        return 1;
+    }
+    finishRun(stop_reason_name(stop_reason));
+
+    return stop_exit_code(stop_reason);
 }
@@ -0,0 +1,173 @@
+#include "mmu.h"
+/**
+ * @file mmu.cpp
+ * @brief TLB, page walks and the identity page table
+ */
+
+#include <sstream>
+
+using namespace std;
+
+Mmu mmu;
+bool mmu_enabled = false;
+
+static uint32_t readPte(uint32_t at) {
+    return prog_mem[at] | (prog_mem[at + 1] << 8) | (prog_mem[at + 2] << 16) |
+           (static_cast<uint32_t>(prog_mem[at + 3]) << 24);
+}
+
+void Mmu::reset(const MmuConfig& cfg, uint32_t base) {
+    config = cfg;
+    pageBits = 0;
+    while ((1u << pageBits) < cfg.pageSize)
+        pageBits++;
+    pageMask = cfg.pageSize - 1;
+    ways = cfg.ways ? cfg.ways : cfg.entries;
+    setMask = cfg.entries / ways - 1;
+    tlb.assign(cfg.entries, TlbEntry());
+    stats = TlbStats();
+    stamp = 0;
+    rng = 0x2545F491;
+    tableBase = base;
+    faultAddress = 0;
+}
+
+void Mmu::flush() {
+    for (TlbEntry& e : tlb)
+        e.valid = false;
+    stats.flushes++;
+}
+
+bool Mmu::walk(uint32_t& address, bool write) {
+    const uint32_t vpn = address >> pageBits;
+    stats.misses++;
+    if (!functional_mode) {
+        mem_cycle_cntr += config.walkCycles;
+        stats.walkCycles += config.walkCycles;
+    }
+
+    const uint32_t at = tableBase + 4 * vpn;
+    const uint32_t pte = at <= mem_size - 4 ? readPte(at) : 0;
+    if (!(pte & PTE_VALID) || (write && !(pte & PTE_WRITABLE)) || (pte & ~pageMask) >= mem_size) {
+        stats.faults++;
+        faultAddress = address;
+        return raiseTrap(TRAP_PAGE_FAULT);
+    }
+
+    // a stale entry for the page or an invalid one first, the policy's pick otherwise
+    TlbEntry* set = &tlb[(vpn & setMask) * ways];
+    TlbEntry* slot = nullptr;
+    for (uint32_t w = 0; w < ways && !slot; w++)
+        if (!set[w].valid || set[w].vpn == vpn) slot = &set[w];
+    if (!slot && config.policy == POLICY_RANDOM) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        slot = &set[rng % ways];
+    }
+    if (!slot) {
+        slot = &set[0];
+        for (uint32_t w = 1; w < ways; w++)
+            if (set[w].lastused < slot->lastused) slot = &set[w];
+    }
+
+    slot->vpn = vpn;
+    slot->pte = pte;
+    slot->valid = true;
+    slot->lastused = ++stamp;
+    address = (pte & ~pageMask) | (address & pageMask);
+    return true;
+}
+
+bool Mmu::translateSplit(uint32_t& address, bool write, uint32_t& next, uint32_t& head) {
+    head = config.pageSize - (address & pageMask);
+    uint32_t first = address;
+    next = address + head;
+    if (!translate(first, write) || !translate(next, write)) return false;
+    if (next == first + head) head = 0;  // the frames are neighbours too
+    address = first;
+    return true;
+}
+
+bool parseMmuSpec(const string& spec, MmuConfig& cfg) {
+    const auto isPow2 = [](uint32_t v) { return v != 0 && (v & (v - 1)) == 0; };
+
+    MmuConfig parsed;
+    if (spec == "default") {
+        cfg = parsed;
+        return true;
+    }
+
+    stringstream in(spec);
+    string field;
+    while (getline(in, field, ',')) {
+        size_t eq = field.find('=');
+        if (eq == string::npos || eq + 1 == field.size()) return false;
+        string key = field.substr(0, eq);
+        string val = field.substr(eq + 1);
+
+        if (key == "policy") {
+            if (val == "lru")
+                parsed.policy = POLICY_LRU;
+            else if (val == "fifo")
+                parsed.policy = POLICY_FIFO;
+            else if (val == "random")
+                parsed.policy = POLICY_RANDOM;
+            else
+                return false;
+            continue;
+        }
+        if (key == "assoc" && val == "full") {
+            parsed.ways = 0;
+            continue;
+        }
+
+        if (val.find_first_not_of("0123456789") != string::npos || val.size() > 9) return false;
+        uint32_t v = static_cast<uint32_t>(stoul(val));
+        if (key == "page")
+            parsed.pageSize = v;
+        else if (key == "tlb")
+            parsed.entries = v;
+        else if (key == "assoc")
+            parsed.ways = v;
+        else if (key == "walk")
+            parsed.walkCycles = v;
+        else
+            return false;
+    }
+
+    uint32_t ways = parsed.ways ? parsed.ways : parsed.entries;
+    if (!isPow2(parsed.pageSize) || parsed.pageSize < 64 || !isPow2(parsed.entries) || !isPow2(ways) ||
+        ways > parsed.entries)
+        return false;
+    cfg = parsed;
+    return true;
+}
+
+bool mmu_start(const MmuConfig& cfg) {
+    mmu.reset(cfg, 0);
+    if (mem_size % cfg.pageSize) return false;
+
+    // the table takes whole pages at the top, the stack starts below them
+    uint32_t bytes = mmu.tableBytes(mem_size);
+    uint32_t base = (mem_size - bytes) & ~(cfg.pageSize - 1);
+    if (bytes > mem_size || base < reg_file[SL]) return false;
+
+    for (uint32_t vpn = 0; vpn < mem_size / cfg.pageSize; vpn++) {
+        uint32_t pte = vpn * cfg.pageSize | PTE_VALID | PTE_WRITABLE;
+        for (uint32_t i = 0; i < 4; i++)
+            prog_mem[base + 4 * vpn + i] = static_cast<unsigned char>(pte >> (8 * i));
+    }
+    mmu.tableBase = base;
+    reg_file[SB] = reg_file[SP] = reg_file[FP] = base;
+    mmu_enabled = true;
+    return true;
+}
+
+bool mmu_set_table(uint32_t base) {
+    uint32_t bytes = mmu.tableBytes(mem_size);
+    if (base % 4 || base > mem_size || bytes > mem_size - base) return raiseTrap(TRAP_OUT_OF_BOUNDS);
+    mmu.tableBase = base;
+    mmu.flush();
+    return true;
+}
@@ -0,0 +1,258 @@
+#include "ooo.h"
+/**
+ * @file ooo.cpp
+ * @brief Out-of-order superscalar timing, on its own thread
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "spsc.h"
+
+using namespace std;
+
+constexpr size_t OOO_RING = 1u << 14;  // instructions the model thread may fall behind by
+constexpr size_t OOO_BATCH = 256;
+
+OooModel ooo;
+bool ooo_enabled = false;
+
+static unique_ptr<SpscRing<RetiredInstr>> ooo_ring;
+static vector<RetiredInstr> ooo_pending;
+static thread ooo_thread;
+
+bool parseOooSpec(const string& spec, OooConfig& cfg) {
+    OooConfig parsed;
+    if (spec == "default") {
+        cfg = parsed;
+        return true;
+    }
+
+    stringstream in(spec);
+    string field;
+    while (getline(in, field, ',')) {
+        size_t eq = field.find('=');
+        if (eq == string::npos || eq + 1 == field.size()) return false;
+        string key = field.substr(0, eq);
+        string val = field.substr(eq + 1);
+        if (val.find_first_not_of("0123456789") != string::npos || val.size() > 9) return false;
+        uint32_t v = static_cast<uint32_t>(stoul(val));
+        if (v == 0) return false;
+
+        if (key == "width")
+            parsed.width = v;
+        else if (key == "rob")
+            parsed.rob = v;
+        else if (key == "rs")
+            parsed.rs = v;
+        else if (key == "lsq")
+            parsed.lsq = v;
+        else if (key == "alu")
+            parsed.alu = v;
+        else if (key == "mul")
+            parsed.mul = v;
+        else if (key == "div")
+            parsed.div = v;
+        else if (key == "load")
+            parsed.load = v;
+        else
+            return false;
+    }
+    cfg = parsed;
+    return true;
+}
+
+void OooModel::reset(const OooConfig& cfg) {
+    *this = OooModel();
+    config = cfg;
+    robCommit.assign(cfg.rob, 0);
+    lsqCommit.assign(cfg.lsq, 0);
+    stats.robOccupancy.assign(cfg.rob + 1, 0);
+    stats.rsOccupancy.assign(cfg.rs + 1, 0);
+    stats.lsqOccupancy.assign(cfg.lsq + 1, 0);
+}
+
+// adds up the merged miss intervals that end by `before`: nothing issued later can overlap them
+void OooModel::closeMisses(uint64_t before) {
+    while (!misses.empty() && misses.begin()->second <= before) {
+        stats.missBusyCycles += misses.begin()->second - misses.begin()->first;
+        misses.erase(misses.begin());
+    }
+}
+
+void OooModel::retire(const RetiredInstr& r) {
+    const bool memOp = (r.flags & (RETIRE_LOAD | RETIRE_STORE)) != 0;
+
+    // dispatch, in order, once the front end has the instruction and the structures have room
+    uint64_t d = max(fetchReady, lastDispatch) + beyondHits(r.fetchCycles, 2, config.hitCycles);
+    d = max(d, robCommit[retired % config.rob]);
+    if (memOp) d = max(d, lsqCommit[memOps % config.lsq]);
+    while (!rsIssue.empty() && rsIssue.top() <= d)
+        rsIssue.pop();
+    if (rsIssue.size() >= config.rs) {
+        d = rsIssue.top();
+        while (!rsIssue.empty() && rsIssue.top() <= d)
+            rsIssue.pop();
+    }
+    if (d == lastDispatch && dispatchSlots == config.width) d++;
+    if (d == lastDispatch) {
+        dispatchSlots++;
+    } else {
+        lastDispatch = d;
+        dispatchSlots = 1;
+    }
+
+    // what is in flight as this one joins
+    while (!inFlight.empty() && inFlight.front() <= d)
+        inFlight.pop_front();
+    while (!memInFlight.empty() && memInFlight.front() <= d)
+        memInFlight.pop_front();
+    stats.robOccupancy[min<size_t>(inFlight.size(), config.rob)]++;
+    stats.rsOccupancy[min<size_t>(rsIssue.size(), config.rs)]++;
+    stats.lsqOccupancy[min<size_t>(memInFlight.size(), config.lsq)]++;
+    closeMisses(d);
+
+    // issue once the operands are ready, then complete after the unit's latency
+    uint64_t issue = d + 1;
+    for (uint8_t s : r.src)
+        if (s < TIMED_REGS) issue = max(issue, ready[s]);
+
+    uint64_t latency = config.alu;
+    uint64_t miss = 0;
+    switch (r.op) {
+        case OP_MUL:
+        case OP_MULI:
+            latency = config.mul;
+            break;
+        case OP_DIV:
+        case OP_SDIV:
+        case OP_DIVI:
+            issue = max(issue, divFree);
+            latency = config.div;
+            divFree = issue + config.div;
+            break;
+        default:
+            if (r.flags & RETIRE_LOAD) {
+                miss = beyondHits(r.memCycles, r.memAccesses, config.hitCycles);
+                latency = config.load + miss;
+            }
+            break;
+    }
+    // execute cycles from the cost model lengthen whichever unit ran the instruction
+    const uint64_t done = issue + latency;
+    uint64_t complete = done + r.exCycles;
+    for (uint8_t dst : r.dst)
+        if (dst < TIMED_REGS) ready[dst] = complete;
+
+    if (miss) {
+        // merge [issue, complete) into the outstanding misses
+        stats.missCycles += done - issue;
+        uint64_t lo = issue, hi = done;
+        auto it = misses.upper_bound(lo);
+        if (it != misses.begin() && prev(it)->second >= lo) --it;
+        while (it != misses.end() && it->first <= hi) {
+            lo = min(lo, it->first);
+            hi = max(hi, it->second);
+            it = misses.erase(it);
+        }
+        misses[lo] = hi;
+    }
+
+    // commit, in order, `width` a cycle
+    uint64_t c = max(complete, lastCommit);
+    if (c == lastCommit && commitSlots == config.width) c++;
+    if (c == lastCommit) {
+        commitSlots++;
+    } else {
+        lastCommit = c;
+        commitSlots = 1;
+    }
+
+    rsIssue.push(issue);
+    inFlight.push_back(c);
+    robCommit[retired % config.rob] = c;
+    if (memOp) {
+        memInFlight.push_back(c);
+        lsqCommit[memOps % config.lsq] = c;
+        memOps++;
+    }
+
+    // a path change the front end didn't predict
+    if (redirects(r)) {
+        uint64_t redirect = (r.flags & (RETIRE_BRANCH | RETIRE_INDIRECT)) ? complete + 1 : d + 1;
+        fetchReady = max(fetchReady, redirect);
+    }
+
+    retired++;
+    stats.instructions++;
+    stats.cycles = lastCommit + 1;
+}
+
+void OooModel::finish() {
+    closeMisses(UINT64_MAX);
+}
+
+static void runModel() {
+    RetiredInstr batch[OOO_BATCH];
+    while (true) {
+        size_t n = ooo_ring->popBulk(batch, OOO_BATCH);
+        if (n == 0) {
+            if (ooo_ring->drained()) return;
+            this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < n; i++)
+            ooo.retire(batch[i]);
+    }
+}
+
+static void flushPending() {
+    const RetiredInstr* items = ooo_pending.data();
+    size_t left = ooo_pending.size();
+    while (left) {
+        size_t n = ooo_ring->pushBulk(items, left);
+        if (n == 0) this_thread::yield();
+        items += n;
+        left -= n;
+    }
+    ooo_pending.clear();
+}
+
+void ooo_start(const OooConfig& cfg) {
+    ooo.reset(cfg);
+    ooo_ring.reset(new SpscRing<RetiredInstr>(OOO_RING));
+    ooo_pending.clear();
+    ooo_pending.reserve(OOO_BATCH);
+    ooo_thread = thread(runModel);
+    ooo_enabled = true;
+}
+
+void ooo_feed(const RetiredInstr& r) {
+    ooo_pending.push_back(r);
+    if (ooo_pending.size() == OOO_BATCH) flushPending();
+}
+
+void ooo_finish() {
+    if (!ooo_enabled) return;
+    flushPending();
+    ooo_ring->close();
+    ooo_thread.join();
+    ooo.finish();
+    ooo_enabled = false;
+}
+
+bool write_ooo_report(const char* filename) {
+    ofstream out(filename);
+    if (!out) return false;
+
+    out << "structure,entries,dispatches\n";
+    const pair<const char*, const vector<uint64_t>*> hists[] = {
+        {"rob", &ooo.stats.robOccupancy}, {"rs", &ooo.stats.rsOccupancy}, {"lsq", &ooo.stats.lsqOccupancy}};
+    for (const auto& h : hists)
+        for (size_t i = 0; i < h.second->size(); i++)
+            if ((*h.second)[i]) out << h.first << ',' << i << ',' << (*h.second)[i] << '\n';
+    return static_cast<bool>(out);
+}
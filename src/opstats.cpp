@@ -0,0 +1,108 @@
+#include "opstats.h"
+/**
+ * @file opstats.cpp
+ * @brief Opcode mix and n-gram reports
+ */
+
+#include <algorithm>
+#include <sstream>
+
+OpcodeStats opstats;
+bool opstats_enabled = false;
+
+// "ADD" rather than the padded "OP_ADD  " the stream operator prints
+static string mnemonic(uint32_t op) {
+    stringstream ss;
+    ss << static_cast<Opcode>(op);
+    string name = ss.str();
+    if (name.compare(0, 3, "OP_") == 0) name = name.substr(3);
+    name.erase(name.find_last_not_of(' ') + 1);
+    return name;
+}
+
+static string sequence(size_t key, int length) {
+    string out;
+    for (int i = length - 1; i >= 0; i--) {
+        size_t op = key;
+        for (int j = 0; j < i; j++)
+            op /= OPCODE_SLOTS;
+        out += mnemonic(op % OPCODE_SLOTS);
+        if (i) out += ' ';
+    }
+    return out;
+}
+
+// (count, index) of every non-zero counter, largest first
+static vector<pair<uint64_t, size_t>> ranked(const uint64_t* counts, size_t n) {
+    vector<pair<uint64_t, size_t>> out;
+    for (size_t i = 0; i < n; i++)
+        if (counts[i]) out.emplace_back(counts[i], i);
+    sort(out.begin(), out.end(), [](const pair<uint64_t, size_t>& a, const pair<uint64_t, size_t>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    return out;
+}
+
+void OpcodeStats::reset() {
+    total = 0;
+    fill(begin(mix), end(mix), 0);
+    pairs.assign(OPCODE_SLOTS * OPCODE_SLOTS, 0);
+    triples.assign(OPCODE_SLOTS * OPCODE_SLOTS * OPCODE_SLOTS, 0);
+    traps.clear();
+    fill(begin(taken), end(taken), 0);
+    fill(begin(notTaken), end(notTaken), 0);
+    prev1 = prev2 = 0;
+}
+
+bool OpcodeStats::writeReport(const char* filename, size_t top) const {
+    ofstream out(filename);
+    if (!out) return false;
+
+    const auto percent = [](uint64_t part, uint64_t whole) { return whole ? 100.0 * part / whole : 0.0; };
+    out << fixed << setprecision(2);
+
+    out << "Instructions executed: " << total << "\n\nOpcode mix\n";
+    for (const auto& e : ranked(mix, OPCODE_SLOTS))
+        out << "  " << left << setw(8) << mnemonic(e.second) << right << setw(14) << e.first << setw(9)
+            << percent(e.first, total) << "%\n";
+
+    const auto section = [&](const char* title, const vector<uint64_t>& counts, int length) {
+        vector<pair<uint64_t, size_t>> rows = ranked(counts.data(), counts.size());
+        out << '\n' << title << " (top " << min(top, rows.size()) << " of " << rows.size() << ")\n";
+        for (size_t i = 0; i < min(top, rows.size()); i++)
+            out << "  " << left << setw(24) << sequence(rows[i].second, length) << right << setw(14)
+                << rows[i].first << setw(9) << percent(rows[i].first, total) << "%\n";
+    };
+    section("Opcode pairs", pairs, 2);
+    section("Opcode triples", triples, 3);
+
+    out << "\nTRP immediates\n";
+    for (const auto& t : traps)
+        out << "  #" << left << setw(7) << t.first << right << setw(14) << t.second << '\n';
+
+    out << "\nBranches" << setw(25) << "taken" << setw(14) << "not taken" << setw(10) << "taken %\n";
+    for (uint32_t op = OP_BNZ; op <= OP_BRZ; op++)
+        out << "  " << left << setw(8) << mnemonic(op) << right << setw(23) << taken[op] << setw(14)
+            << notTaken[op] << setw(9) << percent(taken[op], taken[op] + notTaken[op]) << "%\n";
+    return static_cast<bool>(out);
+}
+
+bool OpcodeStats::writeCsv(const char* filename) const {
+    ofstream out(filename);
+    if (!out) return false;
+
+    out << "kind,key,count\n";
+    for (const auto& e : ranked(mix, OPCODE_SLOTS))
+        out << "op," << mnemonic(e.second) << ',' << e.first << '\n';
+    for (const auto& e : ranked(pairs.data(), pairs.size()))
+        out << "pair," << sequence(e.second, 2) << ',' << e.first << '\n';
+    for (const auto& e : ranked(triples.data(), triples.size()))
+        out << "triple," << sequence(e.second, 3) << ',' << e.first << '\n';
+    for (const auto& t : traps)
+        out << "trp," << t.first << ',' << t.second << '\n';
+    for (uint32_t op = OP_BNZ; op <= OP_BRZ; op++) {
+        out << "taken," << mnemonic(op) << ',' << taken[op] << '\n';
+        out << "not_taken," << mnemonic(op) << ',' << notTaken[op] << '\n';
+    }
+    return static_cast<bool>(out);
+}
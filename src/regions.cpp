@@ -0,0 +1,55 @@
+#include "regions.h"
+
+#include "cache.h"
+/**
+ * @file regions.cpp
+ * @brief Per-region memory statistics
+ */
+
+#include <sstream>
+
+RegionStats region_stats[REGION_COUNT];
+bool region_stats_enabled = false;
+MemRegion current_region = REGION_CODE;
+
+void region_stats_start() {
+    for (RegionStats& r : region_stats)
+        r = RegionStats();
+    current_region = REGION_CODE;
+    region_stats_enabled = true;
+    cache_model.regionStats = region_stats;
+}
+
+bool write_region_report(const char* filename) {
+    static const char* NAMES[REGION_COUNT] = {"code/data", "heap", "stack", "free"};
+
+    ofstream out(filename);
+    if (!out) return false;
+
+    // boundaries as the program left them
+    const uint32_t bounds[REGION_COUNT][2] = {
+        {0, reg_file[SL]},
+        {reg_file[SL], reg_file[HP]},
+        {reg_file[SP], reg_file[SB]},
+        {reg_file[HP], reg_file[SP]}};
+
+    uint64_t totalCycles = 0;
+    for (const RegionStats& r : region_stats)
+        totalCycles += r.cycles;
+
+    out << left << setw(11) << "region" << setw(26) << "range at exit" << right
+        << setw(12) << "reads" << setw(12) << "writes" << setw(12) << "hits" << setw(12) << "misses"
+        << setw(14) << "cycles" << setw(10) << "% cycles" << '\n';
+
+    for (int i = 0; i < REGION_COUNT; i++) {
+        const RegionStats& r = region_stats[i];
+        stringstream range;
+        range << "[0x" << hex << bounds[i][0] << ", 0x" << bounds[i][1] << ')';
+
+        out << left << setw(11) << NAMES[i] << setw(26) << range.str() << right
+            << setw(12) << r.reads << setw(12) << r.writes << setw(12) << r.hits << setw(12) << r.misses
+            << setw(14) << r.cycles << setw(10) << fixed << setprecision(2)
+            << (totalCycles ? 100.0 * r.cycles / totalCycles : 0.0) << '\n';
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,160 @@
+#include "retire.h"
+/**
+ * @file retire.cpp
+ * @brief Register and memory footprint of retired instructions
+ */
+
+#include "costs.h"
+#include "mmu.h"
+
+RetiredInstr retired_instr(uint32_t fallthrough, uint64_t fetchCycles, uint64_t memCycles) {
+    RetiredInstr r;
+    r.pc = fallthrough - 8;
+    r.nextPc = reg_file[PC];
+    r.op = static_cast<uint8_t>(cntrl_regs[OPERATION]);
+    r.fetchCycles = static_cast<uint32_t>(fetchCycles);
+    if (cost_model.executeCosts && !functional_mode) r.exCycles = cost_model.execute[r.op & (COST_OPCODES - 1)];
+    r.memCycles = static_cast<uint32_t>(memCycles - r.exCycles);
+    if (r.nextPc != fallthrough) r.flags |= RETIRE_TAKEN;
+
+    const uint8_t op1 = static_cast<uint8_t>(cntrl_regs[OPERAND_1]);
+    const uint8_t op2 = static_cast<uint8_t>(cntrl_regs[OPERAND_2]);
+    const uint8_t op3 = static_cast<uint8_t>(cntrl_regs[OPERAND_3]);
+
+    switch (r.op) {
+        case OP_JMP:
+            r.flags |= RETIRE_JUMP;
+            r.target = cntrl_regs[IMMEDIATE];
+            break;
+        case OP_JMR:
+            r.flags |= RETIRE_JUMP | RETIRE_INDIRECT;
+            r.src[0] = op1;
+            break;
+        case OP_BNZ:
+        case OP_BGT:
+        case OP_BLT:
+        case OP_BRZ:
+            r.flags |= RETIRE_BRANCH;
+            r.src[0] = op1;
+            r.target = cntrl_regs[IMMEDIATE];
+            break;
+
+        case OP_MOV:
+            r.dst[0] = op1;
+            r.src[0] = op2;
+            break;
+        case OP_MOVI:
+        case OP_LDA:
+            r.dst[0] = op1;
+            break;
+        case OP_STR:
+        case OP_STB:
+            r.flags |= RETIRE_STORE;
+            r.src[0] = op1;
+            r.memAccesses = 1;
+            break;
+        case OP_LDR:
+        case OP_LDB:
+            r.flags |= RETIRE_LOAD;
+            r.dst[0] = op1;
+            r.memAccesses = 1;
+            break;
+        case OP_ISTR:
+        case OP_ISTB:
+            r.flags |= RETIRE_STORE;
+            r.src[0] = op1;
+            r.src[1] = op2;
+            r.memAccesses = 1;
+            break;
+        case OP_ILDR:
+        case OP_ILDB:
+            r.flags |= RETIRE_LOAD;
+            r.dst[0] = op1;
+            r.src[0] = op2;
+            r.memAccesses = 1;
+            break;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_SDIV:
+        case OP_AND:
+        case OP_OR:
+        case OP_CMP:
+            r.dst[0] = op1;
+            r.src[0] = op2;
+            r.src[1] = op3;
+            break;
+        case OP_ADDI:
+        case OP_SUBI:
+        case OP_MULI:
+        case OP_DIVI:
+        case OP_CMPI:
+            r.dst[0] = op1;
+            r.src[0] = op2;
+            break;
+
+        case OP_TRP:
+            // reads go through R3, TRP #98 reads everything but only prints
+            if (cntrl_regs[IMMEDIATE] == 2 || cntrl_regs[IMMEDIATE] == 4 || cntrl_regs[IMMEDIATE] == TRP_PT_GET)
+                r.dst[0] = R3;
+            else
+                r.src[0] = R3;
+            if (cntrl_regs[IMMEDIATE] == 5) r.flags |= RETIRE_LOAD;
+            if (cntrl_regs[IMMEDIATE] == 6) r.flags |= RETIRE_STORE;
+            break;
+
+        case OP_ALCI:
+            r.dst[0] = op1;
+            r.dst[1] = HP;
+            r.src[0] = HP;
+            break;
+        case OP_ALLC:
+            r.flags |= RETIRE_LOAD;
+            r.dst[0] = op1;
+            r.dst[1] = HP;
+            r.src[0] = HP;
+            r.memAccesses = 1;
+            break;
+        case OP_IALLC:
+            r.flags |= RETIRE_LOAD;
+            r.dst[0] = op1;
+            r.dst[1] = HP;
+            r.src[0] = HP;
+            r.src[1] = op2;
+            r.memAccesses = 1;
+            break;
+
+        case OP_PSHR:
+        case OP_PSHB:
+            r.flags |= RETIRE_STORE;
+            r.dst[0] = SP;
+            r.src[0] = op1;
+            r.src[1] = SP;
+            r.memAccesses = 1;
+            break;
+        case OP_POPR:
+        case OP_POPB:
+            r.flags |= RETIRE_LOAD;
+            r.dst[0] = op1;
+            r.dst[1] = SP;
+            r.src[0] = SP;
+            r.memAccesses = 1;
+            break;
+        case OP_CALL:
+            r.flags |= RETIRE_JUMP | RETIRE_STORE;
+            r.target = cntrl_regs[IMMEDIATE];
+            r.dst[0] = SP;
+            r.src[0] = SP;
+            r.memAccesses = 1;
+            break;
+        case OP_RET:
+            r.flags |= RETIRE_JUMP | RETIRE_INDIRECT | RETIRE_LOAD;
+            r.dst[0] = SP;
+            r.src[0] = SP;
+            r.memAccesses = 1;
+            break;
+    }
+    return r;
+}
@@ -0,0 +1,47 @@
+#include "roi.h"
+/**
+ * @file roi.cpp
+ * @brief Region of interest markers
+ */
+
+#include "cache.h"
+
+RoiStats roi_stats;
+bool roi_active = false;
+bool roi_only = false;
+
+static RoiStats roi_mark;  // counters when the open region began
+
+void roi_start(bool only) {
+    roi_stats = RoiStats();
+    roi_active = false;
+    roi_only = only;
+    if (only) set_functional_mode(true);
+}
+
+void roi_begin() {
+    if (roi_active) return;
+    if (roi_only) set_functional_mode(false);
+    if (cache_pipelined) sync_cache_pipeline();
+
+    roi_mark.instructions = instructions_retired + 1;  // the marker itself retires after this
+    roi_mark.cycles = mem_cycle_cntr;
+    roi_mark.hits = cache_model.stats.hits;
+    roi_mark.misses = cache_model.stats.misses;
+    roi_mark.writebacks = cache_model.stats.writebacks;
+    roi_active = true;
+}
+
+void roi_end() {
+    if (!roi_active) return;
+    if (cache_pipelined) sync_cache_pipeline();
+
+    roi_stats.regions++;
+    roi_stats.instructions += instructions_retired - roi_mark.instructions;
+    roi_stats.cycles += mem_cycle_cntr - roi_mark.cycles;
+    roi_stats.hits += cache_model.stats.hits - roi_mark.hits;
+    roi_stats.misses += cache_model.stats.misses - roi_mark.misses;
+    roi_stats.writebacks += cache_model.stats.writebacks - roi_mark.writebacks;
+    roi_active = false;
+    if (roi_only) set_functional_mode(true);
+}
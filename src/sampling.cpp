@@ -0,0 +1,148 @@
+#include "sampling.h"
+/**
+ * @file sampling.cpp
+ * @brief Sampled simulation with functional fast-forward
+ */
+
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#include "cache.h"
+
+enum SamplePhase : std::uint8_t { PHASE_FAST, PHASE_WARM, PHASE_DETAIL, PHASE_DONE };
+
+struct SampleWindow {
+    double cpi;
+    double missRatio;
+};
+
+bool sampling_enabled = false;
+uint64_t sampling_next = UINT64_MAX;
+
+static SampleConfig sample_cfg;
+static SamplePhase sample_phase = PHASE_DONE;
+static std::vector<SampleWindow> sample_windows;
+static uint64_t window_start = 0;  // instruction count, cycles, hits and misses when the window opened
+static uint64_t window_cycles = 0;
+static uint64_t window_hits = 0;
+static uint64_t window_misses = 0;
+
+bool parseSampleSpec(const string& spec, SampleConfig& cfg) {
+    uint64_t v[4];
+    stringstream in(spec);
+    string field;
+    for (int i = 0; i < 4; i++) {
+        if (!getline(in, field, ',') || field.empty() || field.find_first_not_of("0123456789") != string::npos)
+            return false;
+        v[i] = stoull(field);
+    }
+    if (getline(in, field) || v[2] == 0 || v[3] == 0 || v[3] > UINT32_MAX) return false;
+
+    cfg.fastForward = v[0];
+    cfg.warmup = v[1];
+    cfg.detail = v[2];
+    cfg.samples = static_cast<uint32_t>(v[3]);
+    return true;
+}
+
+// the pipelined cache's counters lag execution, so every window edge waits for it
+static void catchUp() {
+    if (cache_pipelined) sync_cache_pipeline();
+}
+
+static void enter(SamplePhase phase, uint64_t length) {
+    sample_phase = phase;
+    sampling_next = phase == PHASE_DONE ? UINT64_MAX : instructions_retired + length;
+}
+
+// leaves the current phase for the next one
+static void advance() {
+    switch (sample_phase) {
+        case PHASE_FAST:
+            set_functional_mode(false);
+            enter(PHASE_WARM, sample_cfg.warmup);
+            break;
+
+        case PHASE_WARM:
+            catchUp();
+            window_start = instructions_retired;
+            window_cycles = mem_cycle_cntr;
+            window_hits = cache_model.stats.hits;
+            window_misses = cache_model.stats.misses;
+            enter(PHASE_DETAIL, sample_cfg.detail);
+            break;
+
+        case PHASE_DETAIL: {
+            catchUp();
+            uint64_t hits = cache_model.stats.hits - window_hits;
+            uint64_t misses = cache_model.stats.misses - window_misses;
+            SampleWindow w;
+            w.cpi = static_cast<double>(mem_cycle_cntr - window_cycles) / (instructions_retired - window_start);
+            w.missRatio = hits + misses ? static_cast<double>(misses) / (hits + misses) : 0.0;
+            sample_windows.push_back(w);
+
+            // without a fast-forward the cache stays warm into the next window
+            if (sample_windows.size() == sample_cfg.samples) {
+                set_functional_mode(true);
+                enter(PHASE_DONE, 0);
+            } else {
+                if (sample_cfg.fastForward) set_functional_mode(true);
+                enter(PHASE_FAST, sample_cfg.fastForward);
+            }
+            break;
+        }
+
+        case PHASE_DONE:
+            break;
+    }
+}
+
+void sampling_start(const SampleConfig& cfg) {
+    sample_cfg = cfg;
+    sample_windows.clear();
+    sample_windows.reserve(cfg.samples);
+    sampling_enabled = true;
+
+    set_functional_mode(true);
+    enter(PHASE_FAST, cfg.fastForward);
+    sampling_event();
+    if (sampling_next < next_event) next_event = sampling_next;
+}
+
+void sampling_event() {
+    // zero length fast-forwards and warm-ups end as soon as they start
+    while (sampling_next == instructions_retired)
+        advance();
+}
+
+SampleEstimate sampling_finish() {
+    SampleEstimate est;
+    if (!sampling_enabled) return est;
+
+    sampling_enabled = false;
+    sampling_next = UINT64_MAX;
+    set_functional_mode(false);
+
+    est.windows = static_cast<uint32_t>(sample_windows.size());
+    est.instructions = instructions_retired;
+    if (sample_windows.empty()) return est;
+
+    double sum = 0, missSum = 0;
+    for (const SampleWindow& w : sample_windows) {
+        sum += w.cpi;
+        missSum += w.missRatio;
+    }
+    est.cpi = sum / est.windows;
+    est.missRatio = missSum / est.windows;
+    est.cycles = est.cpi * est.instructions;
+
+    if (est.windows > 1) {
+        double var = 0;
+        for (const SampleWindow& w : sample_windows)
+            var += (w.cpi - est.cpi) * (w.cpi - est.cpi);
+        var /= est.windows - 1;
+        est.cyclesHalfWidth = 1.96 * std::sqrt(var / est.windows) * est.instructions;
+    }
+    return est;
+}
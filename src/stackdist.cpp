@@ -0,0 +1,159 @@
+#include "stackdist.h"
+/**
+ * @file stackdist.cpp
+ * @brief Single-pass LRU stack distance analysis and miss-ratio curve output
+ */
+
+#include <algorithm>
+
+constexpr uint32_t INITIAL_TIMELINE = 1u << 16;
+constexpr uint32_t SAMPLE_MODULUS = 1u << 24;
+
+StackDistance stackdist;
+bool stackdist_enabled = false;
+
+// murmur3 finalizer, spreads neighbouring block numbers across the whole sample space
+static uint32_t hashBlock(uint32_t block) {
+    block ^= block >> 16;
+    block *= 0x85EBCA6Bu;
+    block ^= block >> 13;
+    block *= 0xC2B2AE35u;
+    block ^= block >> 16;
+    return block;
+}
+
+bool StackDistance::init(uint32_t granularity, double sampleRate) {
+    if (granularity == 0 || (granularity & (granularity - 1)) != 0) return false;
+    if (!(sampleRate > 0.0) || sampleRate > 1.0) return false;
+
+    shift = 0;
+    while ((1u << shift) < granularity) shift++;
+
+    rate = sampleRate;
+    threshold = static_cast<uint32_t>(sampleRate * SAMPLE_MODULUS);
+    if (threshold == 0) threshold = 1;
+
+    now = 1;
+    tree.assign(INITIAL_TIMELINE + 1, 0);
+    lastseen.clear();
+    for (int c = 0; c < 2; c++) {
+        hist[c].clear();
+        cold[c] = 0;
+        refs[c] = 0;
+    }
+    return true;
+}
+
+void StackDistance::mark(uint32_t t, int delta) {
+    for (; t < tree.size(); t += t & (~t + 1))
+        tree[t] += delta;
+}
+
+uint32_t StackDistance::prefix(uint32_t t) const {
+    uint32_t sum = 0;
+    for (; t > 0; t -= t & (~t + 1))
+        sum += tree[t];
+    return sum;
+}
+
+// the timeline only needs one slot per live block, so once it fills up the surviving timestamps are
+// renumbered 1..k in order and the tree is rebuilt. Amortized over the accesses that filled it, this is O(1).
+void StackDistance::compact() {
+    std::vector<std::pair<uint32_t, uint32_t>> order;  // (time, block)
+    order.reserve(lastseen.size());
+    for (const auto& kv : lastseen)
+        order.emplace_back(kv.second, kv.first);
+    sort(order.begin(), order.end());
+
+    size_t capacity = std::max<size_t>(INITIAL_TIMELINE, order.size() * 2);
+    tree.assign(capacity + 1, 0);
+
+    uint32_t t = 0;
+    for (const auto& entry : order) {
+        lastseen[entry.second] = ++t;
+        mark(t, 1);
+    }
+    now = t + 1;
+}
+
+void StackDistance::access(uint32_t address, AccessClass cls) {
+    uint32_t block = address >> shift;
+    if (threshold < SAMPLE_MODULUS && (hashBlock(block) & (SAMPLE_MODULUS - 1)) >= threshold) return;
+
+    if (now >= tree.size()) compact();
+
+    refs[cls]++;
+
+    auto it = lastseen.find(block);
+    if (it == lastseen.end()) {
+        cold[cls]++;
+        lastseen.emplace(block, now);
+    } else {
+        // every live block has exactly one mark, so the blocks touched after `it->second` are the ones past it
+        uint32_t distance = static_cast<uint32_t>(lastseen.size()) - prefix(it->second);
+        if (distance >= hist[cls].size()) hist[cls].resize(distance + 1, 0);
+        hist[cls][distance]++;
+
+        mark(it->second, -1);
+        it->second = now;
+    }
+    mark(now, 1);
+    now++;
+}
+
+double StackDistance::missRatio(uint64_t lines, int cls) const {
+    uint64_t misses = 0;
+    uint64_t total = 0;
+
+    for (int c = 0; c < 2; c++) {
+        if (cls >= 0 && cls != c) continue;
+        total += refs[c];
+        misses += cold[c];
+
+        // a sampled distance d stands for d / rate real blocks
+        for (size_t d = 0; d < hist[c].size(); d++)
+            if (d >= lines * rate) misses += hist[c][d];
+    }
+    return total ? static_cast<double>(misses) / total : 0.0;
+}
+
+bool StackDistance::write(const char* filename) const {
+    ofstream out(filename);
+    if (!out) return false;
+
+    size_t depth = std::max(hist[CLASS_IFETCH].size(), hist[CLASS_DATA].size());
+
+    // suffix sums turn the histogram into miss counts, misses(k) = cold + accesses with distance >= k
+    std::vector<uint64_t> misses[2];
+    for (int c = 0; c < 2; c++) {
+        misses[c].assign(depth + 1, cold[c]);
+        uint64_t running = cold[c];
+        for (size_t d = depth; d-- > 0;) {
+            if (d < hist[c].size()) running += hist[c][d];
+            misses[c][d] = running;
+        }
+        misses[c][depth] = cold[c];
+    }
+
+    const auto ratio = [](uint64_t m, uint64_t n) { return n ? static_cast<double>(m) / n : 0.0; };
+
+    const auto row = [&](uint64_t lines, uint64_t mi, uint64_t md) {
+        out << lines << ',' << (lines << shift) << ','
+            << ratio(mi + md, refs[CLASS_IFETCH] + refs[CLASS_DATA]) << ','
+            << ratio(mi, refs[CLASS_IFETCH]) << ','
+            << ratio(md, refs[CLASS_DATA]) << '\n';
+    };
+
+    out << "lines,bytes,miss_ratio,ifetch_miss_ratio,data_miss_ratio\n";
+    out << setprecision(6) << fixed;
+    // a cache with no lines misses everything; the point also keeps a run without any reuse from writing no rows
+    row(0, refs[CLASS_IFETCH], refs[CLASS_DATA]);
+    uint64_t lastLines = 0;
+    for (size_t k = 1; k <= depth; k++) {
+        uint64_t lines = static_cast<uint64_t>((k / rate) + 0.5);
+        if (lines == lastLines) continue;
+        lastLines = lines;
+        row(lines, misses[CLASS_IFETCH][k], misses[CLASS_DATA][k]);
+    }
+    return static_cast<bool>(out);
+}
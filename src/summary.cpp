@@ -0,0 +1,120 @@
+#include "summary.h"
+/**
+ * @file summary.cpp
+ * @brief JSON run summary
+ */
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#include "bpred.h"
+#include "cache.h"
+#include "dram.h"
+#include "inorder.h"
+#include "mmu.h"
+#include "ooo.h"
+#include "roi.h"
+
+using namespace std;
+
+bool summary_enabled = false;
+uint32_t stack_low = UINT32_MAX;
+
+static string summary_file;
+static chrono::steady_clock::time_point summary_clock;
+
+void summary_start(const char* filename) {
+    summary_file = filename;
+    summary_clock = chrono::steady_clock::now();
+    stack_low = reg_file[SP];
+    summary_enabled = true;
+}
+
+bool summary_write(const char* status) {
+    if (!summary_enabled) return false;
+    summary_enabled = false;
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - summary_clock).count();
+    if (cache_pipelined) sync_cache_pipeline();
+    ooo_finish();
+
+    ofstream out(summary_file);
+    if (!out) return false;
+
+    const CacheStats& c = cache_model.stats;
+    uint64_t n = instructions_retired;
+    uint32_t low = stack_low < reg_file[SP] ? stack_low : reg_file[SP];
+    out << "{\n"
+        << "  \"status\": \"" << status << "\",\n"
+        << "  \"instructions\": " << n << ",\n"
+        << "  \"cycles\": " << mem_cycle_cntr << ",\n"
+        << "  \"cpi\": " << (n ? static_cast<double>(mem_cycle_cntr) / n : 0.0) << ",\n"
+        << "  \"host_seconds\": " << seconds << ",\n"
+        << "  \"host_ns_per_instruction\": " << (n ? seconds * 1e9 / n : 0.0) << ",\n"
+        << "  \"cache\": {\"enabled\": " << (cacheUsed ? "true" : "false") << ", \"hits\": " << c.hits
+        << ", \"misses\": " << c.misses << ", \"writebacks\": " << c.writebacks << ", \"victim_hits\": "
+        << c.victimHits << ", \"evictions\": " << c.evictions << ", \"split_words\": " << c.splits
+        << ", \"batched_fills\": " << c.batchedFills << "},\n";
+    if (roi_stats.regions)
+        out << "  \"roi\": {\"regions\": " << roi_stats.regions << ", \"instructions\": " << roi_stats.instructions
+            << ", \"cycles\": " << roi_stats.cycles << ", \"hits\": " << roi_stats.hits << ", \"misses\": "
+            << roi_stats.misses << ", \"writebacks\": " << roi_stats.writebacks << "},\n";
+    if (cacheUsed && cache_model.mshrCount)
+        out << "  \"mshr\": {\"entries\": " << cache_model.mshrCount << ", \"secondary_misses\": "
+            << c.secondaryMisses << ", \"stall_cycles\": " << c.mshrStallCycles << ", \"mlp\": " << c.mlp()
+            << ", \"cycles\": " << c.cycles << ", \"blocking_cycles\": " << c.blockingCycles << "},\n";
+    if (cacheUsed && cache_model.sectorsPerLine > 1)
+        out << "  \"sectors\": {\"size\": " << cache_model.sectorSize << ", \"fill\": " << cache_model.sectorFill
+            << ", \"sector_misses\": " << c.sectorMisses << ", \"filled\": " << c.sectorFills
+            << ", \"evicted\": " << c.evictedSectors << ", \"evicted_valid\": " << c.evictedValid
+            << ", \"evicted_used\": " << c.evictedUsed << ", \"utilization\": " << c.sectorUtilization() << "},\n";
+    if (cacheUsed && cache_model.partition != PARTITION_NONE) {
+        out << "  \"partitions\": {\"mode\": \"" << (cache_model.partition == PARTITION_FIXED ? "fixed" : "ucp")
+            << "\", \"resizes\": " << c.repartitions;
+        for (uint32_t p = 0; p < PART_COUNT; p++)
+            out << ", \"" << partition_name(static_cast<CachePartition>(p)) << "\": {\"ways\": " << cache_model.quota[p]
+                << ", \"hits\": " << c.partHits[p] << ", \"misses\": " << c.partMisses[p] << "}";
+        out << "},\n";
+    }
+    if (mmu_enabled) {
+        const TlbStats& t = mmu.stats;
+        out << "  \"tlb\": {\"entries\": " << mmu.configuration().entries << ", \"page_size\": "
+            << mmu.configuration().pageSize << ", \"hits\": " << t.hits << ", \"misses\": " << t.misses
+            << ", \"walk_cycles\": " << t.walkCycles << ", \"page_faults\": " << t.faults << "},\n";
+    }
+    if (dram_enabled) {
+        const DramStats& d = dram.stats;
+        out << "  \"dram\": {\"reads\": " << d.reads << ", \"writes\": " << d.writes << ", \"row_hits\": "
+            << d.rowHits << ", \"row_misses\": " << d.rowMisses << ", \"row_conflicts\": " << d.rowConflicts
+            << ", \"cycles\": " << d.cycles << "},\n";
+    }
+    if (inorder_enabled) {
+        const PipelineStats& p = inorder.stats;
+        out << "  \"pipeline\": {\"cycles\": " << p.cycles << ", \"instructions\": " << p.instructions << ", \"cpi\": "
+            << (p.instructions ? static_cast<double>(p.cycles) / p.instructions : 0.0) << ", \"stalls\": {";
+        for (uint32_t c = 0; c < STALL_COUNT; c++)
+            out << (c ? ", \"" : "\"") << stall_cause_name(static_cast<StallCause>(c)) << "\": " << p.stalls[c];
+        out << "}},\n";
+    }
+    if (bpred_enabled) {
+        out << "  \"branch_predictors\": [";
+        for (size_t i = 0; i < bpred_units.size(); i++) {
+            const BranchStats& b = bpred_units[i].stats;
+            out << (i ? ", " : "") << "{\"name\": \"" << predictor_name(bpred_units[i].kind)
+                << "\", \"branches\": " << b.branches << ", \"direction_misses\": " << b.directionMisses
+                << ", \"jumps\": " << b.jumps << ", \"target_misses\": " << b.targetMisses << ", \"mpki\": "
+                << (bpred_instructions ? 1000.0 * b.mispredicts() / bpred_instructions : 0.0) << "}";
+        }
+        out << "],\n";
+    }
+    if (ooo.stats.instructions) {
+        const OooStats& o = ooo.stats;
+        out << "  \"ooo\": {\"cycles\": " << o.cycles << ", \"instructions\": " << o.instructions << ", \"ipc\": "
+            << o.ipc() << ", \"mlp\": " << o.mlp() << "},\n";
+    }
+    out << "  \"peak_stack_bytes\": " << (reg_file[SB] > low ? reg_file[SB] - low : 0) << ",\n"
+        << "  \"final_hp\": " << reg_file[HP] << "\n"
+        << "}\n";
+    return static_cast<bool>(out);
+}
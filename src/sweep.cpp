@@ -0,0 +1,286 @@
+#include "sweep.h"
+/**
+ * @file sweep.cpp
+ * @brief Parallel cache configuration sweeps
+ */
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <sstream>
+
+// what a sweep child reports back to the parent through its pipe
+struct SweepResult {
+    uint64_t cycles = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t writebacks = 0;
+    uint64_t victimHits = 0;
+    double hostMs = 0.0;
+    bool completed = false;
+    uint8_t stop = STOP_NONE;  // StopReason, for SWEEP_STOPPED
+};
+
+enum SweepStatus {
+    SWEEP_PENDING,
+    SWEEP_OK,
+    SWEEP_INVALID_CONFIG,
+    SWEEP_LOAD_FAILED,
+    SWEEP_INVALID_INSTRUCTION,
+    SWEEP_STOPPED  // hit one of the run limits, named in the status column
+};
+
+static const char* POLICY_NAMES[] = {"lru", "fifo", "random"};
+static const char* PARTITION_MODES[] = {"none", "fixed", "ucp"};
+static const char* STATUS_NAMES[] = {"pending", "ok", "invalid_config", "load_failed", "invalid_instruction",
+                                     "stopped"};
+
+static bool parseValues(const string& key, const string& list, vector<uint32_t>& out) {
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty()) return false;
+
+        if (key == "policy") {
+            if (item == "lru")
+                out.push_back(POLICY_LRU);
+            else if (item == "fifo")
+                out.push_back(POLICY_FIFO);
+            else if (item == "random")
+                out.push_back(POLICY_RANDOM);
+            else
+                return false;
+        } else if (key == "partition") {
+            uint32_t mode = 0;
+            while (mode <= PARTITION_UTILITY && item != PARTITION_MODES[mode])
+                mode++;
+            if (mode > PARTITION_UTILITY) return false;
+            out.push_back(mode);
+        } else if (key == "assoc" && item == "full") {
+            out.push_back(0);
+        } else {
+            size_t pos;
+            unsigned long long v;
+            try {
+                v = stoull(item, &pos);
+            } catch (const exception&) {
+                return false;
+            }
+            if (pos != item.size() || (v == 0 && key != "victim" && key != "mshrs" && key != "sector" && key.compare(0, 5, "ways_") != 0) || v > UINT32_MAX) return false;
+            out.push_back(static_cast<uint32_t>(v));
+        }
+    }
+    return !out.empty();
+}
+
+// grid keys, outermost first
+static const char* GRID_KEYS[] = {"block", "lines", "assoc", "policy", "victim", "victim_latency", "mshrs",
+                                  "sector", "sector_fill", "partition", "ways_code", "ways_static", "ways_heap",
+                                  "ways_stack", "repartition"};
+
+// stores a value of `GRID_KEYS[key]` in `pt`
+static void setGridValue(SweepPoint& pt, size_t key, uint32_t v) {
+    switch (key) {
+        case 0: pt.blockSize = v; break;
+        case 1: pt.lines = v; break;
+        case 2: pt.ways = v; break;
+        case 3: pt.policy = static_cast<ReplacementPolicy>(v); break;
+        case 4: pt.victims = v; break;
+        case 5: pt.victimLatency = v; break;
+        case 6: pt.mshrs = v; break;
+        case 7: pt.sectorSize = v; break;
+        case 8: pt.sectorFill = v; break;
+        case 9: pt.partition = static_cast<PartitionMode>(v); break;
+        case 10: case 11: case 12: case 13: pt.quotas[key - 10] = v; break;
+        default: pt.repartition = v; break;
+    }
+}
+
+bool parseSweepGrid(const string& spec, vector<SweepPoint>& grid) {
+    map<string, vector<uint32_t>> axes = {
+        {"block", {BLOCK_SIZE}},
+        {"lines", {NUM_CACHE_LINES}},
+        {"assoc", {1}},
+        {"policy", {POLICY_LRU}},
+        {"victim", {0}},
+        {"victim_latency", {CacheConfig().victimLatency}},
+        {"mshrs", {0}},
+        {"sector", {0}},
+        {"sector_fill", {1}},
+        {"partition", {PARTITION_NONE}},
+        {"ways_code", {0}},
+        {"ways_static", {0}},
+        {"ways_heap", {0}},
+        {"ways_stack", {0}},
+        {"repartition", {CacheConfig().repartition}}};
+
+    stringstream ss(spec);
+    string group;
+    while (getline(ss, group, ';')) {
+        if (group.empty()) continue;
+
+        size_t eq = group.find('=');
+        if (eq == string::npos) return false;
+
+        string key = group.substr(0, eq);
+        if (!axes.count(key)) return false;
+
+        vector<uint32_t> values;
+        if (!parseValues(key, group.substr(eq + 1), values)) return false;
+        axes[key] = values;
+    }
+
+    // every combination, counting through the values like an odometer with the last key turning fastest
+    const size_t keys = sizeof(GRID_KEYS) / sizeof(GRID_KEYS[0]);
+    vector<size_t> at(keys, 0);
+    grid.clear();
+    while (true) {
+        SweepPoint pt;
+        for (size_t k = 0; k < keys; k++)
+            setGridValue(pt, k, axes[GRID_KEYS[k]][at[k]]);
+        grid.push_back(pt);
+
+        size_t k = keys;
+        while (k > 0 && ++at[k - 1] == axes[GRID_KEYS[k - 1]].size())
+            at[--k] = 0;
+        if (k == 0) break;
+    }
+    return true;
+}
+
+// body of a forked sweep child. Never returns. The cost and DRAM models come along with the fork.
+static void runSweepChild(const SweepPoint& pt,
+                          const string& binary,
+                          uint32_t memSize,
+                          const string& input,
+                          const RunLimits& limits,
+                          const MmuConfig* mmu,
+                          int fd) {
+    // guest output would interleave between children, only the result row matters
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+
+    istringstream guestIn(input);
+    cin.rdbuf(guestIn.rdbuf());
+
+    SweepResult result;
+    if (!init_mem(memSize) || !configure_cache(pt)) _exit(SWEEP_INVALID_CONFIG);
+    if (load_binary(binary.c_str()) != 0) _exit(SWEEP_LOAD_FAILED);
+    if (mmu && !mmu_start(*mmu)) _exit(SWEEP_INVALID_CONFIG);
+    set_run_limits(limits);
+
+    auto start = chrono::steady_clock::now();
+    result.completed = runLoop();
+    auto end = chrono::steady_clock::now();
+
+    result.cycles = mem_cycle_cntr;
+    result.hits = cache_model.stats.hits;
+    result.misses = cache_model.stats.misses;
+    result.writebacks = cache_model.stats.writebacks;
+    result.victimHits = cache_model.stats.victimHits;
+    result.hostMs = chrono::duration<double, milli>(end - start).count();
+    result.stop = stop_reason;
+
+    // smaller than PIPE_BUF, so the write is atomic. A short write shows up in the parent as a missing result.
+    ssize_t written = write(fd, &result, sizeof(result));
+    (void)written;
+    cout.flush();
+    _exit(!result.completed ? SWEEP_INVALID_INSTRUCTION : stop_reason != STOP_NONE ? SWEEP_STOPPED : SWEEP_OK);
+}
+
+int runSweep(const vector<SweepPoint>& grid,
+             const string& binary,
+             uint32_t memSize,
+             const string& input,
+             const string& csvFile,
+             unsigned jobs,
+             const RunLimits& limits,
+             const MmuConfig* mmu) {
+    vector<SweepResult> results(grid.size());
+    vector<SweepStatus> status(grid.size(), SWEEP_PENDING);
+    map<pid_t, pair<size_t, int>> running;  // pid -> (grid index, read end of its pipe)
+
+    if (jobs == 0) jobs = 1;
+    cout.flush();  // a child must not inherit and re-flush buffered output
+    cerr.flush();
+
+    size_t next = 0;
+    while (next < grid.size() || !running.empty()) {
+        while (next < grid.size() && running.size() < jobs) {
+            int fds[2];
+            if (pipe(fds) != 0) break;
+
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                runSweepChild(grid[next], binary, memSize, input, limits, mmu, fds[1]);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                close(fds[0]);
+                break;
+            }
+            running[pid] = make_pair(next, fds[0]);
+            next++;
+        }
+        if (running.empty()) return 1;  // couldn't start anything
+
+        int wstatus = 0;
+        pid_t done = waitpid(-1, &wstatus, 0);
+        if (done < 0) break;
+
+        auto it = running.find(done);
+        if (it == running.end()) continue;
+
+        size_t idx = it->second.first;
+        int fd = it->second.second;
+        running.erase(it);
+
+        SweepResult r;
+        bool gotResult = read(fd, &r, sizeof(r)) == sizeof(r);
+        close(fd);
+        if (gotResult) results[idx] = r;
+
+        if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) <= SWEEP_STOPPED)
+            status[idx] = static_cast<SweepStatus>(WEXITSTATUS(wstatus));
+        else
+            status[idx] = SWEEP_INVALID_INSTRUCTION;
+
+        // guest errors that exit the process directly never report back
+        if (!gotResult && (status[idx] == SWEEP_OK || status[idx] == SWEEP_STOPPED))
+            status[idx] = SWEEP_INVALID_INSTRUCTION;
+    }
+
+    ofstream file;
+    if (!csvFile.empty()) {
+        file.open(csvFile);
+        if (!file) return 2;
+    }
+    ostream& out = csvFile.empty() ? cout : file;
+
+    bool allOk = true;
+    out << "block_size,lines,assoc,policy,victim,mshrs,sector,sector_fill,partition,status,mem_cycle_cntr,hits,misses,writebacks,victim_hits,host_ms\n";
+    for (size_t i = 0; i < grid.size(); i++) {
+        const SweepPoint& pt = grid[i];
+        const SweepResult& r = results[i];
+        allOk = allOk && status[i] == SWEEP_OK;
+
+        out << pt.blockSize << ',' << pt.lines << ',' << (pt.ways ? pt.ways : pt.lines) << ','
+            << POLICY_NAMES[pt.policy] << ',' << pt.victims << ',' << pt.mshrs << ','
+            << (pt.sectorSize ? pt.sectorSize : pt.blockSize) << ',' << pt.sectorFill << ',' << PARTITION_MODES[pt.partition];
+        if (pt.partition == PARTITION_FIXED)
+            out << ':' << pt.quotas[PART_CODE] << '/' << pt.quotas[PART_STATIC] << '/' << pt.quotas[PART_HEAP] << '/'
+                << pt.quotas[PART_STACK];
+        const char* statusName =
+            status[i] == SWEEP_STOPPED ? stop_reason_name(static_cast<StopReason>(r.stop)) : STATUS_NAMES[status[i]];
+        out << ',' << statusName << ','
+            << r.cycles << ',' << r.hits << ',' << r.misses << ',' << r.writebacks << ',' << r.victimHits << ','
+            << fixed << setprecision(3) << r.hostMs << '\n';
+    }
+    out.flush();
+
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+#include "trace.h"
+/**
+ * @file trace.cpp
+ * @brief Memory access trace recording and set-partitioned replay
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include "costs.h"
+
+constexpr size_t TRACE_BUFFER = 1u << 16;  // records buffered before each write
+constexpr size_t SHARD_QUEUE = 1u << 14;   // records in flight per replay worker
+constexpr size_t SHARD_BATCH = 256;        // records handed to a worker per push
+
+bool trace_enabled = false;
+
+static FILE* trace_file = nullptr;
+static std::vector<AccessRecord> trace_buffer;
+static bool trace_failed = false;
+
+static void flushTrace() {
+    if (trace_buffer.empty()) return;
+    if (fwrite(trace_buffer.data(), sizeof(AccessRecord), trace_buffer.size(), trace_file) != trace_buffer.size())
+        trace_failed = true;
+    trace_buffer.clear();
+}
+
+bool trace_open(const char* filename) {
+    trace_file = fopen(filename, "wb");
+    if (!trace_file) return false;
+
+    uint32_t header[2] = {TRACE_VERSION, sizeof(AccessRecord)};
+    trace_failed = fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, trace_file) != 1 ||
+                   fwrite(header, sizeof(header), 1, trace_file) != 1;
+
+    trace_buffer.clear();
+    trace_buffer.reserve(TRACE_BUFFER);
+    trace_enabled = true;
+    return !trace_failed;
+}
+
+void trace_record(uint32_t addr, AccessType type, AccessClass cls, CachePartition part) {
+    AccessRecord rec;
+    rec.addr = addr;
+    rec.type = static_cast<uint8_t>(type);
+    rec.cls = static_cast<uint8_t>(cls);
+    rec.part = part;
+    rec.reserved = 0;
+
+    trace_buffer.push_back(rec);
+    if (trace_buffer.size() == TRACE_BUFFER) flushTrace();
+}
+
+bool trace_close() {
+    if (!trace_file) return false;
+
+    flushTrace();
+    bool ok = fclose(trace_file) == 0 && !trace_failed;
+    trace_file = nullptr;
+    trace_enabled = false;
+    return ok;
+}
+
+// a replay worker and the private cache it drives
+struct ReplayShard {
+    CacheModel model;
+    CacheWorker worker{&model, SHARD_QUEUE};
+};
+
+static bool readHeader(FILE* in) {
+    char magic[sizeof(TRACE_MAGIC)];
+    uint32_t header[2];
+    if (fread(magic, sizeof(magic), 1, in) != 1 || fread(header, sizeof(header), 1, in) != 1) return false;
+    return memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0 && header[0] == TRACE_VERSION &&
+           header[1] == sizeof(AccessRecord);
+}
+
+bool replayTrace(const char* filename, const CacheConfig& cfg, unsigned threads, ReplayResult& result) {
+    FILE* in = fopen(filename, "rb");
+    if (!in) return false;
+
+    CacheModel sequential;
+    if (!readHeader(in) || !sequential.configure(cfg)) {
+        fclose(in);
+        return false;
+    }
+
+    result = ReplayResult();
+    unsigned shards = threads < sequential.numSets ? threads : sequential.numSets;
+    // one victim stream, victim cache, shadow cache, set of MSHRs, set of DRAM banks or utility monitor shared by every set
+    if (shards == 0 || cfg.policy == POLICY_RANDOM || cfg.victims || cfg.classify || cfg.mshrs || dram_enabled ||
+        cfg.partition == PARTITION_UTILITY)
+        shards = 1;
+    if (dram_enabled) sequential.memory = &dram;
+    result.shards = shards;
+
+    std::vector<AccessRecord> chunk(TRACE_BUFFER);
+    uint64_t stamp = 0;
+
+    if (shards == 1) {
+        size_t n;
+        while ((n = fread(chunk.data(), sizeof(AccessRecord), chunk.size(), in)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                const AccessType type = static_cast<AccessType>(chunk[i].type);
+                result.cycles += sequential.timeAccess(chunk[i].addr, type, ++stamp, REGION_CODE, chunk[i].part);
+                if (sequential.straddles(chunk[i].addr, type)) ++stamp;
+            }
+            result.accesses += n;
+        }
+        result.stats = sequential.stats;
+        result.setStats = sequential.setStats;
+
+    } else {
+        sequential.release();
+
+        std::vector<std::unique_ptr<ReplayShard>> workers;
+        for (unsigned s = 0; s < shards; s++) {
+            workers.emplace_back(new ReplayShard);
+            workers.back()->model.configure(cfg);
+        }
+
+        std::vector<std::thread> pool;
+        for (auto& w : workers)
+            pool.emplace_back(&CacheWorker::run, &w->worker);
+
+        // per shard staging, so the queues see a few large pushes rather than one per record
+        std::vector<std::vector<CacheAccess>> pending(shards);
+        for (auto& p : pending)
+            p.reserve(SHARD_BATCH);
+
+        const auto hand = [&](unsigned s) {
+            const CacheAccess* items = pending[s].data();
+            size_t left = pending[s].size();
+            while (left) {
+                size_t n = workers[s]->worker.queue.pushBulk(items, left);
+                if (n == 0) std::this_thread::yield();
+                items += n;
+                left -= n;
+            }
+            pending[s].clear();
+        };
+
+        const CacheModel& geometry = workers[0]->model;
+        const auto send = [&](const CacheAccess& access) {
+            unsigned s = geometry.setIndex(access.addr) % shards;
+            pending[s].push_back(access);
+            if (pending[s].size() == SHARD_BATCH) hand(s);
+        };
+        uint64_t splits = 0;
+        size_t n;
+        while ((n = fread(chunk.data(), sizeof(AccessRecord), chunk.size(), in)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+                const uint32_t addr = chunk[i].addr;
+                if (!geometry.straddles(addr, static_cast<AccessType>(chunk[i].type))) {
+                    send({++stamp, addr, chunk[i].type, REGION_CODE, HALF_NONE, chunk[i].part});
+                    continue;
+                }
+                // the halves can land in different shards, the pairing happens after the join
+                send({++stamp, addr, chunk[i].type, REGION_CODE, HALF_FIRST, chunk[i].part});
+                send({++stamp, (addr | geometry.offsetMask) + 1, chunk[i].type, REGION_CODE, HALF_SECOND, chunk[i].part});
+                splits++;
+            }
+            result.accesses += n;
+        }
+        for (unsigned s = 0; s < shards; s++) {
+            hand(s);
+            workers[s]->worker.queue.close();
+        }
+        for (auto& t : pool)
+            t.join();
+
+        // set i lives in shard i % shards, which is the only one that ever touched it
+        result.setStats.resize(geometry.numSets);
+        for (size_t set = 0; set < geometry.numSets; set++)
+            result.setStats[set] = workers[set % shards]->model.setStats[set];
+
+        for (auto& w : workers) {
+            result.cycles += w->worker.cycles;
+            result.stats.add(w->model.stats);
+        }
+
+        // a second half filled right after its first half filled continues that request, as in a live run
+        std::vector<uint64_t> firstFilled, secondFilled;
+        for (auto& w : workers) {
+            firstFilled.insert(firstFilled.end(), w->worker.filledHalves[0].begin(), w->worker.filledHalves[0].end());
+            secondFilled.insert(secondFilled.end(), w->worker.filledHalves[1].begin(), w->worker.filledHalves[1].end());
+        }
+        std::sort(firstFilled.begin(), firstFilled.end());
+        uint64_t batched = 0;
+        for (uint64_t s : secondFilled)
+            if (std::binary_search(firstFilled.begin(), firstFilled.end(), s - 1)) batched++;
+        result.cycles += batched * cost_model.fillNextWord;
+        result.cycles -= batched * cost_model.fillFirstWord;
+        result.stats.splits = splits;
+        result.stats.batchedFills = batched;
+    }
+
+    bool ok = !ferror(in);
+    fclose(in);
+    return ok;
+}
@@ -6,9 +6,35 @@
 
 #include <array>
 #include <cstring>
+#include <fstream>
 #include <numeric>  // std::iota
+#include <sstream>
+#include <thread>
 
 #include "emu4380.h"
+#include "bpred.h"
+#include "costs.h"
+#include "dram.h"
+#include "heatmap.h"
+#include "inorder.h"
+#include "interval.h"
+#include "mmu.h"
+#include "ooo.h"
+#include "opstats.h"
+#include "regions.h"
+#include "roi.h"
+#include "sampling.h"
+#include "stackdist.h"
+#include "summary.h"
+#include "spsc.h"
+#include "sweep.h"
+#include "trace.h"
+
+// A scratch file of the running test's own, so tests run in parallel by ctest never share one
+static std::string testTempPath(const std::string& suffix) {
+    const ::testing::TestInfo* test = ::testing::UnitTest::GetInstance()->current_test_info();
+    return ::testing::TempDir() + test->test_suite_name() + "_" + test->name() + "_" + suffix;
+}
 
 // -----------------------------------------------------------------------------
 // 1.  Loader
@@ -886,9 +912,11 @@ static const HeapCase kHeapCases[]{
 
     {OP_ALLC, 4, 0, 20, 0, 30, 10, true, 10, 40},
     {OP_ALLC, 4, 0, 200, 0, 10000000, 0, false, 0, 0},
+    {OP_ALLC, 4, 0, 200, 0, 0xFFFFFFF0u, 100, false, 0, 0},  // HP + size wraps past 2^32
 
     {OP_IALLC, 6, 2, 0, 12, 25, 0, true, 0, 25},
-    {OP_IALLC, 6, 2, 0, 20, 10000000, 0, false, 0, 0}};
+    {OP_IALLC, 6, 2, 0, 20, 10000000, 0, false, 0, 0},
+    {OP_IALLC, 6, 2, 0, 20, 0xFFFFFFF0u, 100, false, 0, 0}};
 
 class HeapParam : public InstrTest,
                   public ::testing::WithParamInterface<HeapCase> {};
@@ -949,6 +977,23 @@ TEST_F(InstrTest, Trap5_PrintPascalString) {
     EXPECT_EQ(out, message);
 }
 
+TEST_F(InstrTest, Trap6_LineThatDoesNotFitTraps) {
+    std::istringstream fakeIn("hello\n");
+    auto* oldCin = std::cin.rdbuf(fakeIn.rdbuf());
+
+    reg_file[R3] = kMem - 4;  // room for the length byte and 3 more, not 5 characters and a terminator
+    prog_mem[kMem - 4] = 0xEE;
+    loadInstr(OP_TRP, 0, 0, 0, 6);
+    ASSERT_TRUE(fetch());
+    ASSERT_TRUE(decode());
+    EXPECT_FALSE(execute());
+    std::cin.rdbuf(oldCin);
+
+    EXPECT_EQ(trap_code, TRAP_OUT_OF_BOUNDS);
+    EXPECT_EQ(prog_mem[kMem - 4], 0xEE);  // nothing written
+    trap_code = TRAP_NONE;
+}
+
 TEST_F(InstrTest, Trap6_ReadPascalStringToMemory) {
     std::string input = "CS4380 Test\n";
     std::istringstream fakeIn(input);
@@ -1025,4 +1070,1706 @@ INSTANTIATE_TEST_SUITE_P(AllReturns,
 
 INSTANTIATE_TEST_SUITE_P(AllHeap,
                          HeapParam,
-                         ::testing::ValuesIn(kHeapCases));
\ No newline at end of file
+                         ::testing::ValuesIn(kHeapCases));
+// -----------------------------------------------------------------------------
+// 8.  Stack distance / miss-ratio curve tests
+// -----------------------------------------------------------------------------
+TEST(StackDistanceTest, ReuseDistanceCountsDistinctBlocksBetween) {
+    ASSERT_TRUE(stackdist.init(16));
+
+    // A B C B A  ->  second B has distance 1 (C), second A has distance 2 (B, C)
+    for (uint32_t addr : {0x000u, 0x010u, 0x020u, 0x014u, 0x008u})
+        stackdist.access(addr, CLASS_DATA);
+
+    EXPECT_EQ(stackdist.cold[CLASS_DATA], 3u);
+    ASSERT_GE(stackdist.hist[CLASS_DATA].size(), 3u);
+    EXPECT_EQ(stackdist.hist[CLASS_DATA][1], 1u);
+    EXPECT_EQ(stackdist.hist[CLASS_DATA][2], 1u);
+
+    EXPECT_DOUBLE_EQ(stackdist.missRatio(1), 1.0);
+    EXPECT_DOUBLE_EQ(stackdist.missRatio(2), 4.0 / 5.0);
+    EXPECT_DOUBLE_EQ(stackdist.missRatio(3), 3.0 / 5.0);
+}
+
+TEST(StackDistanceTest, MatchesFullyAssociativeCacheAcrossCompaction) {
+    // sweep far more accesses than the initial timeline so compaction runs several times
+    ASSERT_TRUE(stackdist.init(16));
+    for (int pass = 0; pass < 3000; pass++)
+        for (uint32_t b = 0; b < 100; b++)
+            stackdist.access(b * 16, (b & 1) ? CLASS_DATA : CLASS_IFETCH);
+
+    // cyclic sweep of 100 blocks: LRU misses on everything below 100 lines and only on cold misses above it
+    EXPECT_DOUBLE_EQ(stackdist.missRatio(99), 1.0);
+    EXPECT_DOUBLE_EQ(stackdist.missRatio(100), 100.0 / 300000.0);
+    EXPECT_DOUBLE_EQ(stackdist.missRatio(100, CLASS_IFETCH), 50.0 / 150000.0);
+}
+
+TEST(StackDistanceTest, CurveWithoutReuseStillHasTheColdPoint) {
+    ASSERT_TRUE(stackdist.init(16));
+    for (uint32_t b = 0; b < 4; b++)
+        stackdist.access(b * 16, CLASS_DATA);
+
+    const string path = testTempPath("cold.csv");
+    ASSERT_TRUE(stackdist.write(path.c_str()));
+    ifstream in(path);
+    string header, row, rest;
+    getline(in, header);
+    getline(in, row);
+    EXPECT_FALSE(getline(in, rest));
+    in.close();
+    remove(path.c_str());
+    EXPECT_EQ(row, "0,0,1.000000,0.000000,1.000000");
+}
+
+TEST(StackDistanceTest, RejectsBadParameters) {
+    EXPECT_FALSE(stackdist.init(24));
+    EXPECT_FALSE(stackdist.init(16, 0.0));
+    EXPECT_FALSE(stackdist.init(16, 1.5));
+    EXPECT_TRUE(stackdist.init(64, 0.01));
+}
+
+// -----------------------------------------------------------------------------
+// 9.  Runtime cache geometry and sweep grid tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, ConfiguredBlockSizeChargesWholeBlockFill) {
+    ASSERT_TRUE(configure_cache(32, 128, 4));
+    EXPECT_EQ(num_sets, 32u);
+    EXPECT_EQ(current_cache_type, SET_ASSOCIATIVE);
+
+    readByte(0x1000);
+    // 8 words per block: 6 + 2 * 8 to fill, 1 for the hit
+    EXPECT_EQ(mem_cycle_cntr, 23u);
+    readByte(0x101F);
+    EXPECT_EQ(mem_cycle_cntr, 24u);
+
+    EXPECT_EQ(cache_model.stats.misses, 1u);
+    EXPECT_EQ(cache_model.stats.hits, 1u);
+}
+
+TEST_F(CacheTest, ConfigureRejectsBadGeometry) {
+    EXPECT_FALSE(configure_cache(24, 64, 1));
+    EXPECT_FALSE(configure_cache(256, 64, 1));
+    EXPECT_FALSE(configure_cache(16, 64, 128));
+    EXPECT_FALSE(configure_cache(16, 48, 1));
+}
+
+TEST_F(CacheTest, FifoIgnoresRecentUse) {
+    ASSERT_TRUE(configure_cache(16, 2, 2, POLICY_FIFO));
+
+    readByte(0x000);  // A
+    readByte(0x010);  // B
+    readByte(0x000);  // touch A, LRU would now evict B
+    readByte(0x020);  // C evicts A under FIFO
+    uint64_t misses = cache_model.stats.misses;
+    readByte(0x010);  // B still resident
+    EXPECT_EQ(cache_model.stats.misses, misses);
+    readByte(0x000);  // A was evicted
+    EXPECT_EQ(cache_model.stats.misses, misses + 1);
+}
+
+TEST_F(CacheTest, WritebackCountedOnDirtyEviction) {
+    ASSERT_TRUE(configure_cache(16, 64, 1));
+    writeWord(0x000, 0x12345678);
+    readWord(0x400);  // same set in a 64 line direct mapped cache
+    EXPECT_EQ(cache_model.stats.writebacks, 1u);
+    EXPECT_EQ(prog_mem[0], 0x78);
+}
+
+TEST(SweepTest, GridExpandsEveryCombination) {
+    vector<SweepPoint> grid;
+    ASSERT_TRUE(parseSweepGrid("block=16,32;assoc=1,full;policy=lru,fifo,random", grid));
+    ASSERT_EQ(grid.size(), 12u);
+
+    EXPECT_EQ(grid[0].blockSize, 16u);
+    EXPECT_EQ(grid[0].lines, NUM_CACHE_LINES);
+    EXPECT_EQ(grid[0].ways, 1u);
+    EXPECT_EQ(grid[0].policy, POLICY_LRU);
+    EXPECT_EQ(grid[11].blockSize, 32u);
+    EXPECT_EQ(grid[11].ways, 0u);  // full
+    EXPECT_EQ(grid[11].policy, POLICY_RANDOM);
+}
+
+TEST(SweepTest, GridRejectsUnknownKeysAndValues) {
+    vector<SweepPoint> grid;
+    EXPECT_FALSE(parseSweepGrid("ways=2", grid));
+    EXPECT_FALSE(parseSweepGrid("policy=mru", grid));
+    EXPECT_FALSE(parseSweepGrid("block=16,,32", grid));
+    EXPECT_FALSE(parseSweepGrid("lines", grid));
+}
+
+TEST(SweepTest, ChildrenStopAtTheRunLimits) {
+    const string binary = testTempPath("spin.bin");
+    const unsigned char spin[] = {4, 0, 0, 0, OP_JMP, 0, 0, 0, 4, 0, 0, 0};  // entry 4: JMP 4
+    ofstream(binary, ios::binary).write(reinterpret_cast<const char*>(spin), sizeof spin);
+    const string csv = testTempPath("sweep.csv");
+
+    vector<SweepPoint> grid;
+    ASSERT_TRUE(parseSweepGrid("lines=32,64", grid));
+    RunLimits limits;
+    limits.instructions = 1000;
+    MmuConfig mmuConfig;
+    EXPECT_EQ(runSweep(grid, binary, kMem, "", csv, 2, limits, &mmuConfig), 1);  // stopped, not completed
+
+    ifstream in(csv);
+    string header, row;
+    getline(in, header);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_TRUE(getline(in, row));
+        EXPECT_NE(row.find(",instruction_limit,"), string::npos) << row;
+    }
+    remove(binary.c_str());
+    remove(csv.c_str());
+}
+
+// -----------------------------------------------------------------------------
+// 10. Trace recording and set-partitioned replay tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, ShardedReplayMatchesLiveRun) {
+    const string path = testTempPath("replay_test.trace");
+    ASSERT_TRUE(configure_cache(16, 64, 4));
+    ASSERT_TRUE(trace_open(path.c_str()));
+    access_hooks = true;
+
+    uint32_t x = 12345;
+    for (int i = 0; i < 20000; i++) {
+        x = x * 1103515245u + 12345u;
+        uint32_t addr = ((x >> 8) % 0x4000) & ~3u;
+        switch (x >> 30) {
+            case 0: readByte(addr); break;
+            case 1: readWord(addr); break;
+            case 2: writeByte(addr, 1); break;
+            default: writeWord(addr, 2); break;
+        }
+    }
+    access_hooks = false;
+    ASSERT_TRUE(trace_close());
+
+    CacheConfig cfg;
+    cfg.ways = 4;
+    ReplayResult one, many;
+    ASSERT_TRUE(replayTrace(path.c_str(), cfg, 1, one));
+    ASSERT_TRUE(replayTrace(path.c_str(), cfg, 5, many));
+    EXPECT_EQ(many.shards, 5u);
+
+    EXPECT_EQ(one.accesses, 20000u);
+    EXPECT_EQ(one.cycles, mem_cycle_cntr);
+    EXPECT_EQ(one.stats.misses, cache_model.stats.misses);
+    EXPECT_EQ(one.stats.writebacks, cache_model.stats.writebacks);
+
+    EXPECT_EQ(many.cycles, one.cycles);
+    EXPECT_EQ(many.stats.hits, one.stats.hits);
+    EXPECT_EQ(many.stats.misses, one.stats.misses);
+    EXPECT_EQ(many.stats.writebacks, one.stats.writebacks);
+    for (size_t s = 0; s < one.setStats.size(); s++)
+        EXPECT_EQ(many.setStats[s].misses, one.setStats[s].misses) << "set " << s;
+    remove(path.c_str());
+}
+
+TEST(ReplayTest, RejectsMissingOrForeignTraces) {
+    ReplayResult result;
+    EXPECT_FALSE(replayTrace("no_such.trace", CacheConfig(), 2, result));
+
+    const string path = testTempPath("foreign.trace");
+    ofstream(path) << "not a trace file";
+    EXPECT_FALSE(replayTrace(path.c_str(), CacheConfig(), 2, result));
+    remove(path.c_str());
+}
+
+TEST(SpscRingTest, BulkTransferAcrossThreadsKeepsOrder) {
+    SpscRing<uint32_t> ring(64);
+    const uint32_t total = 100000;
+
+    std::thread producer([&] {
+        uint32_t batch[7];
+        for (uint32_t next = 0; next < total;) {
+            uint32_t n = 0;
+            while (n < 7 && next + n < total) {
+                batch[n] = next + n;
+                n++;
+            }
+            next += ring.pushBulk(batch, n);
+        }
+        ring.close();
+    });
+
+    uint32_t expected = 0, got;
+    bool ordered = true;
+    while (!ring.drained())
+        if (ring.pop(got)) ordered = ordered && got == expected++;
+    producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(expected, total);
+}
+
+// -----------------------------------------------------------------------------
+// 11. Pipelined cache tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, PipelinedCacheMatchesSynchronousRun) {
+    const auto workload = [] {
+        uint32_t x = 777, sum = 0;
+        for (int i = 0; i < 20000; i++) {
+            x = x * 1103515245u + 12345u;
+            uint32_t addr = ((x >> 8) % 0x4000) & ~3u;
+            switch (x >> 30) {
+                case 0: sum += readByte(addr); break;
+                case 1: sum += readWord(addr); break;
+                case 2: writeByte(addr, static_cast<unsigned char>(i)); break;
+                default: writeWord(addr, x); break;
+            }
+        }
+        return sum;
+    };
+
+    ASSERT_TRUE(configure_cache(16, 64, 2, POLICY_FIFO));
+    uint32_t syncSum = workload();
+    uint32_t syncCycles = mem_cycle_cntr;
+    CacheStats syncStats = cache_model.stats;
+    workload();
+    uint64_t syncCyclesTwice = mem_cycle_cntr;
+    uint64_t syncMissesTwice = cache_model.stats.misses;
+
+    memset(prog_mem, 0xAA, kMem);
+    mem_cycle_cntr = 0;
+    ASSERT_TRUE(configure_cache(16, 64, 2, POLICY_FIFO));
+    ASSERT_TRUE(start_cache_pipeline());
+    uint32_t pipeSum = workload();
+    sync_cache_pipeline();
+
+    EXPECT_EQ(pipeSum, syncSum);
+    EXPECT_EQ(mem_cycle_cntr, syncCycles);
+    EXPECT_EQ(cache_model.stats.hits, syncStats.hits);
+    EXPECT_EQ(cache_model.stats.misses, syncStats.misses);
+    EXPECT_EQ(cache_model.stats.writebacks, syncStats.writebacks);
+
+    workload();  // the same worker carries on after a sync
+    sync_cache_pipeline();
+    EXPECT_EQ(mem_cycle_cntr, syncCyclesTwice);
+    EXPECT_EQ(cache_model.stats.misses, syncMissesTwice);
+    PipelineCounters published = cache_pipeline_counters();  // what an interval record would read, unsynced
+    EXPECT_EQ(published.memCycles, syncCyclesTwice);
+    EXPECT_EQ(published.misses, syncMissesTwice);
+    EXPECT_EQ(published.hits, cache_model.stats.hits);
+
+    writeWord(0x100, 0xCAFEF00D);  // functional image stays current while the worker runs
+    EXPECT_EQ(readWord(0x100), 0xCAFEF00Du);
+    stop_cache_pipeline();
+    EXPECT_FALSE(cache_pipelined);
+}
+
+// -----------------------------------------------------------------------------
+// 12. Victim cache tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, VictimCacheServesConflictMiss) {
+    CacheConfig cfg;
+    cfg.victims = 4;
+    ASSERT_TRUE(configure_cache(cfg));
+
+    readByte(0x000);  // A: 14 to fill + 1
+    readByte(0x400);  // B: same set, A moves to the victim cache
+    readByte(0x000);  // A: served by the victim cache, trades places with B
+    EXPECT_EQ(mem_cycle_cntr, 15u + 15u + cfg.victimLatency);
+    EXPECT_EQ(cache_model.stats.misses, 3u);
+    EXPECT_EQ(cache_model.stats.victimHits, 1u);
+
+    readByte(0x400);  // B is in the victim cache now
+    EXPECT_EQ(cache_model.stats.victimHits, 2u);
+}
+
+TEST_F(CacheTest, VictimCacheWritesBackDirtyOverflow) {
+    CacheConfig cfg;
+    cfg.victims = 1;
+    ASSERT_TRUE(configure_cache(cfg));
+
+    writeWord(0x000, 0x12345678);
+    readWord(0x400);  // dirty A parks in the victim cache, no write-back yet
+    EXPECT_EQ(cache_model.stats.writebacks, 0u);
+    readWord(0x800);  // B pushes A out of the single entry
+    EXPECT_EQ(cache_model.stats.writebacks, 1u);
+    EXPECT_EQ(prog_mem[0], 0x78);
+
+    cfg.victims = MAX_VICTIMS + 1;
+    EXPECT_FALSE(configure_cache(cfg));
+}
+
+// -----------------------------------------------------------------------------
+// 13. Miss classification tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, MissesSplitIntoThreeCs) {
+    CacheConfig cfg;
+    cfg.lines = 2;
+    cfg.classify = true;
+    ASSERT_TRUE(configure_cache(cfg));  // two sets of one line
+
+    readByte(0x00);  // compulsory
+    readByte(0x20);  // compulsory, same set
+    readByte(0x00);  // conflict: a two line fully associative cache still holds it
+    readByte(0x10);  // compulsory, other set
+    readByte(0x30);  // compulsory, pushes 0x20 out of the shadow cache too
+    readByte(0x20);  // capacity
+
+    EXPECT_EQ(cache_model.stats.misses, 6u);
+    EXPECT_EQ(cache_model.stats.compulsory, 4u);
+    EXPECT_EQ(cache_model.stats.conflict, 1u);
+    EXPECT_EQ(cache_model.stats.capacity, 1u);
+    EXPECT_EQ(cache_model.stats.evictions, 4u);
+    EXPECT_EQ(cache_model.setStats[0].conflict, 1u);
+    EXPECT_EQ(cache_model.setStats[1].evictions, 1u);
+}
+
+// -----------------------------------------------------------------------------
+// 14. Per-region statistics tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, AccessesChargedToTheirRegion) {
+    reg_file[SL] = 0x100;
+    reg_file[HP] = 0x200;
+    reg_file[SP] = 0x1000;
+    reg_file[SB] = kMem;
+    init_cache(NO_CACHE);
+    region_stats_start();
+    access_hooks = true;
+
+    readWord(0x10);         // code/data
+    writeWord(0x180, 1);    // heap
+    writeByte(0x1004, 2);   // stack
+    readByte(0x800);        // between heap and stack
+    reg_file[HP] = 0x900;   // the heap grows over it
+    readByte(0x800);
+
+    EXPECT_EQ(region_stats[REGION_CODE].reads, 1u);
+    EXPECT_EQ(region_stats[REGION_CODE].cycles, 8u);
+    EXPECT_EQ(region_stats[REGION_HEAP].writes, 1u);
+    EXPECT_EQ(region_stats[REGION_HEAP].reads, 1u);
+    EXPECT_EQ(region_stats[REGION_STACK].writes, 1u);
+    EXPECT_EQ(region_stats[REGION_FREE].reads, 1u);
+
+    ASSERT_TRUE(configure_cache(16, 64, 1));
+    readByte(0x1010);
+    readByte(0x1014);
+    EXPECT_EQ(region_stats[REGION_STACK].misses, 1u);
+    EXPECT_EQ(region_stats[REGION_STACK].hits, 1u);
+    EXPECT_EQ(region_stats[REGION_STACK].cycles, 8u + 16u);
+
+    access_hooks = false;
+    region_stats_enabled = false;
+    cache_model.regionStats = nullptr;
+}
+
+// -----------------------------------------------------------------------------
+// 15. Heat map tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, HeatMapCountsPerBlockAndRoundTrips) {
+    ASSERT_TRUE(heatmap.init(64, kMem));
+    heatmap_enabled = true;
+    access_hooks = true;
+    ASSERT_TRUE(configure_cache(16, 64, 1));
+
+    readWord(0x100);
+    readWord(0x104);       // same 64 byte block, cache hit
+    writeByte(0x13F, 1);   // same block, different cache line: miss
+    writeWord(0x1F000, 2); // far away, lands in another page
+
+    access_hooks = false;
+    heatmap_enabled = false;
+    cache_model.heat = nullptr;
+
+    const string path = testTempPath("heat_test.bin");
+    ASSERT_TRUE(heatmap.write(path.c_str()));
+
+    HeatmapHeader header;
+    vector<HeatRecord> records;
+    ASSERT_TRUE(read_heatmap(path.c_str(), header, records));
+    remove(path.c_str());
+
+    EXPECT_EQ(header.blockSize, 64u);
+    EXPECT_EQ(header.memSize, kMem);
+    ASSERT_EQ(records.size(), 2u);
+    EXPECT_EQ(records[0].block, 0x100u / 64);
+    EXPECT_EQ(records[0].counts.reads, 2u);
+    EXPECT_EQ(records[0].counts.writes, 1u);
+    EXPECT_EQ(records[0].counts.misses, 2u);
+    EXPECT_EQ(records[1].block, 0x1F000u / 64);
+    EXPECT_EQ(records[1].counts.writes, 1u);
+
+    EXPECT_FALSE(heatmap.init(48, kMem));
+    EXPECT_EQ(heatmap.at(kMem + 64), nullptr);
+}
+
+// -----------------------------------------------------------------------------
+// 16. Opcode mix tests
+// -----------------------------------------------------------------------------
+#ifdef EMU_OPCODE_STATS
+TEST_F(CacheTest, OpcodeMixPairsAndBranchOutcomes) {
+    const auto put = [](uint32_t at, uint8_t op, uint8_t a, uint8_t b, uint32_t imm) {
+        prog_mem[at] = op;
+        prog_mem[at + 1] = a;
+        prog_mem[at + 2] = b;
+        prog_mem[at + 3] = 0;
+        memcpy(&prog_mem[at + 4], &imm, 4);
+    };
+    put(0, OP_MOVI, R1, 0, 2);
+    put(8, OP_ADDI, R1, R1, static_cast<uint32_t>(-1));  // loop:
+    put(16, OP_BNZ, R1, 0, 8);
+    put(24, OP_TRP, 0, 0, 0);
+
+    init_cache(NO_CACHE);
+    reg_file[SB] = reg_file[SP] = kMem;
+    opstats.reset();
+    opstats_enabled = true;
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    opstats_enabled = false;
+
+    // MOVI ADDI BNZ(taken) ADDI BNZ(not taken) TRP
+    EXPECT_EQ(opstats.total, 6u);
+    EXPECT_EQ(opstats.mix[OP_ADDI], 2u);
+    EXPECT_EQ(opstats.pairs[OP_ADDI * OPCODE_SLOTS + OP_BNZ], 2u);
+    EXPECT_EQ(opstats.triples[(OP_ADDI * OPCODE_SLOTS + OP_BNZ) * OPCODE_SLOTS + OP_ADDI], 1u);
+    EXPECT_EQ(opstats.taken[OP_BNZ], 1u);
+    EXPECT_EQ(opstats.notTaken[OP_BNZ], 1u);
+    EXPECT_EQ(opstats.traps[0], 1u);
+}
+#endif
+
+// -----------------------------------------------------------------------------
+// 17. Interval statistics tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, IntervalRecordsEveryNInstructionsPlusTheTail) {
+    const auto put = [](uint32_t at, uint8_t op, uint8_t a, uint8_t b, uint32_t imm) {
+        prog_mem[at] = op;
+        prog_mem[at + 1] = a;
+        prog_mem[at + 2] = b;
+        prog_mem[at + 3] = 0;
+        memcpy(&prog_mem[at + 4], &imm, 4);
+    };
+    put(0, OP_MOVI, R1, 0, 3);
+    put(8, OP_ADDI, R1, R1, static_cast<uint32_t>(-1));  // loop:
+    put(16, OP_BNZ, R1, 0, 8);
+    put(24, OP_TRP, 0, 0, 0);
+
+    init_cache(NO_CACHE);
+    reg_file[SB] = reg_file[SP] = kMem;
+    reg_file[HP] = 0x100;
+    instructions_retired = 0;
+    const char* file = "interval_test.bin";
+    ASSERT_TRUE(interval_start(3, file));
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    ASSERT_TRUE(interval_finish());
+
+    FILE* in = fopen(file, "rb");
+    ASSERT_NE(in, nullptr);
+    char magic[sizeof(INTERVAL_MAGIC)];
+    uint32_t header[3];
+    ASSERT_EQ(fread(magic, sizeof(magic), 1, in), 1u);
+    ASSERT_EQ(fread(header, sizeof(header), 1, in), 1u);
+    IntervalRecord r[4];
+    size_t n = fread(r, sizeof(IntervalRecord), 4, in);
+    fclose(in);
+    remove(file);
+
+    EXPECT_EQ(memcmp(magic, INTERVAL_MAGIC, sizeof(magic)), 0);
+    EXPECT_EQ(header[1], sizeof(IntervalRecord));
+    EXPECT_EQ(header[2], 3u);
+    // MOVI (ADDI BNZ) x3 TRP: snapshots after 3 and 6 instructions, then the last 2
+    ASSERT_EQ(n, 3u);
+    EXPECT_EQ(r[0].instructions, 3u);
+    EXPECT_EQ(r[1].instructions, 6u);
+    EXPECT_EQ(r[2].instructions, 8u);
+    EXPECT_EQ(r[0].cycles, 3u * 10);  // uncached fetch: 8 for the first word, 2 for the second
+    EXPECT_EQ(r[2].cycles, mem_cycle_cntr);
+    EXPECT_EQ(r[1].pc, 16u);
+    EXPECT_EQ(r[1].pcBucket, 0u);
+    EXPECT_EQ(r[2].hp, 0x100u);
+    EXPECT_EQ(r[2].sp, static_cast<uint32_t>(kMem));
+}
+
+// -----------------------------------------------------------------------------
+// 18. Run summary tests
+// -----------------------------------------------------------------------------
+TEST_F(CacheTest, CycleCounterDoesNotWrapAt32Bits) {
+    init_cache(NO_CACHE);
+    mem_cycle_cntr = UINT32_MAX;
+    readByte(0);
+    EXPECT_EQ(mem_cycle_cntr, static_cast<uint64_t>(UINT32_MAX) + 8);
+}
+
+TEST_F(CacheTest, StatsJsonSummarisesTheRun) {
+    const auto put = [](uint32_t at, uint8_t op, uint8_t a, uint8_t b, uint32_t imm) {
+        prog_mem[at] = op;
+        prog_mem[at + 1] = a;
+        prog_mem[at + 2] = b;
+        prog_mem[at + 3] = 0;
+        memcpy(&prog_mem[at + 4], &imm, 4);
+    };
+    put(0, OP_MOVI, R1, 0, 7);
+    put(8, OP_PSHR, R1, 0, 0);
+    put(16, OP_POPR, R2, 0, 0);
+    put(24, OP_TRP, 0, 0, 0);
+
+    init_cache(NO_CACHE);
+    reg_file[SB] = reg_file[SP] = kMem;
+    reg_file[HP] = 0x200;
+    instructions_retired = 0;
+    const char* file = "summary_test.json";
+    summary_start(file);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    ASSERT_TRUE(summary_write("completed"));
+    EXPECT_FALSE(summary_enabled);
+
+    std::ifstream in(file);
+    std::stringstream json;
+    json << in.rdbuf();
+    in.close();
+    remove(file);
+
+    EXPECT_NE(json.str().find("\"status\": \"completed\""), std::string::npos);
+    EXPECT_NE(json.str().find("\"instructions\": 4,"), std::string::npos);
+    EXPECT_NE(json.str().find("\"cycles\": " + std::to_string(mem_cycle_cntr) + ","), std::string::npos);
+    EXPECT_NE(json.str().find("\"peak_stack_bytes\": 4,"), std::string::npos);
+    EXPECT_NE(json.str().find("\"final_hp\": 512"), std::string::npos);
+}
+
+// -----------------------------------------------------------------------------
+// 19. Run limit tests
+// -----------------------------------------------------------------------------
+class RunLoopTest : public CacheTest {
+   protected:
+    void SetUp() override {
+        CacheTest::SetUp();
+        init_cache(NO_CACHE);
+        reg_file[SB] = reg_file[SP] = kMem;
+        instructions_retired = 0;
+    }
+    void TearDown() override {
+        set_run_limits(RunLimits());
+        CacheTest::TearDown();
+    }
+    static void put(uint32_t at, uint8_t op, uint8_t a, uint32_t imm) {
+        prog_mem[at] = op;
+        prog_mem[at + 1] = a;
+        prog_mem[at + 2] = 0;
+        prog_mem[at + 3] = 0;
+        memcpy(&prog_mem[at + 4], &imm, 4);
+    }
+};
+
+TEST_F(RunLoopTest, InstructionLimitIsExact) {
+    put(0, OP_JMP, 0, 0);  // spin forever
+    RunLimits limits;
+    limits.instructions = 100;
+    set_run_limits(limits);
+    EXPECT_TRUE(runLoop());
+    EXPECT_EQ(stop_reason, STOP_INSTRUCTIONS);
+    EXPECT_EQ(instructions_retired, 100u);
+    EXPECT_EQ(stop_exit_code(stop_reason), 3);
+}
+
+TEST_F(RunLoopTest, CycleLimitIsPolled) {
+    put(0, OP_JMP, 0, 0);
+    RunLimits limits;
+    limits.cycles = 50000;  // 10 cycles per uncached fetch
+    set_run_limits(limits);
+    EXPECT_TRUE(runLoop());
+    EXPECT_EQ(stop_reason, STOP_CYCLES);
+    EXPECT_EQ(instructions_retired, 2 * LIMIT_POLL);
+    EXPECT_EQ(stop_exit_code(stop_reason), 4);
+}
+
+TEST_F(RunLoopTest, OutputLimitWithholdsTheWriteThatCrossesIt) {
+    put(0, OP_MOVI, R3, 'x');
+    put(8, OP_TRP, 0, 3);
+    put(16, OP_JMP, 0, 8);
+    RunLimits limits;
+    limits.outputBytes = 5;
+    set_run_limits(limits);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "xxxxx");
+    EXPECT_EQ(stop_reason, STOP_OUTPUT);
+    EXPECT_STREQ(stop_reason_name(stop_reason), "output_limit");
+}
+
+// -----------------------------------------------------------------------------
+// 20. Trap code tests
+// -----------------------------------------------------------------------------
+TEST_F(RunLoopTest, PopOnEmptyStackTrapsInsteadOfExiting) {
+    put(0, OP_POPR, R1, 0);
+    EXPECT_FALSE(runLoop());
+    EXPECT_EQ(trap_code, TRAP_STACK_UNDERFLOW);
+    EXPECT_EQ(reg_file[SP], static_cast<uint32_t>(kMem));
+    EXPECT_STREQ(trap_name(trap_code), "stack_underflow");
+}
+
+TEST_F(RunLoopTest, DecodeAndExecuteReportWhyTheyFailed) {
+    put(0, OP_DIVI, R1, 0);  // R1 / 0
+    EXPECT_FALSE(runLoop());
+    EXPECT_EQ(trap_code, TRAP_DIVIDE_BY_ZERO);
+
+    runBool = true;
+    reg_file[PC] = 0;
+    put(0, OP_MOV, 99, 0);  // no register 99
+    EXPECT_FALSE(runLoop());
+    EXPECT_EQ(trap_code, TRAP_BAD_REGISTER);
+}
+
+TEST_F(RunLoopTest, OutOfBoundsWriteTrapsInsteadOfAborting) {
+    trap_code = TRAP_NONE;
+    writeWord(kMem - 2, 0xDEADBEEF);
+    EXPECT_EQ(trap_code, TRAP_OUT_OF_BOUNDS);
+    EXPECT_EQ(mem_cycle_cntr, 0u);
+}
+
+TEST_F(RunLoopTest, ResettingTheMachineClearsALeftoverTrap) {
+    writeWord(kMem - 2, 0xDEADBEEF);
+    ASSERT_EQ(trap_code, TRAP_OUT_OF_BOUNDS);
+    ASSERT_TRUE(init_mem(kMem));
+    EXPECT_EQ(trap_code, TRAP_NONE);
+
+    writeWord(kMem - 2, 0xDEADBEEF);
+    ASSERT_EQ(load_binary(kGoodBin), 0u);
+    EXPECT_EQ(trap_code, TRAP_NONE);
+}
+
+// -----------------------------------------------------------------------------
+// 21. Sampled simulation tests
+// -----------------------------------------------------------------------------
+TEST_F(RunLoopTest, FlushWritesDirtyLinesBackAndEmptiesTheCache) {
+    init_cache(DIRECT_MAPPED);
+    writeWord(0x100, 0xCAFEBABE);
+    EXPECT_NE(memcmp(&prog_mem[0x100], "\xBE\xBA\xFE\xCA", 4), 0);  // still only in the line
+
+    cache_model.flush();
+    EXPECT_EQ(memcmp(&prog_mem[0x100], "\xBE\xBA\xFE\xCA", 4), 0);
+    EXPECT_FALSE(cache_model.sets[cache_model.setIndex(0x100)][0].valid);
+    free_cache();
+}
+
+TEST_F(RunLoopTest, FunctionalModeSkipsTimingButKeepsData) {
+    init_cache(DIRECT_MAPPED);
+    writeWord(0x200, 7);
+    uint64_t cycles = mem_cycle_cntr;
+
+    set_functional_mode(true);
+    EXPECT_EQ(readWord(0x200), 7u);  // flushed on the way in
+    writeWord(0x204, 9);
+    EXPECT_EQ(mem_cycle_cntr, cycles);
+    set_functional_mode(false);
+
+    EXPECT_EQ(readWord(0x204), 9u);
+    EXPECT_GT(mem_cycle_cntr, cycles);
+    free_cache();
+}
+
+TEST_F(RunLoopTest, WindowsCoveringTheWholeRunEstimateItExactly) {
+    put(0, OP_MOVI, R1, 10);
+    put(8, OP_ADDI, R1, static_cast<uint32_t>(-1));  // loop:
+    prog_mem[10] = R1;
+    put(16, OP_BNZ, R1, 8);
+    put(24, OP_TRP, 0, 0);
+    init_cache(DIRECT_MAPPED);
+
+    SampleConfig cfg;
+    ASSERT_TRUE(parseSampleSpec("0,0,11,2", cfg));
+    sampling_start(cfg);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    SampleEstimate est = sampling_finish();
+
+    // MOVI (ADDI BNZ) x10 TRP
+    EXPECT_EQ(est.windows, 2u);
+    EXPECT_EQ(est.instructions, 22u);
+    EXPECT_DOUBLE_EQ(est.cycles, static_cast<double>(mem_cycle_cntr));
+    EXPECT_GT(est.cyclesHalfWidth, 0.0);  // the first window pays the cold misses
+    free_cache();
+}
+
+TEST(SampleSpecTest, NeedsFourNumbersWithAWindow) {
+    SampleConfig cfg;
+    EXPECT_TRUE(parseSampleSpec("1000,100,50,8", cfg));
+    EXPECT_EQ(cfg.fastForward, 1000u);
+    EXPECT_EQ(cfg.samples, 8u);
+    EXPECT_FALSE(parseSampleSpec("1000,100,0,8", cfg));
+    EXPECT_FALSE(parseSampleSpec("1000,100,50", cfg));
+    EXPECT_FALSE(parseSampleSpec("1000,100,50,8,1", cfg));
+    EXPECT_FALSE(parseSampleSpec("a,100,50,8", cfg));
+}
+
+// 22. Region of interest tests
+TEST_F(RunLoopTest, RoiCountsOnlyBetweenTheMarkers) {
+    put(0, OP_MOVI, R1, 10);
+    put(8, OP_TRP, 0, TRP_ROI_BEGIN);
+    put(16, OP_ADDI, R1, static_cast<uint32_t>(-1));  // loop:
+    prog_mem[18] = R1;
+    put(24, OP_BNZ, R1, 16);
+    put(32, OP_TRP, 0, TRP_ROI_END);
+    put(40, OP_TRP, 0, 0);
+    init_cache(DIRECT_MAPPED);
+
+    roi_start(false);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    std::string out = testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(roi_stats.regions, 1u);
+    EXPECT_EQ(roi_stats.instructions, 20u);  // (ADDI BNZ) x10
+    EXPECT_GT(roi_stats.cycles, 0u);
+    EXPECT_LT(roi_stats.cycles, mem_cycle_cntr);
+    EXPECT_NE(out.find("Region of interest: 20 instructions"), std::string::npos);
+    free_cache();
+}
+
+TEST_F(RunLoopTest, RoiOnlyChargesNothingOutsideTheRegion) {
+    put(0, OP_MOVI, R1, 10);
+    put(8, OP_TRP, 0, TRP_ROI_BEGIN);
+    put(16, OP_ADDI, R1, static_cast<uint32_t>(-1));  // loop:
+    prog_mem[18] = R1;
+    put(24, OP_BNZ, R1, 16);
+    put(32, OP_TRP, 0, TRP_ROI_END);
+    put(40, OP_MOVI, R2, 5);
+    put(48, OP_TRP, 0, 0);
+    init_cache(DIRECT_MAPPED);
+
+    roi_start(true);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_EQ(roi_stats.regions, 1u);
+    EXPECT_EQ(mem_cycle_cntr, roi_stats.cycles);
+    EXPECT_EQ(reg_file[R2], 5u);
+
+    roi_start(false);
+    set_functional_mode(false);
+    free_cache();
+}
+
+TEST_F(RunLoopTest, ProgramsWithoutMarkersPrintNoRoiLine) {
+    put(0, OP_TRP, 0, 0);
+    roi_start(false);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    EXPECT_EQ(testing::internal::GetCapturedStdout().find("Region of interest"), std::string::npos);
+}
+
+// 23. Pipeline timing tests
+static RetiredInstr alu(uint8_t rd, uint8_t rs1, uint8_t rs2 = NO_REG) {
+    RetiredInstr r;
+    r.op = OP_ADD;
+    r.dst[0] = rd;
+    r.src[0] = rs1;
+    r.src[1] = rs2;
+    r.fetchCycles = 2;  // two hits
+    return r;
+}
+
+static RetiredInstr load(uint8_t rd, uint32_t memCycles = 1) {
+    RetiredInstr r;
+    r.op = OP_LDR;
+    r.flags = RETIRE_LOAD;
+    r.dst[0] = rd;
+    r.fetchCycles = 2;
+    r.memCycles = memCycles;
+    r.memAccesses = 1;
+    return r;
+}
+
+TEST(PipelineTest, IndependentInstructionsRetireOnePerCycle) {
+    InOrderModel m;
+    m.reset(PipelineConfig());
+    for (int i = 0; i < 10; i++) m.retire(alu(R1 + i % 4, R8));
+    EXPECT_EQ(m.stats.cycles, 14u);  // 10 plus filling the other four stages
+    for (uint64_t s : m.stats.stalls) EXPECT_EQ(s, 0u);
+}
+
+TEST(PipelineTest, ForwardingLeavesOnlyTheLoadUseBubble) {
+    InOrderModel m;
+    m.reset(PipelineConfig());
+    m.retire(alu(R1, R2));
+    m.retire(alu(R3, R1));  // forwarded from EX
+    m.retire(load(R4));
+    m.retire(alu(R5, R4));  // one bubble for the load
+    EXPECT_EQ(m.stats.stalls[STALL_RAW], 0u);
+    EXPECT_EQ(m.stats.stalls[STALL_LOAD_USE], 1u);
+    EXPECT_EQ(m.stats.cycles, 4u + 4 + 1);
+}
+
+TEST(PipelineTest, WithoutForwardingOperandsWaitForWriteBack) {
+    PipelineConfig cfg;
+    cfg.forwarding = false;
+    InOrderModel m;
+    m.reset(cfg);
+    m.retire(alu(R1, R2));
+    m.retire(alu(R3, R1));  // ID waits for the WB two cycles later
+    EXPECT_EQ(m.stats.stalls[STALL_RAW], 2u);
+    EXPECT_EQ(m.stats.cycles, 2u + 4 + 2);
+}
+
+TEST(PipelineTest, TakenBranchesAndJumpsRefetch) {
+    InOrderModel m;
+    m.reset(PipelineConfig());
+    RetiredInstr branch = alu(NO_REG, R1);
+    branch.op = OP_BNZ;
+    branch.flags = RETIRE_BRANCH;
+    m.retire(branch);  // not taken, predicted right
+    branch.flags |= RETIRE_TAKEN;
+    m.retire(branch);  // resolved in EX
+    RetiredInstr jump = alu(NO_REG, NO_REG);
+    jump.op = OP_JMP;
+    jump.flags = RETIRE_JUMP | RETIRE_TAKEN;
+    m.retire(jump);  // redirected from ID
+    m.retire(alu(R2, R3));
+    EXPECT_EQ(m.stats.stalls[STALL_BRANCH], 3u);
+    EXPECT_EQ(m.stats.branches, 2u);
+    EXPECT_EQ(m.stats.taken, 1u);
+}
+
+TEST(PipelineTest, MemoryCyclesBeyondAHitStall) {
+    InOrderModel m;
+    m.reset(PipelineConfig());
+    m.retire(load(R1, 23));  // a miss
+    RetiredInstr slowFetch = alu(R2, R3);
+    slowFetch.fetchCycles = 10;
+    m.retire(slowFetch);
+    EXPECT_EQ(m.stats.stalls[STALL_MEMORY], 22u);
+    EXPECT_EQ(m.stats.stalls[STALL_FETCH], 0u);  // hidden behind the miss
+    EXPECT_EQ(m.stats.cycles, 2u + 4 + 22);
+}
+
+TEST(PipelineTest, ExecuteCostsHoldEx) {
+    InOrderModel m;
+    m.reset(PipelineConfig());
+    RetiredInstr divide = alu(R1, R2, R3);
+    divide.op = OP_DIV;
+    divide.exCycles = 4;
+    m.retire(divide);
+    m.retire(alu(R4, R1));  // forwarded once EX is done
+    EXPECT_EQ(m.stats.stalls[STALL_EXECUTE], 4u);
+    EXPECT_EQ(m.stats.stalls[STALL_MEMORY], 0u);
+    EXPECT_EQ(m.stats.stalls[STALL_RAW], 0u);
+    EXPECT_EQ(m.stats.cycles, 2u + 4 + 4);
+}
+
+TEST(PipelineTest, StallsAlwaysAddUpToTheCycles) {
+    InOrderModel m;
+    m.reset(PipelineConfig());
+    uint32_t x = 99;
+    for (int i = 0; i < 5000; i++) {
+        x = x * 1103515245u + 12345u;
+        const uint8_t rd = R1 + (x >> 8) % 4;
+        RetiredInstr r = (x >> 29) < 3 ? load(rd, (x >> 12) % 20) : alu(rd, R1 + (x >> 16) % 4);
+        if ((x >> 29) == 7) r.flags = RETIRE_BRANCH | RETIRE_TAKEN;
+        r.exCycles = (x >> 4) % 8 == 0 ? 3 : 0;
+        m.retire(r);
+    }
+    uint64_t stalls = 0;
+    for (uint64_t s : m.stats.stalls) stalls += s;
+    EXPECT_EQ(m.stats.cycles, m.stats.instructions + 4 + stalls);
+    EXPECT_EQ(m.stats.stalls[STALL_OTHER], 0u);
+}
+
+TEST(PipelineTest, BubblesNoDelayExplainsAreChargedToOther) {
+    uint64_t stalls[STALL_COUNT] = {};
+    uint64_t delay[STALL_COUNT] = {};
+    delay[STALL_MEMORY] = 2;
+    delay[STALL_RAW] = 1;
+    charge_stalls(stalls, delay, 5);
+    EXPECT_EQ(stalls[STALL_MEMORY], 2u);
+    EXPECT_EQ(stalls[STALL_RAW], 1u);
+    EXPECT_EQ(stalls[STALL_OTHER], 2u);
+}
+
+TEST_F(RunLoopTest, PipelineSeesEveryRetiredInstruction) {
+    put(0, OP_MOVI, R1, 10);
+    put(8, OP_ADDI, R1, static_cast<uint32_t>(-1));  // loop:
+    prog_mem[10] = R1;
+    put(16, OP_BNZ, R1, 8);
+    put(24, OP_TRP, 0, 0);
+    init_cache(DIRECT_MAPPED);
+
+    inorder_start(PipelineConfig());
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    inorder_enabled = false;
+
+    const PipelineStats& p = inorder.stats;
+    EXPECT_EQ(p.instructions, 22u);
+    EXPECT_EQ(p.branches, 10u);
+    EXPECT_EQ(p.taken, 9u);
+    EXPECT_EQ(p.stalls[STALL_RAW], 0u);  // ADDI -> BNZ is forwarded
+    EXPECT_EQ(p.stalls[STALL_BRANCH], 18u);
+    uint64_t stalls = 0;
+    for (uint64_t s : p.stalls) stalls += s;
+    EXPECT_EQ(p.cycles, p.instructions + 4 + stalls);
+    free_cache();
+}
+
+// 24. Out-of-order timing tests
+static RetiredInstr divide(uint8_t rd, uint8_t rs) {
+    RetiredInstr r = alu(rd, rs);
+    r.op = OP_DIV;
+    return r;
+}
+
+TEST(OooTest, IndependentInstructionsFillTheWidth) {
+    OooModel m;
+    m.reset(OooConfig());
+    for (int i = 0; i < 400; i++) m.retire(alu(R1 + i % 8, R9));
+    m.finish();
+    EXPECT_EQ(m.stats.instructions, 400u);
+    EXPECT_GT(m.stats.ipc(), 3.9);
+}
+
+TEST(OooTest, DependentDividesSerialise) {
+    OooModel m;
+    m.reset(OooConfig());
+    for (int i = 0; i < 10; i++) m.retire(divide(R1, R1));
+    m.finish();
+    EXPECT_GE(m.stats.cycles, 10u * OooConfig().div);
+    EXPECT_LT(m.stats.cycles, 10u * OooConfig().div + 5);
+}
+
+TEST(OooTest, ALargerWindowHidesAMiss) {
+    const auto run = [](uint32_t rob) {
+        OooConfig cfg;
+        cfg.rob = rob;
+        cfg.rs = rob;
+        OooModel m;
+        m.reset(cfg);
+        m.retire(load(R1, 101));
+        for (int i = 0; i < 100; i++) m.retire(alu(R2, R2));  // a dependent chain, one a cycle at best
+        m.finish();
+        return m.stats.cycles;
+    };
+    uint64_t small = run(8), large = run(256);
+    EXPECT_GT(small, 190u);  // most of the chain waits for the load to leave the window
+    EXPECT_LT(large, 140u);  // the chain runs under the miss, only commit is left after it
+}
+
+TEST(OooTest, IndependentMissesOverlap) {
+    OooModel m;
+    m.reset(OooConfig());
+    m.retire(load(R1, 101));
+    m.retire(load(R2, 101));
+    m.retire(load(R3, 101));
+    m.finish();
+    EXPECT_NEAR(m.stats.mlp(), 3.0, 0.1);
+
+    m.reset(OooConfig());
+    m.retire(load(R1, 101));
+    RetiredInstr chased = load(R2, 101);
+    chased.op = OP_ILDR;
+    chased.src[0] = R1;  // address comes from the first load
+    m.retire(chased);
+    m.finish();
+    EXPECT_NEAR(m.stats.mlp(), 1.0, 0.01);
+}
+
+TEST(OooTest, SpecOverridesTheDefaults) {
+    OooConfig cfg;
+    ASSERT_TRUE(parseOooSpec("width=2,rob=32,div=20", cfg));
+    EXPECT_EQ(cfg.width, 2u);
+    EXPECT_EQ(cfg.rob, 32u);
+    EXPECT_EQ(cfg.div, 20u);
+    EXPECT_EQ(cfg.rs, OooConfig().rs);
+    EXPECT_TRUE(parseOooSpec("default", cfg));
+    EXPECT_EQ(cfg.width, OooConfig().width);
+    EXPECT_FALSE(parseOooSpec("width=0", cfg));
+    EXPECT_FALSE(parseOooSpec("ports=2", cfg));
+    EXPECT_FALSE(parseOooSpec("width", cfg));
+}
+
+TEST_F(RunLoopTest, OooModelRunsOnItsOwnThread) {
+    put(0, OP_MOVI, R1, 10);
+    put(8, OP_ADDI, R1, static_cast<uint32_t>(-1));  // loop:
+    prog_mem[10] = R1;
+    put(16, OP_BNZ, R1, 8);
+    put(24, OP_TRP, 0, 0);
+    init_cache(DIRECT_MAPPED);
+
+    ooo_start(OooConfig());
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    ooo_finish();
+
+    EXPECT_FALSE(ooo_enabled);
+    EXPECT_EQ(ooo.stats.instructions, 22u);
+    EXPECT_GT(ooo.stats.cycles, 22u / OooConfig().width);
+    free_cache();
+}
+
+// 25. Branch prediction tests
+static RetiredInstr control(uint8_t op, uint8_t flags, uint32_t pc, uint32_t nextPc, uint32_t target = 0) {
+    RetiredInstr r;
+    r.op = op;
+    r.flags = flags;
+    r.pc = pc;
+    r.nextPc = nextPc;
+    r.target = target;
+    return r;
+}
+
+// a loop branch at 0x100 back to 0x80, taken `trips - 1` times then falling through
+static uint64_t loopMisses(PredictorKind kind, int loops, int trips) {
+    BranchUnit u(kind);
+    for (int l = 0; l < loops; l++)
+        for (int t = 0; t < trips; t++) {
+            bool taken = t != trips - 1;
+            u.retire(control(OP_BNZ, RETIRE_BRANCH | (taken ? RETIRE_TAKEN : 0), 0x100, taken ? 0x80 : 0x108, 0x80));
+        }
+    return u.stats.directionMisses;
+}
+
+TEST(BranchPredictorTest, BackwardBranchesPredictTakenStatically) {
+    EXPECT_EQ(loopMisses(PRED_STATIC, 10, 5), 10u);  // every loop exit
+    BranchUnit u(PRED_STATIC);
+    EXPECT_TRUE(u.retire(control(OP_BRZ, RETIRE_BRANCH | RETIRE_TAKEN, 0x100, 0x200, 0x200)));  // forward, taken
+}
+
+TEST(BranchPredictorTest, HistoryLearnsShortLoopExits) {
+    // bimodal keeps missing the exit, the history based ones learn where it is
+    EXPECT_GE(loopMisses(PRED_BIMODAL, 200, 4), 190u);
+    EXPECT_LT(loopMisses(PRED_GSHARE, 200, 4), 20u);
+    EXPECT_LT(loopMisses(PRED_TAGE, 200, 4), 20u);
+}
+
+TEST(BranchPredictorTest, ReturnStackPredictsReturns) {
+    BranchUnit u(PRED_GSHARE);
+    for (int i = 0; i < 3; i++) {
+        // two call sites of the same helper
+        u.retire(control(OP_CALL, RETIRE_JUMP | RETIRE_STORE | RETIRE_TAKEN, 0x10, 0x400, 0x400));
+        EXPECT_FALSE(u.retire(control(OP_RET, RETIRE_JUMP | RETIRE_INDIRECT | RETIRE_TAKEN, 0x420, 0x18)));
+        u.retire(control(OP_CALL, RETIRE_JUMP | RETIRE_STORE | RETIRE_TAKEN, 0x40, 0x400, 0x400));
+        EXPECT_FALSE(u.retire(control(OP_RET, RETIRE_JUMP | RETIRE_INDIRECT | RETIRE_TAKEN, 0x420, 0x48)));
+    }
+    EXPECT_EQ(u.stats.targetMisses, 2u);  // only the first sight of each CALL in the BTB
+    EXPECT_TRUE(u.retire(control(OP_RET, RETIRE_JUMP | RETIRE_INDIRECT | RETIRE_TAKEN, 0x420, 0x18)));  // empty
+}
+
+TEST(BranchPredictorTest, PredictorListParses) {
+    vector<PredictorKind> kinds;
+    ASSERT_TRUE(parsePredictorList("static,tage", kinds));
+    ASSERT_EQ(kinds.size(), 2u);
+    EXPECT_EQ(kinds[1], PRED_TAGE);
+    EXPECT_FALSE(parsePredictorList("", kinds));
+    EXPECT_FALSE(parsePredictorList("gshare,perceptron", kinds));
+}
+
+TEST_F(RunLoopTest, PredictedBranchesCostThePipelineNothing) {
+    put(0, OP_MOVI, R1, 50);
+    put(8, OP_ADDI, R1, static_cast<uint32_t>(-1));  // loop:
+    prog_mem[10] = R1;
+    put(16, OP_BNZ, R1, 8);
+    put(24, OP_TRP, 0, 0);
+
+    bpred_start({PRED_BIMODAL}, false);
+    inorder_start(PipelineConfig());
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    inorder_enabled = false;
+    bpred_enabled = false;
+
+    const BranchStats& b = bpred_units[0].stats;
+    EXPECT_EQ(b.branches, 50u);
+    uint64_t misses = b.mispredicts();
+    EXPECT_LE(misses, 4u);  // warming up, and the exit
+    EXPECT_EQ(inorder.stats.stalls[STALL_BRANCH], 2 * misses);  // resolved in EX
+    EXPECT_EQ(bpred_instructions, 102u);
+}
+
+// 26. Cost model tests
+static string costFile(const string& text) {
+    const string path = testTempPath("costs.txt");
+    ofstream(path) << text;
+    return path;
+}
+
+TEST(CostModelTest, FileOverridesOnlyWhatItNames) {
+    CostModel m;
+    string error;
+    const string path = costFile("# board B\nhit = 2\n  fill_next_word=4  # slower bus\nexecute.* = 1\nexecute.DIV = 20\n");
+    ASSERT_TRUE(load_cost_model(path.c_str(), m, error)) << error;
+    EXPECT_EQ(m.hit, 2u);
+    EXPECT_EQ(m.transfer(4), 8u + 3 * 4);
+    EXPECT_EQ(m.uncachedWord, 8u);
+    EXPECT_EQ(m.execute[OP_DIV], 20u);
+    EXPECT_EQ(m.execute[OP_ADD], 1u);
+    EXPECT_TRUE(m.executeCosts);
+    remove(path.c_str());
+}
+
+TEST(CostModelTest, RejectsUnknownKeysAndBadValues) {
+    CostModel m;
+    string error;
+    EXPECT_FALSE(load_cost_model("no_such.costs", m, error));
+
+    const string path = costFile("hit = 1\nmiss = 40\n");
+    EXPECT_FALSE(load_cost_model(path.c_str(), m, error));
+    EXPECT_EQ(error, "line 2: unknown key miss");
+    costFile("execute.FOO = 3\n");
+    EXPECT_FALSE(load_cost_model(path.c_str(), m, error));
+    costFile("hit = -1\n");
+    EXPECT_FALSE(load_cost_model(path.c_str(), m, error));
+    EXPECT_EQ(m.hit, 1u);  // untouched by a rejected file
+    remove(path.c_str());
+}
+
+TEST_F(RunLoopTest, CostModelChargesMemoryExecuteAndTraps) {
+    put(0, OP_MOVI, R1, 7);
+    put(8, OP_DIVI, R1, 1);
+    prog_mem[10] = R1;
+    put(16, OP_TRP, 0, 1);
+    put(24, OP_TRP, 0, 0);
+
+    testing::internal::CaptureStdout();
+    ASSERT_TRUE(runLoop());
+    const uint64_t base = mem_cycle_cntr;
+    EXPECT_EQ(base, 4u * (8 + 2));  // the defaults charge nothing but fetches
+
+    reg_file[PC] = 0;
+    runBool = true;
+    mem_cycle_cntr = 0;
+    cost_model.uncachedWord = 4;
+    cost_model.execute[OP_DIVI] = 20;
+    cost_model.executeCosts = true;
+    cost_model.trapIo = 100;
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    cost_model = CostModel();
+    EXPECT_EQ(mem_cycle_cntr, 4u * (4 + 2) + 20 + 100);
+}
+
+TEST_F(CacheTest, CostModelPricesHitsAndFills) {
+    init_cache(1);
+    mem_cycle_cntr = 0;
+    cost_model.fillFirstWord = 10;
+    cost_model.hit = 3;
+    readWord(64);
+    EXPECT_EQ(mem_cycle_cntr, 10u + 2 * (BLOCK_SIZE / 4 - 1) + 3);  // the fill, then the hit it serves
+    mem_cycle_cntr = 0;
+    readWord(68);
+    EXPECT_EQ(mem_cycle_cntr, 3u);
+    cost_model = CostModel();
+}
+
+// 27. DRAM tests
+TEST(DramTest, RowBufferDecidesTheLatency) {
+    DramModel d;
+    d.reset(DramConfig());  // 8 banks of 1024 byte rows, tRCD = tCAS = tRP = 4
+    EXPECT_EQ(d.access(0, 4, false), 4u + 4 + 3 * 2);            // miss: activate, then the burst
+    EXPECT_EQ(d.access(64, 4, false), 4u + 3 * 2);               // same row
+    EXPECT_EQ(d.access(1024, 1, true), 4u + 4);                  // next bank, nothing open yet
+    EXPECT_EQ(d.access(8 * 1024, 1, false), 4u + 4 + 4);         // bank 0 again, another row
+    EXPECT_EQ(d.stats.rowHits, 1u);
+    EXPECT_EQ(d.stats.rowMisses, 2u);
+    EXPECT_EQ(d.stats.rowConflicts, 1u);
+    EXPECT_EQ(d.stats.reads, 3u);
+    EXPECT_EQ(d.stats.writes, 1u);
+    EXPECT_EQ(d.stats.cycles, 14u + 10 + 8 + 12);
+}
+
+TEST(DramTest, ClosedPageNeverHitsOrConflicts) {
+    DramConfig cfg;
+    ASSERT_TRUE(parseDramSpec("page=closed,trcd=6", cfg));
+    DramModel d;
+    d.reset(cfg);
+    EXPECT_EQ(d.access(0, 1, false), 6u + 4);
+    EXPECT_EQ(d.access(4, 1, false), 6u + 4);
+    EXPECT_EQ(d.access(8 * 1024, 1, false), 6u + 4);
+    EXPECT_EQ(d.stats.rowMisses, 3u);
+}
+
+TEST(DramTest, SpecParses) {
+    DramConfig cfg;
+    ASSERT_TRUE(parseDramSpec("banks=4,row=2048,tcas=3,burst=1", cfg));
+    EXPECT_EQ(cfg.banks, 4u);
+    EXPECT_EQ(cfg.rowSize, 2048u);
+    EXPECT_EQ(cfg.tCAS, 3u);
+    EXPECT_EQ(cfg.policy, PAGE_OPEN);
+    EXPECT_TRUE(parseDramSpec("default", cfg));
+    EXPECT_FALSE(parseDramSpec("banks=3", cfg));
+    EXPECT_FALSE(parseDramSpec("row=64", cfg));  // smaller than a block can be
+    EXPECT_FALSE(parseDramSpec("page=lazy", cfg));
+    EXPECT_FALSE(parseDramSpec("ranks=2", cfg));
+}
+
+TEST_F(CacheTest, DramTimesFillsAndWriteBacks) {
+    dram_start(DramConfig());
+    init_cache(1);
+    mem_cycle_cntr = 0;
+    readWord(0);
+    EXPECT_EQ(mem_cycle_cntr, (4u + 4 + 3 * 2) + 1);  // row miss, then the hit it serves
+    mem_cycle_cntr = 0;
+    readWord(16);
+    EXPECT_EQ(mem_cycle_cntr, (4u + 3 * 2) + 1);  // the next block is in the open row
+
+    // a dirty block pushed out by the one 8 KiB on: same set, same bank, the next row
+    writeWord(32, 7);
+    mem_cycle_cntr = 0;
+    readWord(32 + 8 * 1024);
+    EXPECT_EQ(dram.stats.writes, 1u);
+    EXPECT_EQ(dram.stats.rowConflicts, 1u);
+    EXPECT_EQ(mem_cycle_cntr, (4u + 3 * 2) + (4u + 4 + 4 + 3 * 2) + 1);  // write-back in the open row, then the fill
+
+    dram_enabled = false;
+    cache_model.memory = nullptr;
+}
+
+// 28. MSHR tests
+static CacheConfig withMshrs(uint32_t mshrs) {
+    CacheConfig cfg;  // direct mapped, 16 byte blocks: a fill is 8 + 3 * 2 cycles
+    cfg.mshrs = mshrs;
+    return cfg;
+}
+
+TEST(MshrTest, ReadsMergeIntoAFillInFlight) {
+    CacheModel m;
+    ASSERT_TRUE(m.configure(withMshrs(2)));
+    uint64_t stamp = 0;
+    EXPECT_EQ(m.checkCache(0, WRITEWORD, ++stamp).cycles, 1u);  // posted
+    EXPECT_EQ(m.checkCache(4, READWORD, ++stamp).cycles, 1u + 13);  // the rest of the fill
+    EXPECT_EQ(m.checkCache(8, READWORD, ++stamp).cycles, 1u);  // landed by now
+    EXPECT_EQ(m.stats.secondaryMisses, 1u);
+    EXPECT_EQ(m.stats.misses, 1u);
+    EXPECT_EQ(m.stats.cycles, 16u);
+    EXPECT_EQ(m.stats.blockingCycles, 15u + 1 + 1);
+}
+
+TEST(MshrTest, StoresCompeteForMshrsAndOverlap) {
+    CacheModel m;
+    ASSERT_TRUE(m.configure(withMshrs(2)));
+    uint64_t stamp = 0;
+    EXPECT_EQ(m.checkCache(0, WRITEWORD, ++stamp).cycles, 1u);   // in flight over [0, 14)
+    EXPECT_EQ(m.checkCache(16, WRITEWORD, ++stamp).cycles, 1u);  // and [1, 15)
+    EXPECT_EQ(m.checkCache(32, WRITEWORD, ++stamp).cycles, 12u + 1);  // waits for the first to land
+    EXPECT_EQ(m.stats.mshrStallCycles, 12u);
+    EXPECT_EQ(m.stats.missCycles, 3u * 14);
+    EXPECT_EQ(m.stats.missBusyCycles, 28u);  // [0, 28)
+    EXPECT_DOUBLE_EQ(m.stats.mlp(), 1.5);
+}
+
+TEST(MshrTest, ReadMissesStillBlockAndWriteBacksArePosted) {
+    CacheModel m;
+    ASSERT_TRUE(m.configure(withMshrs(4)));
+    uint64_t stamp = 0;
+    EXPECT_EQ(m.checkCache(0, READWORD, ++stamp).cycles, 14u + 1);
+    EXPECT_EQ(m.checkCache(0, WRITEWORD, ++stamp).cycles, 1u);
+    EXPECT_EQ(m.checkCache(1024, READWORD, ++stamp).cycles, 14u + 1);  // dirty block out, its write-back overlaps
+    EXPECT_EQ(m.stats.writebacks, 1u);
+    EXPECT_EQ(m.stats.blockingCycles, 15u + 1 + 29);
+
+    CacheModel blocking;
+    ASSERT_TRUE(blocking.configure(withMshrs(0)));
+    stamp = 0;
+    blocking.checkCache(0, READWORD, ++stamp);
+    blocking.checkCache(0, WRITEWORD, ++stamp);
+    EXPECT_EQ(blocking.checkCache(1024, READWORD, ++stamp).cycles, 29u);
+    EXPECT_EQ(blocking.stats.blockingCycles, 0u);  // not counted without MSHRs
+}
+
+TEST(MshrTest, SweepGridAndLimits) {
+    vector<SweepPoint> grid;
+    ASSERT_TRUE(parseSweepGrid("mshrs=0,8", grid));
+    ASSERT_EQ(grid.size(), 2u);
+    EXPECT_EQ(grid[1].mshrs, 8u);
+    CacheModel m;
+    EXPECT_FALSE(m.configure(withMshrs(MAX_MSHRS + 1)));
+}
+
+// 29. MMU tests
+class MmuTest : public RunLoopTest {
+   protected:
+    void TearDown() override {
+        mmu_enabled = false;
+        RunLoopTest::TearDown();
+    }
+    static void setPte(uint32_t vpn, uint32_t pte) {
+        memcpy(&prog_mem[mmu.tableBase + 4 * vpn], &pte, 4);
+    }
+};
+
+TEST_F(MmuTest, IdentityTableSitsAboveTheStack) {
+    ASSERT_TRUE(mmu_start(MmuConfig()));
+    EXPECT_EQ(mmu.tableBase, kMem - 4096);  // 32 entries, rounded to a page
+    EXPECT_EQ(reg_file[SB], mmu.tableBase);
+    EXPECT_EQ(reg_file[SP], mmu.tableBase);
+
+    mem_cycle_cntr = 0;
+    writeWord(100, 42);
+    EXPECT_EQ(mem_cycle_cntr, 8u + 8);  // walk, then the access
+    EXPECT_EQ(readWord(100), 42u);
+    EXPECT_EQ(mem_cycle_cntr, 8u + 8 + 8);
+    EXPECT_EQ(mmu.stats.misses, 1u);
+    EXPECT_EQ(mmu.stats.hits, 1u);
+
+    MmuConfig odd;
+    odd.pageSize = 1u << 20;  // bigger than memory
+    EXPECT_FALSE(mmu_start(odd));
+}
+
+TEST_F(MmuTest, RemappedAndProtectedPages) {
+    ASSERT_TRUE(mmu_start(MmuConfig()));
+    setPte(1, 2 * 4096 | PTE_VALID | PTE_WRITABLE);
+    setPte(3, 3 * 4096 | PTE_VALID);  // read-only
+    setPte(4, 0);
+    ASSERT_TRUE(mmu_set_table(mmu.tableBase));
+
+    writeWord(4096 + 8, 0xCAFE);
+    EXPECT_EQ(memcmp(&prog_mem[2 * 4096 + 8], "\xFE\xCA\0\0", 4), 0);
+    EXPECT_EQ(trap_code, TRAP_NONE);
+
+    readByte(3 * 4096);
+    EXPECT_EQ(trap_code, TRAP_NONE);
+    writeByte(3 * 4096, 1);
+    EXPECT_EQ(trap_code, TRAP_PAGE_FAULT);
+    EXPECT_EQ(mmu.faultAddress, 3u * 4096);
+
+    trap_code = TRAP_NONE;
+    readWord(4 * 4096 - 2);  // runs into the unmapped page
+    EXPECT_EQ(trap_code, TRAP_PAGE_FAULT);
+    EXPECT_EQ(mmu.stats.faults, 2u);
+    trap_code = TRAP_NONE;
+}
+
+TEST_F(MmuTest, WordsRunIntoPagesInFramesApart) {
+    ASSERT_TRUE(mmu_start(MmuConfig()));
+    setPte(1, 5 * 4096 | PTE_VALID | PTE_WRITABLE);
+    setPte(2, 3 * 4096 | PTE_VALID | PTE_WRITABLE);
+    ASSERT_TRUE(mmu_set_table(mmu.tableBase));
+
+    writeWord(2 * 4096 - 1, 0x44332211);
+    EXPECT_EQ(trap_code, TRAP_NONE);
+    EXPECT_EQ(prog_mem[6 * 4096 - 1], 0x11);
+    EXPECT_EQ(memcmp(&prog_mem[3 * 4096], "\x22\x33\x44", 3), 0);
+    EXPECT_EQ(readWord(2 * 4096 - 1), 0x44332211u);
+    EXPECT_EQ(mmu.stats.faults, 0u);
+
+    setPte(2, 3 * 4096 | PTE_VALID);  // read-only now: nothing of the word is written
+    ASSERT_TRUE(mmu_set_table(mmu.tableBase));
+    writeWord(2 * 4096 - 1, 0);
+    EXPECT_EQ(trap_code, TRAP_PAGE_FAULT);
+    EXPECT_EQ(prog_mem[6 * 4096 - 1], 0x11);
+    trap_code = TRAP_NONE;
+}
+
+TEST_F(MmuTest, WordInFramesApartIsOneAccessInTwoLookups) {
+    ASSERT_TRUE(mmu_start(MmuConfig()));
+    setPte(1, 5 * 4096 | PTE_VALID | PTE_WRITABLE);
+    setPte(2, 3 * 4096 | PTE_VALID | PTE_WRITABLE);
+    ASSERT_TRUE(mmu_set_table(mmu.tableBase));
+    ASSERT_TRUE(configure_cache(16, 64, 1));
+    region_stats_start();
+    access_hooks = true;
+
+    writeWord(2 * 4096 - 2, 0x44332211);
+    EXPECT_EQ(cache_model.stats.misses, 2u);
+    EXPECT_EQ(cache_model.stats.splits, 1u);
+    EXPECT_EQ(cache_model.stats.batchedFills, 0u);  // the second frame isn't the next block
+    EXPECT_EQ(region_stats[REGION_FREE].writes, 1u);
+
+    mem_cycle_cntr = 0;
+    EXPECT_EQ(readWord(2 * 4096 - 2), 0x44332211u);
+    EXPECT_EQ(mem_cycle_cntr, 2 * cost_model.hit);
+    EXPECT_EQ(cache_model.stats.hits, 2u);
+    EXPECT_EQ(region_stats[REGION_FREE].reads, 1u);
+
+    access_hooks = false;
+    region_stats_enabled = false;
+    cache_model.regionStats = nullptr;
+    free_cache();
+}
+
+TEST_F(MmuTest, TlbReplacesLeastRecentlyUsed) {
+    MmuConfig cfg;
+    ASSERT_TRUE(parseMmuSpec("tlb=2,assoc=full,page=256", cfg));
+    ASSERT_TRUE(mmu_start(cfg));
+    for (uint32_t page : {0, 1, 0, 2, 0, 1})
+        readByte(page * 256);
+    EXPECT_EQ(mmu.stats.misses, 4u);  // 0, 1, 2, then 1 again: 2 pushed it out
+    EXPECT_EQ(mmu.stats.hits, 2u);
+}
+
+TEST_F(MmuTest, TrapsReadAndSetTheTableBase) {
+    ASSERT_TRUE(mmu_start(MmuConfig()));
+    put(0, OP_TRP, 0, TRP_PT_GET);
+    put(8, OP_TRP, 0, TRP_PT_SET);
+    put(16, OP_TRP, 0, 0);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(runLoop());
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(reg_file[R3], mmu.tableBase);
+    EXPECT_EQ(mmu.stats.flushes, 1u);
+    EXPECT_FALSE(mmu_set_table(kMem - 4));  // the table would run past memory
+}
+
+TEST_F(InstrTest, FetchIgnoresAnEarlierTrap) {
+    reg_file[PC] = mem_size - 3;
+    EXPECT_FALSE(fetch());
+    reg_file[PC] = 0;
+    EXPECT_TRUE(fetch());  // TRAP_OUT_OF_BOUNDS is still in `trap_code`, no MMU to fault
+}
+
+TEST(MmuSpecTest, Parses) {
+    MmuConfig cfg;
+    ASSERT_TRUE(parseMmuSpec("page=1024,tlb=16,assoc=2,policy=fifo,walk=20", cfg));
+    EXPECT_EQ(cfg.pageSize, 1024u);
+    EXPECT_EQ(cfg.entries, 16u);
+    EXPECT_EQ(cfg.ways, 2u);
+    EXPECT_EQ(cfg.policy, POLICY_FIFO);
+    EXPECT_EQ(cfg.walkCycles, 20u);
+    EXPECT_FALSE(parseMmuSpec("page=1000", cfg));
+    EXPECT_FALSE(parseMmuSpec("tlb=8,assoc=16", cfg));
+    EXPECT_FALSE(parseMmuSpec("levels=2", cfg));
+}
+
+// 30. Straddling access tests
+TEST_F(CacheTest, StraddlingWordTakesTwoLookupsAndOneBatchedFill) {
+    ASSERT_TRUE(configure_cache(16, 64, 1));
+    writeWord(14, 0x44332211);
+    EXPECT_EQ(mem_cycle_cntr, 14u + 1 + 4 * 2 + 1);  // the second block only pays its words
+    EXPECT_EQ(cache_model.stats.misses, 2u);
+    EXPECT_EQ(cache_model.stats.splits, 1u);
+    EXPECT_EQ(cache_model.stats.batchedFills, 1u);
+
+    EXPECT_EQ(readWord(14), 0x44332211u);
+    EXPECT_EQ(readByte(15), 0x22);
+    EXPECT_EQ(readByte(16), 0x33);
+    EXPECT_EQ(cache_model.stats.hits, 4u);
+
+    writeWord(0x40E, 0);  // evicts both dirty halves
+    EXPECT_EQ(prog_mem[14], 0x11);
+    EXPECT_EQ(prog_mem[17], 0x44);
+}
+
+TEST_F(CacheTest, StraddlingWordStaysInsideLargestBlock) {
+    ASSERT_TRUE(configure_cache(MAX_BLOCK_SIZE, 8, 1));
+    writeWord(MAX_BLOCK_SIZE - 2, 0xCAFEF00D);
+    EXPECT_EQ(readWord(MAX_BLOCK_SIZE - 2), 0xCAFEF00Du);
+    EXPECT_EQ(readWord(MAX_BLOCK_SIZE - 8), 0xAAAAAAAAu);
+    EXPECT_EQ(readWord(MAX_BLOCK_SIZE + 2), 0xAAAAAAAAu);
+    EXPECT_EQ(cache_model.stats.splits, 2u);
+}
+
+TEST_F(CacheTest, ShardedReplaySplitsStraddlingWordsLikeALiveRun) {
+    const string path = testTempPath("straddle_test.trace");
+    ASSERT_TRUE(configure_cache(16, 64, 4));
+    ASSERT_TRUE(trace_open(path.c_str()));
+    access_hooks = true;
+
+    uint32_t x = 54321;
+    for (int i = 0; i < 5000; i++) {
+        x = x * 1103515245u + 12345u;
+        uint32_t addr = (x >> 8) % 0x3FF0;
+        if (x >> 31)
+            readWord(addr);
+        else
+            writeWord(addr, 2);
+    }
+    access_hooks = false;
+    ASSERT_TRUE(trace_close());
+
+    CacheConfig cfg;
+    cfg.ways = 4;
+    ReplayResult one, many;
+    ASSERT_TRUE(replayTrace(path.c_str(), cfg, 1, one));
+    ASSERT_TRUE(replayTrace(path.c_str(), cfg, 3, many));
+    EXPECT_EQ(one.accesses, 5000u);
+    EXPECT_EQ(one.cycles, mem_cycle_cntr);
+    EXPECT_EQ(one.stats.splits, cache_model.stats.splits);
+    EXPECT_EQ(one.stats.batchedFills, cache_model.stats.batchedFills);
+    EXPECT_GT(one.stats.batchedFills, 0u);
+
+    EXPECT_EQ(many.accesses, one.accesses);
+    EXPECT_EQ(many.cycles, one.cycles);
+    EXPECT_EQ(many.stats.misses, one.stats.misses);
+    EXPECT_EQ(many.stats.splits, one.stats.splits);
+    EXPECT_EQ(many.stats.batchedFills, one.stats.batchedFills);
+    remove(path.c_str());
+}
+
+// 31. Sectored line tests
+static CacheConfig sectored(uint32_t sectorSize, uint32_t sectorFill = 1) {
+    CacheConfig cfg;
+    cfg.blockSize = 64;
+    cfg.sectorSize = sectorSize;
+    cfg.sectorFill = sectorFill;
+    return cfg;
+}
+
+TEST(SectorTest, MissesFetchOnlyTheSectorsTheyNeed) {
+    CacheModel m;
+    ASSERT_TRUE(m.configure(sectored(8)));
+    uint64_t stamp = 0;
+    EXPECT_EQ(m.checkCache(0, READWORD, ++stamp).cycles, 8u + 2 + 1);   // two words
+    EXPECT_EQ(m.checkCache(4, READBYTE, ++stamp).cycles, 1u);
+    EXPECT_EQ(m.checkCache(8, READWORD, ++stamp).cycles, 8u + 2 + 1);   // block resident, sector not
+    EXPECT_EQ(m.checkCache(22, READWORD, ++stamp).cycles, 8u + 3 * 2 + 1);  // runs over two sectors
+    EXPECT_EQ(m.stats.misses, 3u);
+    EXPECT_EQ(m.stats.sectorMisses, 2u);
+    EXPECT_EQ(m.stats.sectorFills, 4u);
+}
+
+TEST(SectorTest, SectorMissesAreTheFourthMissClass) {
+    CacheConfig cfg = sectored(8);
+    cfg.lines = 2;
+    cfg.classify = true;
+    CacheModel m;
+    ASSERT_TRUE(m.configure(cfg));  // two sets of one line
+    uint64_t stamp = 0;
+    m.checkCache(0, READBYTE, ++stamp);    // compulsory
+    m.checkCache(8, READBYTE, ++stamp);    // sector
+    m.checkCache(128, READBYTE, ++stamp);  // compulsory, same set
+    m.checkCache(16, READBYTE, ++stamp);   // conflict
+    m.checkCache(24, READBYTE, ++stamp);   // sector
+    EXPECT_EQ(m.stats.compulsory, 2u);
+    EXPECT_EQ(m.stats.conflict, 1u);
+    EXPECT_EQ(m.stats.sectorMisses, 2u);
+    EXPECT_EQ(m.stats.compulsory + m.stats.capacity + m.stats.conflict + m.stats.sectorMisses, m.stats.misses);
+    const CacheStats& set = m.setStats[0];
+    EXPECT_EQ(set.compulsory + set.capacity + set.conflict + set.sectorMisses, set.misses);
+
+    const std::string path = testTempPath("sector_report.txt");
+    ASSERT_TRUE(write_cache_report(path.c_str(), cfg, m.stats, m.setStats));
+    std::ifstream in(path);
+    std::stringstream report;
+    report << in.rdbuf();
+    in.close();
+    remove(path.c_str());
+    EXPECT_NE(report.str().find("compulsory  capacity  conflict  sector"), std::string::npos);
+}
+
+TEST(SectorTest, FillGroupsBringInNeighbours) {
+    CacheModel m;
+    ASSERT_TRUE(m.configure(sectored(8, 4)));
+    uint64_t stamp = 0;
+    EXPECT_EQ(m.checkCache(40, READWORD, ++stamp).cycles, 8u + 7 * 2 + 1);  // sectors 4-7
+    EXPECT_EQ(m.checkCache(32, READWORD, ++stamp).cycles, 1u);
+    EXPECT_EQ(m.checkCache(0, READWORD, ++stamp).cycles, 8u + 7 * 2 + 1);
+    EXPECT_EQ(m.stats.sectorFills, 8u);
+
+    EXPECT_FALSE(m.configure(sectored(2)));
+    EXPECT_FALSE(m.configure(sectored(128)));
+    EXPECT_FALSE(m.configure(sectored(8, 16)));
+    EXPECT_FALSE(m.configure(sectored(8, 3)));
+}
+
+TEST_F(CacheTest, SectoredLinesWriteBackOnlyDirtySectors) {
+    ASSERT_TRUE(configure_cache(sectored(4)));
+    writeWord(8, 0x12345678);
+    readWord(12);
+    mem_cycle_cntr = 0;
+    readWord(0x1000);  // same set: evicts the line with one dirty sector
+    EXPECT_EQ(mem_cycle_cntr, 8u + 8 + 1);
+    EXPECT_EQ(prog_mem[8], 0x78);
+    EXPECT_EQ(prog_mem[12], 0xAA);
+    EXPECT_EQ(cache_model.stats.evictedSectors, 16u);
+    EXPECT_EQ(cache_model.stats.evictedValid, 2u);
+    EXPECT_EQ(cache_model.stats.evictedUsed, 2u);
+    EXPECT_DOUBLE_EQ(cache_model.stats.sectorUtilization(), 0.125);
+}
+
+TEST(SectorTest, SweepGridKeys) {
+    vector<SweepPoint> grid;
+    ASSERT_TRUE(parseSweepGrid("block=64;sector=0,8;sector_fill=1,2", grid));
+    ASSERT_EQ(grid.size(), 4u);
+    EXPECT_EQ(grid[0].sectorSize, 0u);
+    EXPECT_EQ(grid[3].sectorSize, 8u);
+    EXPECT_EQ(grid[3].sectorFill, 2u);
+    EXPECT_FALSE(parseSweepGrid("sector_fill=0", grid));
+}
+
+// 32. Way partitioning tests
+static CacheConfig partitioned(PartitionMode mode, uint32_t ways) {
+    CacheConfig cfg;
+    cfg.lines = ways;  // a single set
+    cfg.ways = ways;
+    cfg.partition = mode;
+    return cfg;
+}
+
+TEST(PartitionTest, FixedQuotasConfineFillsButNotHits) {
+    CacheModel m;
+    CacheConfig cfg = partitioned(PARTITION_FIXED, 4);
+    ASSERT_TRUE(m.configure(cfg));  // one way each
+    uint64_t stamp = 0;
+    m.checkCache(0x000, READWORD, ++stamp, REGION_CODE, PART_STACK);
+    m.checkCache(0x100, READWORD, ++stamp, REGION_CODE, PART_CODE);
+    m.checkCache(0x200, READWORD, ++stamp, REGION_CODE, PART_CODE);  // evicts 0x100, never the stack's block
+    EXPECT_TRUE(m.checkCache(0x000, READWORD, ++stamp, REGION_CODE, PART_STACK).hit);
+    EXPECT_FALSE(m.checkCache(0x100, READWORD, ++stamp, REGION_CODE, PART_CODE).hit);
+    EXPECT_TRUE(m.checkCache(0x000, READBYTE, ++stamp, REGION_CODE, PART_HEAP).hit);  // hits in any way
+    EXPECT_EQ(m.stats.partMisses[PART_CODE], 3u);
+    EXPECT_EQ(m.stats.partHits[PART_STACK], 1u);
+    EXPECT_EQ(m.stats.partHits[PART_HEAP], 1u);
+
+    cfg.quotas[PART_CODE] = 3;
+    cfg.quotas[PART_STACK] = 1;
+    EXPECT_FALSE(m.configure(cfg));  // every partition needs a way
+    cfg.quotas[PART_CODE] = 1;
+    cfg.quotas[PART_STATIC] = cfg.quotas[PART_HEAP] = 1;
+    ASSERT_TRUE(m.configure(cfg));
+    EXPECT_EQ(m.firstWay[PART_STACK], 3u);
+    EXPECT_FALSE(m.configure(partitioned(PARTITION_FIXED, 2)));
+}
+
+TEST(PartitionTest, UtilityGivesWaysToThePartitionThatReusesThem) {
+    CacheModel m;
+    CacheConfig cfg = partitioned(PARTITION_UTILITY, 8);
+    cfg.repartition = 100;
+    ASSERT_TRUE(m.configure(cfg));
+    EXPECT_EQ(m.quota[PART_CODE], 2u);
+
+    // code loops over 5 blocks, static data streams through blocks it never touches again
+    uint64_t stamp = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        m.checkCache(0x1000 + (i % 5) * 16, READWORD, ++stamp, REGION_CODE, PART_CODE);
+        m.checkCache(0x8000 + i * 16, READWORD, ++stamp, REGION_CODE, PART_STATIC);
+    }
+    EXPECT_EQ(m.stats.repartitions, 20u);
+    EXPECT_EQ(m.quota[PART_CODE], 5u);
+    uint64_t misses = m.stats.partMisses[PART_CODE];
+    for (uint32_t i = 0; i < 50; i++)
+        m.checkCache(0x1000 + (i % 5) * 16, READWORD, ++stamp, REGION_CODE, PART_CODE);
+    EXPECT_EQ(m.stats.partMisses[PART_CODE], misses);
+}
+
+TEST_F(CacheTest, AccessesArePartitionedByFetchAndLayout) {
+    reg_file[SL] = 0x100;
+    reg_file[HP] = 0x200;
+    reg_file[SP] = 0x400;
+    reg_file[SB] = 0x500;
+    EXPECT_EQ(partitionOf(0x80, CLASS_DATA), PART_STATIC);
+    EXPECT_EQ(partitionOf(0x180, CLASS_DATA), PART_HEAP);
+    EXPECT_EQ(partitionOf(0x300, CLASS_DATA), PART_STACK);  // the free gap the stack grows into
+    EXPECT_EQ(partitionOf(0x480, CLASS_DATA), PART_STACK);
+    EXPECT_EQ(partitionOf(0x80, CLASS_IFETCH), PART_CODE);
+    EXPECT_EQ(regionOf(0x480), REGION_STACK);  // the same boundaries as the region report
+    EXPECT_EQ(regionOf(0x180), REGION_HEAP);
+
+    ASSERT_TRUE(configure_cache(partitioned(PARTITION_FIXED, 4)));
+    readWord(0x300);
+    readWord(0x180);
+    readWord(0x40, CLASS_IFETCH);  // an instruction in the code below SL
+    EXPECT_EQ(cache_model.stats.partMisses[PART_STACK], 1u);
+    EXPECT_EQ(cache_model.stats.partMisses[PART_HEAP], 1u);
+    EXPECT_EQ(cache_model.stats.partMisses[PART_CODE], 1u);
+    EXPECT_EQ(cache_model.stats.partMisses[PART_STATIC], 0u);
+}
+
+TEST(PartitionTest, SweepGridKeys) {
+    vector<SweepPoint> grid;
+    ASSERT_TRUE(parseSweepGrid("assoc=4;partition=none,fixed,ucp;ways_code=1;ways_stack=1", grid));
+    ASSERT_EQ(grid.size(), 3u);
+    EXPECT_EQ(grid[1].partition, PARTITION_FIXED);
+    EXPECT_EQ(grid[2].partition, PARTITION_UTILITY);
+    EXPECT_EQ(grid[2].quotas[PART_STACK], 1u);
+    EXPECT_FALSE(parseSweepGrid("partition=dynamic", grid));
+}
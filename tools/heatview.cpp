@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "heatmap.h"
+
+using namespace std;
+
+static uint64_t total(const HeatCounts& c) {
+    return static_cast<uint64_t>(c.reads) + c.writes;
+}
+
+/** @brief Renders a heat map written by `emu4380 --heatmap`.
+ *  @details Prints the hottest blocks and a character map of memory, one row per `-width` blocks, leaving out rows
+ *  nobody touched. `-pgm FILE` also writes the same rows as a greyscale image, one pixel per block.
+ *  @return 0 on success, 1 if the heat map can't be read or the image can't be written.
+ */
+int main(int argC, char** argV) {
+    if (argC < 2) {
+        cout << "Usage: " << argV[0] << " <heatmap> [-top N] [-width BLOCKS] [-pgm <output.pgm>]\n";
+        return 1;
+    }
+
+    size_t top = 16;
+    size_t width = 64;
+    string pgm;
+    for (int i = 2; i + 1 < argC; i += 2) {
+        string a = argV[i];
+        if (a == "-top")
+            top = stoul(argV[i + 1]);
+        else if (a == "-width")
+            width = max<size_t>(1, stoul(argV[i + 1]));
+        else if (a == "-pgm")
+            pgm = argV[i + 1];
+    }
+
+    HeatmapHeader header;
+    vector<HeatRecord> records;
+    if (!read_heatmap(argV[1], header, records)) {
+        cerr << "Cannot read heat map: " << argV[1] << "\n";
+        return 1;
+    }
+
+    uint64_t reads = 0, writes = 0, misses = 0, hottest = 0;
+    for (const HeatRecord& r : records) {
+        reads += r.counts.reads;
+        writes += r.counts.writes;
+        misses += r.counts.misses;
+        hottest = max(hottest, total(r.counts));
+    }
+
+    cout << records.size() << " of " << (static_cast<uint64_t>(header.memSize) + header.blockSize - 1) / header.blockSize
+         << " blocks of " << header.blockSize << " bytes touched: " << reads << " reads, " << writes << " writes, "
+         << misses << " misses\n\n";
+
+    // hottest blocks
+    vector<HeatRecord> byHeat = records;
+    sort(byHeat.begin(), byHeat.end(), [](const HeatRecord& a, const HeatRecord& b) {
+        return total(a.counts) > total(b.counts);
+    });
+    cout << setw(12) << "address" << setw(12) << "reads" << setw(12) << "writes" << setw(12) << "misses" << '\n';
+    for (size_t i = 0; i < min(top, byHeat.size()); i++) {
+        const HeatRecord& r = byHeat[i];
+        cout << "  0x" << setw(8) << setfill('0') << hex << static_cast<uint64_t>(r.block) * header.blockSize
+             << setfill(' ') << dec << setw(12) << r.counts.reads << setw(12) << r.counts.writes << setw(12)
+             << r.counts.misses << '\n';
+    }
+
+    // rows of `width` blocks that have at least one access, shaded on a log scale
+    map<uint64_t, vector<uint64_t>> rows;
+    for (const HeatRecord& r : records) {
+        vector<uint64_t>& row = rows[r.block / width];
+        if (row.empty()) row.assign(width, 0);
+        row[r.block % width] = total(r.counts);
+    }
+
+    const string SHADES = " .:-=+*#%@";
+    const auto shade = [&](uint64_t count) {
+        if (count == 0 || hottest == 0) return 0.0;
+        return log(static_cast<double>(count) + 1) / log(static_cast<double>(hottest) + 1);
+    };
+
+    cout << "\nOne character per " << header.blockSize << " byte block, darker is hotter, untouched rows skipped\n";
+    for (const auto& row : rows) {
+        cout << "  0x" << setw(8) << setfill('0') << hex << row.first * width * header.blockSize << setfill(' ')
+             << dec << " |";
+        for (uint64_t count : row.second) {
+            size_t level = count ? 1 + static_cast<size_t>(shade(count) * (SHADES.size() - 2)) : 0;
+            cout << SHADES[level];
+        }
+        cout << "|\n";
+    }
+
+    if (!pgm.empty()) {
+        ofstream img(pgm, ofstream::binary);
+        if (!img) {
+            cerr << "Cannot write image: " << pgm << "\n";
+            return 1;
+        }
+        img << "P5\n" << width << ' ' << rows.size() << "\n255\n";
+        for (const auto& row : rows)
+            for (uint64_t count : row.second)
+                img.put(static_cast<char>(static_cast<unsigned char>(shade(count) * 255)));
+    }
+    return 0;
+}